@@ -0,0 +1,203 @@
+#include "binary_vector_store.h"
+#include "distance.h"
+#include "top_k.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <mutex>
+
+namespace humanus {
+
+namespace {
+constexpr double kPi = 3.14159265358979323846;
+}
+
+BinaryVectorStore::BinaryVectorStore(const rag::VectorConfig& config)
+    : rerank_factor_(static_cast<size_t>(std::max(config.rerank_factor, 0))) {
+}
+
+void BinaryVectorStore::reset() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    dim_ = 0;
+    code_bytes_ = 0;
+    floats_ = rag::VectorArena();
+    codes_.clear();
+    ids_.clear();
+    items_.clear();
+    tombstones_.clear();
+    reserved_ = 0;
+    mapping_.reset();
+}
+
+void BinaryVectorStore::reserve(size_t n) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    reserved_ = n;
+    if (dim_ == 0) return;
+    ids_.reserve(n);
+    codes_.reserve(n * code_bytes_);
+    if (rerank_factor_ > 0) floats_.reserve(n);
+}
+
+std::shared_ptr<VectorStore> BinaryVectorStore::clone_empty() {
+    rag::VectorConfig config;
+    config.rerank_factor = static_cast<int>(rerank_factor_);
+    return std::make_shared<BinaryVectorStore>(config);
+}
+
+void BinaryVectorStore::encode(const float* vector, uint8_t* out) const {
+    std::fill(out, out + code_bytes_, 0);
+    for (size_t d = 0; d < dim_; ++d) {
+        if (vector[d] > 0.0f) out[d >> 3] |= static_cast<uint8_t>(1u << (d & 7));
+    }
+}
+
+void BinaryVectorStore::insert(const std::vector<float>& vector, size_t vector_id, const MemoryItem& metadata) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (ids_.empty()) {
+        dim_ = vector.size();
+        code_bytes_ = (dim_ + 63) / 64 * 8;
+        floats_.reset(dim_);
+        ids_.reserve(reserved_);
+        codes_.reserve(reserved_ * code_bytes_);
+        if (rerank_factor_ > 0) floats_.reserve(reserved_);
+    }
+    if (vector.size() != dim_) {
+        std::cerr << "BinaryVectorStore: dimension mismatch (" << vector.size()
+                  << " vs " << dim_ << "), vector " << vector_id << " ignored" << std::endl;
+        return;
+    }
+
+    size_t row = ids_.size();
+    if (rerank_factor_ > 0 && has_floats()) floats_.append(vector.data());
+    auto &codes = codes_.writable();
+    codes.resize(codes.size() + code_bytes_);
+    encode(vector.data(), codes.data() + row * code_bytes_);
+    ids_.push_back(vector_id);
+    tombstones_.on_insert(row, vector_id);
+    items_.set(row, metadata);
+}
+
+std::vector<MemoryItem> BinaryVectorStore::search(const std::vector<float>& query, size_t limit,
+                                                  const rag::DocBitmap* filter) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (ids_.empty() || limit == 0) return {};
+    if (query.size() != dim_) {
+        std::cerr << "BinaryVectorStore: query dimension mismatch (" << query.size()
+                  << " vs " << dim_ << ")" << std::endl;
+        return {};
+    }
+
+    auto skip = [&](size_t row) {
+        if (tombstones_.deleted(row)) return true;
+        return filter && (ids_[row] > UINT32_MAX || !filter->contains(static_cast<uint32_t>(ids_[row])));
+    };
+
+    // 第一阶段：汉明距离越小越相似
+    std::vector<uint8_t> qcode(code_bytes_);
+    encode(query.data(), qcode.data());
+    bool rerank = rerank_factor_ > 0 && has_floats();
+    rag::TopK<size_t> top(rerank ? limit * rerank_factor_ : limit);
+    std::vector<uint32_t> dist(std::min(ids_.size(), kScanRows));
+    for (size_t begin = 0; begin < ids_.size(); begin += kScanRows) {
+        size_t count = std::min(kScanRows, ids_.size() - begin);
+        rag::distance::hamming_scan(qcode.data(), code_at(begin), code_bytes_, count, dist.data());
+        for (size_t i = 0; i < count; ++i) {
+            if (!skip(begin + i)) top.push(begin + i, -static_cast<double>(dist[i]));
+        }
+    }
+    std::vector<std::pair<size_t, double>> ranked = top.take_sorted();
+
+    if (rerank) {
+        // 第二阶段：原始向量精确计算余弦相似度
+        float query_norm = std::sqrt(rag::distance::dot(query.data(), query.data(), dim_));
+        rag::TopK<size_t> exact_top(limit);
+        for (const auto &[row, negative_dist] : ranked) {
+            float norm = floats_.norm(row);
+            double similarity = 0.0;
+            if (query_norm > 0 && norm > 0) {
+                similarity = rag::distance::dot(query.data(), floats_.row(row), dim_) / (query_norm * norm);
+            }
+            exact_top.push(row, similarity);
+        }
+        ranked = exact_top.take_sorted();
+    } else {
+        for (auto &[row, score] : ranked) score = std::cos(kPi * -score / dim_);
+    }
+
+    return items_.collect(ranked, ids_);
+}
+
+bool BinaryVectorStore::remove(size_t vector_id) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    size_t row = tombstones_.remove(vector_id, ids_);
+    if (row == rag::Tombstones::kNone) return false;
+    items_.erase(row);
+    return true;
+}
+
+size_t BinaryVectorStore::size() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return ids_.size() - tombstones_.count();
+}
+
+size_t BinaryVectorStore::code_size() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return code_bytes_;
+}
+
+size_t BinaryVectorStore::memory_usage() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return codes_.memory_usage() + ids_.memory_usage() + tombstones_.memory_usage() +
+           items_.memory_usage();
+}
+
+size_t BinaryVectorStore::float_bytes() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return floats_.memory_usage();
+}
+
+bool BinaryVectorStore::save_snapshot(rag::SnapshotWriter& writer) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    writer.write<uint64_t>(dim_);
+    writer.write<uint64_t>(code_bytes_);
+    writer.write_array(ids_);
+    writer.write_array(codes_);
+    writer.write<uint8_t>(has_floats() ? 1 : 0);
+    if (has_floats()) floats_.save(writer);
+    tombstones_.save(writer);
+    return writer.ok();
+}
+
+bool BinaryVectorStore::load_snapshot(rag::SectionReader& reader) {
+    uint64_t dim = 0, code_bytes = 0;
+    uint8_t with_floats = 0;
+    rag::MappedArray<uint64_t> ids;
+    rag::MappedArray<uint8_t, rag::AlignedAllocator<uint8_t, rag::VectorArena::kAlignment>> codes;
+    rag::VectorArena floats;
+    rag::Tombstones tombstones;
+    bool ok = reader.read(dim) && reader.read(code_bytes) && reader.read_array(ids) && reader.read_array(codes) &&
+              reader.read(with_floats) && (!with_floats || floats.load(reader));
+    size_t n = ids.size();
+    ok = ok && code_bytes == (dim + 63) / 64 * 8 && codes.size() == n * code_bytes;
+    if (ok && with_floats) ok = floats.size() == n && floats.dim() == dim;
+    ok = ok && tombstones.load(reader, n);
+    if (!ok) {
+        reader.fail();
+        std::cerr << "BinaryVectorStore: corrupt vector snapshot section" << std::endl;
+        return false;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    dim_ = dim;
+    code_bytes_ = code_bytes;
+    ids_ = std::move(ids);
+    codes_ = std::move(codes);
+    floats_ = std::move(floats);
+    tombstones_ = std::move(tombstones);
+    items_.clear();
+    reserved_ = 0;
+    mapping_ = reader.file();
+    return true;
+}
+
+} // namespace humanus
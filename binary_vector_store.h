@@ -0,0 +1,64 @@
+#pragma once
+#include "config.h"
+#include "mapped_array.h"
+#include "tombstones.h"
+#include "vector_arena.h"
+#include "vector_store.h"
+#include <cstdint>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace humanus {
+
+// 二值量化（符号位）预筛 + 原始向量重打分：每个分量只保留符号位（大于0为1），768维每向量96字节，为 float32 的1/32
+// 检索时先对全部行的二值码做汉明距离扫描（异或 + popcount），取距离最小的 limit * rerank_factor 行，
+// 再用 float32 原始向量精确计算余弦相似度重排；二值码不需要训练，插入即编码
+// 符号位只保留向量所在的象限，分量全为非负的向量（如 TF-IDF）几乎没有区分度，这类向量应使用 int8 量化
+// rerank_factor 为 0 时不重排也不保留原始向量，相似度按 cos(π · 汉明距离 / dim) 估计
+// 快照同时保存二值码与原始向量，打开后原始向量留在映射文件中，只有重排访问到的行会读入内存
+class BinaryVectorStore : public VectorStore {
+public:
+    static constexpr size_t kScanRows = 4096;  // 每次汉明距离扫描的行数
+
+    explicit BinaryVectorStore(const rag::VectorConfig& config = rag::VectorConfig{});
+
+    void reset() override;
+    void insert(const std::vector<float>& vector, size_t vector_id, const MemoryItem& metadata) override;
+    std::vector<MemoryItem> search(const std::vector<float>& query, size_t limit,
+                                   const rag::DocBitmap* filter = nullptr) override;
+    void reserve(size_t n) override;
+    std::shared_ptr<VectorStore> clone_empty() override;
+    VectorIndexKind kind() const override { return VectorIndexKind::BINARY; }
+    // 删除的行只做标记，检索时跳过，重建前不回收
+    bool remove(size_t vector_id) override;
+
+    bool save_snapshot(rag::SnapshotWriter& writer) override;
+    bool load_snapshot(rag::SectionReader& reader) override;
+
+    size_t size();
+    size_t code_size();
+    // 二值码与ID的字节数；原始向量单独统计
+    size_t memory_usage();
+    size_t float_bytes();
+
+private:
+    const uint8_t* code_at(size_t row) const { return codes_.data() + row * code_bytes_; }
+    bool has_floats() const { return floats_.size() == ids_.size(); }
+
+    void encode(const float* vector, uint8_t* out) const;
+
+    size_t rerank_factor_;
+    size_t dim_ = 0;                 // 第一次插入时确定
+    size_t code_bytes_ = 0;          // 每行二值码字节数，按64位补齐
+    rag::VectorArena floats_;        // 原始向量（不重排时不保留）
+    rag::MappedArray<uint8_t, rag::AlignedAllocator<uint8_t, rag::VectorArena::kAlignment>> codes_;
+    rag::MappedArray<uint64_t> ids_;
+    ItemColumn items_;                              // 插入时传入的非空元数据
+    rag::Tombstones tombstones_;                    // 已删除的行
+    size_t reserved_ = 0;
+    std::shared_ptr<const rag::MappedFile> mapping_;
+    std::shared_mutex mutex_;
+};
+
+} // namespace humanus
@@ -1,10 +1,97 @@
 #include "bm25.h"
+#include "top_k.h"
+#include <atomic>
 #include <cmath>
 #include <algorithm>
+#include <mutex>
+#include <limits>
+#include <map>
+#include <iostream>
 
 namespace rag {
 
-BM25Indexer::BM25Indexer(const BM25Config& config) : k1_(config.k1), b_(config.b) {
+namespace {
+
+constexpr uint32_t kEndDoc = std::numeric_limits<uint32_t>::max();
+
+// 上界比较时的相对容差：上界与真实分数的求和顺序不同，
+// 留出浮点舍入余量，保证剪枝不会误删应进入top-K的文档
+constexpr double kBoundSlack = 1e-9;
+
+// 并行建索引时每个分片的最少文档数，分片太小时合并开销超过并行收益
+constexpr size_t kMinShardDocs = 1024;
+
+// 每个工作线程分到的分片数，分片更细可以平衡各分片分词耗时的差异
+constexpr size_t kShardsPerWorker = 4;
+
+// 查询用的线程局部累加数组（元素全为0）调整到 n 项：只在超过 n 的两倍时收缩，
+// 每个线程保留的内存不超过最近查询的索引文档数的两倍，同一索引的各段、各次查询之间不反复分配
+template <typename T>
+void reserve_scratch(std::vector<T>& acc, size_t n) {
+    if (acc.size() > 2 * n) {
+        acc.resize(n);
+        acc.shrink_to_fit();
+    } else if (acc.size() < n) {
+        acc.resize(n, T());
+    }
+}
+
+// 批量查询每批的查询数：同一批共享倒排表解码结果，批之间释放读锁让写操作进入
+constexpr size_t kBatchQueries = 512;
+
+// 批量查询缓存的已解码倒排项上限（约 12 字节/项），超过时清空缓存
+constexpr size_t kBatchCachePostings = 4 << 20;
+
+// 跳过 n 个变长字节编码的值
+const uint8_t* skip_varbytes(const uint8_t* p, size_t n) {
+    while (n > 0) {
+        if (!(*p++ & 0x80)) --n;
+    }
+    return p;
+}
+
+// 在升序数组 v[from, ...) 中倍增查找第一个 >= target 的位置
+size_t gallop(const std::vector<uint32_t>& v, size_t from, uint32_t target) {
+    if (from >= v.size() || v[from] >= target) return from;
+    size_t lo = from, step = 1;
+    while (lo + step < v.size() && v[lo + step] < target) {
+        lo += step;
+        step <<= 1;
+    }
+    size_t hi = std::min(lo + step, v.size());
+    return std::lower_bound(v.begin() + lo + 1, v.begin() + hi, target) - v.begin();
+}
+
+// 快照中的偏移量数组：n + 1 项，从0开始单调不减，最后一项为数据总长
+bool monotone(const MappedArray<uint64_t>& offsets, size_t n, uint64_t total) {
+    if (offsets.size() != n + 1 || offsets[0] != 0 || offsets[n] != total) return false;
+    for (size_t i = 0; i < n; ++i) {
+        if (offsets[i] > offsets[i + 1]) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+BM25QueryMode parse_bm25_query_mode(const std::string& mode) {
+    if (mode == "wand") return BM25QueryMode::WAND;
+    if (mode == "block_max_wand") return BM25QueryMode::BLOCK_MAX_WAND;
+    if (mode == "impact") return BM25QueryMode::IMPACT;
+    return BM25QueryMode::EXHAUSTIVE;
+}
+
+BM25Indexer::BM25Indexer(const BM25Config& config)
+    : k1_(config.k1), b_(config.b), mode_(parse_bm25_query_mode(config.query_mode)),
+      codec_(parse_posting_codec(config.posting_codec)),
+      store_positions_(config.store_positions),
+      impact_budget_(static_cast<size_t>(std::max(config.impact_budget, 0))),
+      query_shards_(static_cast<size_t>(std::max(config.query_shards, 0))),
+      parallel_query_min_docs_(static_cast<size_t>(std::max(config.parallel_query_min_docs, 0))),
+      segment_docs_(static_cast<size_t>(std::max(config.segment_docs, 1))),
+      merge_factor_(static_cast<size_t>(std::max(config.merge_factor, 2))) {
+    data_.codec = codec_;
+    data_.positions = store_positions_;
+    data_.impacts = mode_ == BM25QueryMode::IMPACT;
     // 创建默认tokenizer
     TokenizerConfig tokenizer_config;
     tokenizer_ = std::make_shared<Tokenizer>(tokenizer_config);
@@ -16,6 +103,11 @@ BM25Indexer::BM25Indexer(double k1, double b) : k1_(k1), b_(b) {
     tokenizer_ = std::make_shared<Tokenizer>(tokenizer_config);
 }
 
+BM25Indexer::~BM25Indexer() {
+    // 后台合并任务引用 this，析构前等待其结束
+    wait_for_merges();
+}
+
 void BM25Indexer::set_tokenizer(std::shared_ptr<Tokenizer> tokenizer) {
     tokenizer_ = tokenizer;
 }
@@ -24,6 +116,27 @@ void BM25Indexer::set_tokenizer_config(const TokenizerConfig& config) {
     tokenizer_ = std::make_shared<Tokenizer>(config);
 }
 
+void BM25Indexer::set_query_mode(BM25QueryMode mode) {
+    auto lock = write_lock();
+    mode_ = mode;
+}
+
+void BM25Indexer::set_thread_pool(std::shared_ptr<ThreadPool> pool) {
+    std::lock_guard<std::mutex> writer(write_mutex_);
+    thread_pool_ = std::move(pool);
+}
+
+std::shared_lock<std::shared_mutex> BM25Indexer::read_lock() {
+    std::lock_guard<std::mutex> gate(gate_);
+    return std::shared_lock<std::shared_mutex>(mutex_);
+}
+
+std::unique_lock<std::shared_mutex> BM25Indexer::write_lock() {
+    // 拿到写锁后释放 gate_，之后到达的读者在 mutex_ 上等待
+    std::lock_guard<std::mutex> gate(gate_);
+    return std::unique_lock<std::shared_mutex>(mutex_);
+}
+
 std::vector<std::string> BM25Indexer::tokenize(const std::string& text, Language lang) const {
     if (tokenizer_) {
         return tokenizer_->tokenize(text, lang);
@@ -39,65 +152,1678 @@ std::vector<std::string> BM25Indexer::tokenize(const std::string& text, Language
     }
 }
 
+std::vector<TermId> BM25Indexer::intern_tokens(const std::string& text, Vocabulary& vocab) const {
+    if (tokenizer_) {
+        return tokenizer_->intern_tokens(text, vocab);
+    }
+    std::vector<TermId> ids;
+    for (const auto& token : tokenize(text)) {
+        ids.push_back(vocab.intern(token));
+    }
+    return ids;
+}
+
+std::vector<TermId> BM25Indexer::lookup_tokens(const std::string& text, Language lang) const {
+    if (tokenizer_) {
+        return tokenizer_->tokenize_ids(text, data_.vocab, lang);
+    }
+    std::vector<TermId> ids;
+    for (const auto& token : tokenize(text, lang)) {
+        TermId id = data_.vocab.lookup(token);
+        if (id != kInvalidTermId) ids.push_back(id);
+    }
+    return ids;
+}
+
+
+const BM25Indexer::TermEntry* BM25Indexer::Segment::find(TermId id) const {
+    if (dense) return id < terms.size() ? &terms[id] : nullptr;
+    if (!sealed) {
+        auto it = term_index.find(id);
+        return it == term_index.end() ? nullptr : &terms[it->second];
+    }
+    auto it = std::lower_bound(term_ids.begin(), term_ids.end(), id);
+    return it != term_ids.end() && *it == id ? &terms[it - term_ids.begin()] : nullptr;
+}
+
+BM25Indexer::TermEntry& BM25Indexer::Segment::get_or_add(TermId id, PostingCodec codec) {
+    if (dense) {
+        while (terms.size() <= id) {
+            terms.emplace_back();
+            terms.back().postings = PostingList(codec);
+        }
+        return terms[id];
+    }
+    auto [it, inserted] = term_index.emplace(id, static_cast<uint32_t>(terms.size()));
+    if (inserted) {
+        terms.emplace_back();
+        terms.back().postings = PostingList(codec);
+    }
+    return terms[it->second];
+}
+
 void BM25Indexer::fit(const std::vector<Chunk>& chunks) {
-    std::unique_lock<std::shared_mutex> lock(mutex_);
-    N_ = chunks.size();
-    tfs_.clear();
-    tfs_.reserve(N_);
-    df_.clear();
-    double total_len = 0.0;
+    std::lock_guard<std::mutex> writer(write_mutex_);
+    bool impacts;
+    {
+        auto lock = read_lock();
+        impacts = mode_ == BM25QueryMode::IMPACT;
+    }
+
+    // 在锁外构建新索引，构建期间查询继续使用旧索引
+    size_t workers = thread_pool_ ? thread_pool_->size() : 0;
+    size_t shards = std::min(workers * kShardsPerWorker, chunks.size() / kMinShardDocs);
+
+    IndexData data;
+    if (shards <= 1) {
+        data = build_shard(chunks, 0, chunks.size());
+        seal_segment(*data.segments.back());
+    } else {
+        std::vector<std::future<IndexData>> futures;
+        futures.reserve(shards);
+        for (size_t s = 0; s < shards; ++s) {
+            size_t begin = chunks.size() * s / shards;
+            size_t end = chunks.size() * (s + 1) / shards;
+            futures.push_back(thread_pool_->submit([this, &chunks, begin, end] {
+                return build_shard(chunks, begin, end);
+            }));
+        }
 
-    for (size_t i = 0; i < N_; ++i) {
-        const auto &c = chunks[i];
-        std::unordered_map<std::string, size_t> tf;
+        std::vector<IndexData> parts;
+        parts.reserve(shards);
+        for (auto &f : futures) parts.push_back(f.get());
+        data = merge_shards(std::move(parts));
+    }
+
+    // 影响值的量化单位由本次构建的统计量确定，之后封存、合并的段以及查询时现算都沿用
+    data.impacts = impacts;
+    if (!data.segments.empty()) {
+        data.impact_unit = impact_unit(data, *data.segments.back());
+        if (impacts) build_segment_impacts(data, *data.segments.back(), thread_pool_ != nullptr);
+    }
+
+    auto lock = write_lock();
+    data_ = std::move(data);
+    ++generation_;
+    avgdl_ = data_.live_docs ? (data_.total_len / (double)data_.live_docs) : 0.0;
+}
+
+BM25Indexer::IndexData BM25Indexer::build_shard(const std::vector<Chunk>& chunks, size_t begin, size_t end) const {
+    IndexData data;
+    data.codec = codec_;
+    data.positions = store_positions_;
+    data.segments.push_back(std::make_shared<Segment>());
+    data.segments.back()->dense = true;
+    data.doc_len.reserve(end - begin);
+    data.live.reserve(end - begin);
+    for (size_t i = begin; i < end; ++i) {
+        append_document(data, intern_tokens(chunks[i].text, data.vocab), chunks[i].doc_id);
+    }
+    return data;
+}
+
+BM25Indexer::IndexData BM25Indexer::merge_shards(std::vector<IndexData>&& shards) const {
+    IndexData data;
+    data.codec = codec_;
+    data.positions = store_positions_;
+    size_t total_docs = 0;
+    for (const auto &shard : shards) total_docs += shard.doc_len.size();
+    data.doc_len.reserve(total_docs);
+    data.live.reserve(total_docs);
+
+    // 词典与按文档存放的数据按分片顺序串行合并
+    // 分片词典的ID即分片内首次出现的顺序，依次映射得到的全局ID与单线程构建相同
+    std::vector<std::vector<TermId>> remaps(shards.size());
+    std::vector<uint32_t> bases(shards.size());
+    for (size_t s = 0; s < shards.size(); ++s) {
+        auto &shard = shards[s];
+        auto &remap = remaps[s];
+        uint32_t base = static_cast<uint32_t>(data.doc_len.size());
+        bases[s] = base;
+
+        remap.resize(shard.vocab.size());
+        for (TermId t = 0; t < remap.size(); ++t) {
+            remap[t] = data.vocab.intern(shard.vocab.term(t));
+        }
+        auto &df = data.df.writable();
+        df.resize(data.vocab.size(), 0);
+        for (TermId t = 0; t < remap.size(); ++t) df[remap[t]] += shard.df[t];
 
-        // 使用新的tokenizer进行分词
-        auto tokens = tokenize(c.text);
+        auto &doc_len = data.doc_len.writable();
+        auto &live = data.live.writable();
+        doc_len.insert(doc_len.end(), shard.doc_len.begin(), shard.doc_len.end());
+        live.insert(live.end(), shard.live.begin(), shard.live.end());
 
-        for (const auto& token : tokens) {
-            ++tf[token];
+        auto &fwd_terms = data.fwd_terms.writable();
+        auto &fwd_offsets = data.fwd_offsets.writable();
+        uint64_t fwd_base = fwd_terms.size();
+        for (TermId t : shard.fwd_terms) fwd_terms.push_back(remap[t]);
+        for (size_t i = 1; i < shard.fwd_offsets.size(); ++i) {
+            fwd_offsets.push_back(fwd_base + shard.fwd_offsets[i]);
         }
 
-        for (auto &p : tf) df_[p.first]++;
-        tfs_.push_back(std::move(tf));
-        total_len += tokens.size();
+        for (auto &[doc_id, docs] : shard.doc_chunks) {
+            auto &dst = data.doc_chunks[doc_id];
+            for (uint32_t d : docs) dst.push_back(d + base);
+        }
+        data.live_docs += shard.live_docs;
+        data.total_len += shard.total_len;
+    }
+
+    auto segment = std::make_shared<Segment>();
+    segment->dense = true;
+    segment->sealed = true;
+    segment->doc_end = static_cast<uint32_t>(total_docs);
+    if (!data.vocab.empty()) segment->get_or_add(static_cast<TermId>(data.vocab.size() - 1), data.codec);
+    data.segments.push_back(segment);
+
+    // 倒排表按全局词项区间并行拼接，每个区间内按分片顺序追加，文档下标保持升序
+    // 分片边界打乱了块划分，拼接后重算块元数据
+    size_t workers = thread_pool_->size();
+    size_t num_terms = segment->terms.size();
+    std::vector<std::future<void>> futures;
+    for (size_t w = 0; w < workers; ++w) {
+        TermId begin = static_cast<TermId>(num_terms * w / workers);
+        TermId end = static_cast<TermId>(num_terms * (w + 1) / workers);
+        futures.push_back(thread_pool_->submit([&, begin, end] {
+            for (size_t s = 0; s < shards.size(); ++s) {
+                const auto &remap = remaps[s];
+                const auto &src_terms = shards[s].segments.back()->terms;
+                uint32_t base = bases[s];
+                for (TermId t = 0; t < remap.size(); ++t) {
+                    if (remap[t] < begin || remap[t] >= end) continue;
+                    auto &dst = segment->terms[remap[t]];
+                    src_terms[t].postings.for_each([&](uint32_t doc, uint32_t tf) {
+                        dst.postings.append(doc + base, tf);
+                    });
+                    // 词位置按倒排项顺序存放，与文档下标无关，直接拼接
+                    const auto &positions = src_terms[t].positions;
+                    if (!positions.empty()) {
+                        dst.positions.writable().insert(dst.positions.writable().end(), positions.begin(), positions.end());
+                    }
+                }
+            }
+            for (TermId g = begin; g < end; ++g) {
+                segment->terms[g].postings.seal();
+                segment->terms[g].postings.shrink_to_fit();
+                segment->terms[g].positions.shrink_to_fit();
+                build_blocks(segment->terms[g], data.doc_len.data(), 0);
+            }
+        }));
+    }
+    for (auto &f : futures) f.get();
+
+    return data;
+}
+
+size_t BM25Indexer::add_documents(const std::vector<Chunk>& chunks) {
+    // 分词最耗时，不持有任何锁
+    std::vector<std::vector<std::string>> tokens;
+    tokens.reserve(chunks.size());
+    for (const auto &c : chunks) {
+        tokens.push_back(tokenize(c.text));
+    }
+
+    std::lock_guard<std::mutex> writer(write_mutex_);
+    size_t first;
+    {
+        auto lock = write_lock();
+        first = data_.doc_len.size();
+        std::vector<TermId> touched;
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            std::vector<TermId> ids;
+            ids.reserve(tokens[i].size());
+            for (const auto &token : tokens[i]) {
+                ids.push_back(data_.vocab.intern(token));
+            }
+
+            // 最后一段已封存时开启新的可变段
+            if (data_.segments.empty() || data_.segments.back()->sealed) {
+                auto segment = std::make_shared<Segment>();
+                segment->doc_begin = segment->doc_end = static_cast<uint32_t>(data_.doc_len.size());
+                data_.segments.push_back(segment);
+            }
+            touched.insert(touched.end(), ids.begin(), ids.end());
+            append_document(data_, std::move(ids), chunks[i].doc_id);
+
+            auto &active = *data_.segments.back();
+            if (active.docs() >= segment_docs_) {
+                seal_segment(active);
+                if (data_.impacts) {
+                    if (data_.impact_unit <= 0) data_.impact_unit = impact_unit(data_, active);
+                    build_segment_impacts(data_, active, false);
+                }
+                touched.clear();
+            }
+        }
+
+        // 编码本批次追加到可变段的尾部条目
+        auto &active = *data_.segments.back();
+        if (!active.sealed) {
+            std::sort(touched.begin(), touched.end());
+            touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+            for (TermId id : touched) {
+                active.terms[active.term_index.at(id)].postings.seal();
+            }
+        }
+        avgdl_ = data_.live_docs ? (data_.total_len / (double)data_.live_docs) : 0.0;
     }
-    avgdl_ = N_ ? (total_len / (double)N_) : 0.0;
+
+    schedule_merges();
+    return first;
 }
 
-double BM25Indexer::idf(const std::string& term) const {
-    auto it = df_.find(term);
-    double df = (it == df_.end()) ? 0.0 : (double)it->second;
-    return std::log(1.0 + (N_ - df + 0.5) / (df + 0.5));
+std::vector<size_t> BM25Indexer::remove_document(const std::string& doc_id) {
+    std::lock_guard<std::mutex> writer(write_mutex_);
+    std::vector<size_t> removed;
+    {
+        auto lock = write_lock();
+        for (uint32_t doc : take_doc_chunks(data_, doc_id)) {
+            if (!data_.live[doc]) continue;
+            data_.live.writable()[doc] = 0;
+            --data_.live_docs;
+            data_.total_len -= data_.doc_len[doc];
+            auto &df = data_.df.writable();
+            for (uint64_t k = data_.fwd_offsets[doc]; k < data_.fwd_offsets[doc + 1]; ++k) {
+                --df[data_.fwd_terms[k]];
+            }
+            // 倒排表不修改，残留项由合并清理；块上界保留已删除文档的统计量只会偏大，仍然是合法上界
+            ++segment_of(data_, doc).dead_docs;
+            removed.push_back(doc);
+        }
+        avgdl_ = data_.live_docs ? (data_.total_len / (double)data_.live_docs) : 0.0;
+    }
+
+    if (!removed.empty()) schedule_merges();
+    return removed;
 }
 
-std::vector<std::pair<size_t, double>> BM25Indexer::query(const std::vector<std::string>& terms, size_t topK) {
-    std::shared_lock<std::shared_mutex> lock(mutex_);
-    std::vector<std::pair<size_t, double>> scores;
-    scores.reserve(N_);
-    for (size_t i = 0; i < N_; ++i) {
-        double score = 0.0;
-        double doclen = 0.0;
-        for (auto &p : tfs_[i]) doclen += p.second;
+void BM25Indexer::append_document(IndexData& data, std::vector<TermId> ids, const std::string& doc_id) {
+    uint32_t doc = static_cast<uint32_t>(data.doc_len.size());
+    uint32_t len = static_cast<uint32_t>(ids.size());
+    data.doc_len.push_back(len);
+    data.live.push_back(1);
+    ++data.live_docs;
+    data.total_len += len;
+    data.doc_chunks[doc_id].push_back(doc);
+
+    auto &segment = *data.segments.back();
+    segment.doc_end = doc + 1;
+    auto &df = data.df.writable();
+    if (df.size() < data.vocab.size()) df.resize(data.vocab.size(), 0);
+
+    // (词项, 位置) 排序后，同一词项的位置升序相邻
+    std::vector<std::pair<TermId, uint32_t>> terms(ids.size());
+    for (uint32_t p = 0; p < ids.size(); ++p) terms[p] = {ids[p], p};
+    std::sort(terms.begin(), terms.end());
+    std::vector<uint32_t> gaps;
+
+    // 文档下标单调递增，倒排表只需追加，块元数据只需更新最后一块
+    for (size_t j = 0; j < terms.size(); ) {
+        TermId id = terms[j].first;
+        size_t k = j;
+        while (k < terms.size() && terms[k].first == id) ++k;
+        auto &entry = segment.get_or_add(id, data.codec);
+        uint32_t tf = static_cast<uint32_t>(k - j);
+        entry.postings.append(doc, tf);
+        ++df[id];
+        bool new_block = (entry.postings.size() - 1) % kBlockSize == 0;
+        if (data.positions) {
+            auto &positions = entry.positions.writable();
+            if (new_block) entry.position_blocks.push_back(static_cast<uint32_t>(positions.size()));
+            gaps.clear();
+            for (size_t i = j; i < k; ++i) gaps.push_back(terms[i].second - (i > j ? terms[i - 1].second : 0));
+            codec::encode_varbyte(gaps.data(), gaps.size(), positions);
+        }
+        if (new_block) {
+            entry.blocks.push_back({doc, tf, len});
+        } else {
+            auto &block = entry.blocks.writable().back();
+            block.last_doc = doc;
+            block.max_tf = std::max(block.max_tf, tf);
+            block.min_len = std::min(block.min_len, len);
+        }
+        entry.max_tf = std::max(entry.max_tf, tf);
+        entry.min_len = std::min(entry.min_len, len);
+        data.fwd_terms.push_back(id);
+        j = k;
+    }
+    data.fwd_offsets.push_back(data.fwd_terms.size());
+}
+
+void BM25Indexer::seal_segment(Segment& segment) {
+    for (auto &entry : segment.terms) {
+        entry.postings.seal();
+        entry.postings.shrink_to_fit();
+        entry.blocks.shrink_to_fit();
+        entry.positions.shrink_to_fit();
+        entry.position_blocks.shrink_to_fit();
+    }
+    if (!segment.dense && !segment.sealed) {
+        std::vector<std::pair<TermId, uint32_t>> order(segment.term_index.begin(), segment.term_index.end());
+        std::sort(order.begin(), order.end());
+        std::vector<TermEntry> terms;
+        std::vector<TermId> ids;
+        terms.reserve(order.size());
+        ids.reserve(order.size());
+        for (const auto &[id, i] : order) {
+            ids.push_back(id);
+            terms.push_back(std::move(segment.terms[i]));
+        }
+        segment.terms = std::move(terms);
+        segment.term_ids.writable() = std::move(ids);
+        std::unordered_map<TermId, uint32_t>().swap(segment.term_index);
+    }
+    segment.sealed = true;
+}
+
+std::vector<uint32_t> BM25Indexer::take_doc_chunks(IndexData& data, const std::string& doc_id) {
+    std::vector<uint32_t> docs;
+
+    // 快照中的条目不可修改，删除后其中的文档都已标记为删除，再次查到时会被跳过
+    const auto &ids = data.snapshot_doc_ids;
+    size_t lo = 0, hi = ids.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ids[mid] < doc_id) lo = mid + 1; else hi = mid;
+    }
+    if (lo < ids.size() && ids[lo] == doc_id) {
+        const auto &offsets = data.snapshot_doc_offsets;
+        docs.assign(data.snapshot_docs.begin() + offsets[lo], data.snapshot_docs.begin() + offsets[lo + 1]);
+    }
+
+    auto it = data.doc_chunks.find(doc_id);
+    if (it != data.doc_chunks.end()) {
+        docs.insert(docs.end(), it->second.begin(), it->second.end());
+        data.doc_chunks.erase(it);
+    }
+    return docs;
+}
+
+BM25Indexer::Segment& BM25Indexer::segment_of(IndexData& data, uint32_t doc) {
+    // 空段与后一段的起点相同，upper_bound 取到的是包含该文档的最后一段
+    auto it = std::upper_bound(data.segments.begin(), data.segments.end(), doc,
+                               [](uint32_t d, const std::shared_ptr<Segment>& s) { return d < s->doc_begin; });
+    return **(it - 1);
+}
+
+void BM25Indexer::build_blocks(TermEntry& entry, const uint32_t* doc_len, uint32_t doc_base) {
+    const auto &postings = entry.postings;
+    entry.blocks.clear();
+    entry.blocks.reserve(postings.num_blocks());
+    entry.max_tf = 0;
+    entry.min_len = std::numeric_limits<uint32_t>::max();
+
+    // 有词位置时每项至少一个字节，按各项的 tf 跳过得到每块的起点
+    bool positions = !entry.positions.empty();
+    const uint8_t* pos = entry.positions.data();
+    entry.position_blocks.clear();
+
+    uint32_t docs[kBlockSize];
+    uint32_t tfs[kBlockSize];
+    for (size_t b = 0; b < postings.num_blocks(); ++b) {
+        size_t n = postings.decode_docs(b, docs);
+        postings.decode_tfs(b, tfs);
+        BlockMax block{docs[n - 1], 0, std::numeric_limits<uint32_t>::max()};
+        for (size_t i = 0; i < n; ++i) {
+            block.max_tf = std::max(block.max_tf, tfs[i]);
+            block.min_len = std::min(block.min_len, doc_len[docs[i] - doc_base]);
+        }
+        if (positions) {
+            entry.position_blocks.push_back(static_cast<uint32_t>(pos - entry.positions.data()));
+            for (size_t i = 0; i < n; ++i) pos = skip_varbytes(pos, tfs[i]);
+        }
+        entry.max_tf = std::max(entry.max_tf, block.max_tf);
+        entry.min_len = std::min(entry.min_len, block.min_len);
+        entry.blocks.push_back(block);
+    }
+    entry.blocks.shrink_to_fit();
+    entry.position_blocks.shrink_to_fit();
+}
+
+BM25Indexer::ImpactStats BM25Indexer::impact_stats(const IndexData& data) const {
+    ImpactStats stats;
+    stats.df = data.df.data();
+    stats.live_docs = data.live_docs;
+    stats.avgdl = data.live_docs ? data.total_len / (double)data.live_docs : 0.0;
+    stats.unit = data.impact_unit;
+    return stats;
+}
+
+double BM25Indexer::impact_unit(const IndexData& data, const Segment& segment) const {
+    // 取段内所有词项分数上界的最大值对应 255；之后统计量变化导致的超出部分截断为 255
+    auto stats = impact_stats(data);
+    double max_score = 0.0;
+    auto bound = [&](TermId id, const TermEntry& entry) {
+        if (entry.postings.empty()) return;
+        double idf_v = idf(stats.df[id], stats.live_docs);
+        max_score = std::max(max_score, term_score(idf_v, entry.max_tf, entry.min_len, stats.avgdl));
+    };
+    for (size_t t = 0; t < segment.terms.size(); ++t) {
+        bound(segment.dense ? static_cast<TermId>(t) : segment.term_ids[t], segment.terms[t]);
+    }
+    return max_score > 0 ? max_score / 255.0 : 1.0;
+}
+
+void BM25Indexer::encode_impacts(const TermEntry& entry, double idf_v, double avgdl, double unit,
+                                 const uint32_t* doc_len, uint32_t doc_base,
+                                 std::vector<uint8_t>& bytes, std::vector<ImpactRun>& runs) const {
+    // (影响值降序, 文档升序) 排序后按影响值分组
+    std::vector<std::pair<uint32_t, uint32_t>> postings;
+    postings.reserve(entry.postings.size());
+    entry.postings.for_each([&](uint32_t doc, uint32_t tf) {
+        double q = std::round(term_score(idf_v, tf, doc_len[doc - doc_base], avgdl) / unit);
+        uint32_t impact = static_cast<uint32_t>(std::min(std::max(q, 1.0), 255.0));
+        postings.emplace_back(255 - impact, doc);
+    });
+    std::sort(postings.begin(), postings.end());
+
+    uint32_t deltas[kBlockSize];
+    for (size_t i = 0; i < postings.size(); ) {
+        size_t j = i;
+        uint32_t prev = 0;
+        size_t n = 0;
+        while (j < postings.size() && postings[j].first == postings[i].first) {
+            deltas[n++] = postings[j].second - prev;
+            prev = postings[j].second;
+            if (n == kBlockSize) {
+                codec::encode_varbyte(deltas, n, bytes);
+                n = 0;
+            }
+            ++j;
+        }
+        codec::encode_varbyte(deltas, n, bytes);
+        runs.push_back({static_cast<uint32_t>(bytes.size()), static_cast<uint32_t>(j - i), 255 - postings[i].first});
+        i = j;
+    }
+}
+
+void BM25Indexer::build_impacts(TermEntry& entry, TermId id, const ImpactStats& stats,
+                                const uint32_t* doc_len, uint32_t doc_base) const {
+    std::vector<uint8_t> bytes;
+    std::vector<ImpactRun> runs;
+    encode_impacts(entry, idf(stats.df[id], stats.live_docs), stats.avgdl, stats.unit, doc_len, doc_base, bytes, runs);
+    bytes.shrink_to_fit();
+    runs.shrink_to_fit();
+    entry.impact_bytes.writable() = std::move(bytes);
+    entry.impact_runs.writable() = std::move(runs);
+}
+
+void BM25Indexer::build_segment_impacts(IndexData& data, Segment& segment, bool parallel) const {
+    auto stats = impact_stats(data);
+    auto build = [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; ++t) {
+            TermId id = segment.dense ? static_cast<TermId>(t) : segment.term_ids[t];
+            build_impacts(segment.terms[t], id, stats, data.doc_len.data(), 0);
+        }
+    };
+    size_t num_terms = segment.terms.size();
+    if (!parallel || !thread_pool_) {
+        build(0, num_terms);
+        return;
+    }
+    size_t workers = thread_pool_->size();
+    std::vector<std::future<void>> futures;
+    for (size_t w = 0; w < workers; ++w) {
+        futures.push_back(thread_pool_->submit([&, w] {
+            build(num_terms * w / workers, num_terms * (w + 1) / workers);
+        }));
+    }
+    for (auto &f : futures) f.get();
+}
+
+std::pair<size_t, size_t> BM25Indexer::pick_merge(const IndexData& data) const {
+    const auto &segments = data.segments;
+    size_t n = segments.size();
+    if (n > 0 && !segments.back()->sealed) --n;  // 可变段不参与合并
+
+    // 按文档数分层：第 t 层的段不超过 segment_docs * merge_factor^t
+    auto tier = [&](size_t docs) {
+        size_t t = 0;
+        for (size_t cap = segment_docs_; docs > cap; cap *= merge_factor_) ++t;
+        return t;
+    };
+
+    // 同一层相邻的段凑满 merge_factor 个时合并，优先合并最低层
+    size_t best_first = 0, best_tier = std::numeric_limits<size_t>::max();
+    for (size_t i = 0; i < n; ) {
+        size_t t = tier(segments[i]->docs());
+        size_t j = i;
+        while (j < n && tier(segments[j]->docs()) == t) ++j;
+        if (j - i >= merge_factor_ && t < best_tier) {
+            best_tier = t;
+            best_first = i;
+        }
+        i = j;
+    }
+    if (best_tier != std::numeric_limits<size_t>::max()) return {best_first, best_first + merge_factor_};
+
+    // 已删除文档的残留项超过1/4时单独重写该段
+    for (size_t i = 0; i < n; ++i) {
+        if (segments[i]->dead_docs * 4 > segments[i]->docs()) return {i, i + 1};
+    }
+    return {0, 0};
+}
+
+std::shared_ptr<BM25Indexer::Segment> BM25Indexer::merge_segments(
+        const std::vector<std::shared_ptr<Segment>>& run,
+        const std::vector<uint8_t>& live,
+        const std::vector<uint32_t>& doc_len,
+        PostingCodec codec, const ImpactStats* impacts) const {
+    auto merged = std::make_shared<Segment>();
+    merged->doc_begin = run.front()->doc_begin;
+    merged->doc_end = run.back()->doc_end;
+    merged->sealed = true;
+
+    // 含稠密段时结果也是稠密段，否则只保留出现过的词项
+    std::vector<TermId> ids;
+    for (const auto &segment : run) {
+        merged->dense = merged->dense || segment->dense;
+        if (segment->dense) {
+            for (TermId id = 0; id < segment->terms.size(); ++id) {
+                if (!segment->terms[id].postings.empty()) ids.push_back(id);
+            }
+        } else {
+            ids.insert(ids.end(), segment->term_ids.begin(), segment->term_ids.end());
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+    // 各段文档区间首尾相接，按段顺序拼接倒排表即保持文档升序
+    uint32_t base = merged->doc_begin;
+    auto merge_term = [&](TermId id, TermEntry& dst) {
+        dst.postings = PostingList(codec);
+        for (const auto &segment : run) {
+            const TermEntry* src = segment->find(id);
+            if (!src) continue;
+            bool positions = !src->positions.empty();
+            const uint8_t* pos = src->positions.data();
+            src->postings.for_each([&](uint32_t doc, uint32_t tf) {
+                const uint8_t* next = positions ? skip_varbytes(pos, tf) : pos;
+                if (live[doc - base]) {
+                    dst.postings.append(doc, tf);
+                    if (positions) dst.positions.writable().insert(dst.positions.writable().end(), pos, next);
+                }
+                pos = next;
+            });
+        }
+        dst.postings.seal();
+        dst.postings.shrink_to_fit();
+        dst.positions.shrink_to_fit();
+        build_blocks(dst, doc_len.data(), base);
+        if (impacts) build_impacts(dst, id, *impacts, doc_len.data(), base);
+    };
+
+    if (merged->dense) {
+        if (!ids.empty()) merged->get_or_add(ids.back(), codec);
+        for (TermId id : ids) merge_term(id, merged->terms[id]);
+    } else {
+        std::vector<TermId> term_ids;
+        for (TermId id : ids) {
+            TermEntry entry;
+            merge_term(id, entry);
+            if (entry.postings.empty()) continue;
+            term_ids.push_back(id);
+            merged->terms.push_back(std::move(entry));
+        }
+        merged->term_ids.writable() = std::move(term_ids);
+    }
+    return merged;
+}
+
+bool BM25Indexer::merge_once() {
+    // 在读锁下选出要合并的段，并复制这些段文档区间内的存活标记与文档长度
+    std::vector<std::shared_ptr<Segment>> run;
+    std::vector<uint8_t> live;
+    std::vector<uint32_t> doc_len;
+    PostingCodec codec;
+    uint64_t generation;
+    std::vector<uint32_t> df;
+    ImpactStats impacts;
+    {
+        auto lock = read_lock();
+        auto [first, last] = pick_merge(data_);
+        if (first == last) return false;
+        run.assign(data_.segments.begin() + first, data_.segments.begin() + last);
+        uint32_t begin = run.front()->doc_begin;
+        uint32_t end = run.back()->doc_end;
+        live.assign(data_.live.begin() + begin, data_.live.begin() + end);
+        doc_len.assign(data_.doc_len.begin() + begin, data_.doc_len.begin() + end);
+        codec = data_.codec;
+        generation = generation_;
+        if (data_.impacts) {
+            // 影响值按合并开始时的统计量重算
+            impacts = impact_stats(data_);
+            df.assign(data_.df.begin(), data_.df.end());
+            impacts.df = df.data();
+        }
+    }
+
+    // 封存段不再修改，合并不持有锁
+    auto merged = merge_segments(run, live, doc_len, codec, impacts.df ? &impacts : nullptr);
+
+    auto lock = write_lock();
+    if (generation != generation_) return false;  // 索引已被 fit() 或快照替换
+    auto &segments = data_.segments;
+    auto it = std::find(segments.begin(), segments.end(), run.front());
+    if (static_cast<size_t>(segments.end() - it) < run.size() || !std::equal(run.begin(), run.end(), it)) {
+        return false;
+    }
+
+    // 合并期间新删除的文档在合并结果中仍有残留项
+    for (uint32_t doc = merged->doc_begin; doc < merged->doc_end; ++doc) {
+        if (live[doc - merged->doc_begin] && !data_.live[doc]) ++merged->dead_docs;
+    }
+    it = segments.erase(it + 1, it + run.size()) - 1;
+    *it = std::move(merged);
+    return true;
+}
+
+void BM25Indexer::schedule_merges() {
+    if (!thread_pool_) {
+        while (merge_once()) {}
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(merge_mutex_);
+        if (merging_) {
+            merge_pending_ = true;  // 正在合并的任务结束前会再检查一次
+            return;
+        }
+        merging_ = true;
+        merge_pending_ = false;
+    }
+    thread_pool_->submit([this] {
+        while (true) {
+            while (merge_once()) {}
+            std::lock_guard<std::mutex> lock(merge_mutex_);
+            if (!merge_pending_) {
+                merging_ = false;
+                merge_cv_.notify_all();
+                return;
+            }
+            merge_pending_ = false;
+        }
+    });
+}
+
+void BM25Indexer::wait_for_merges() {
+    std::unique_lock<std::mutex> lock(merge_mutex_);
+    merge_cv_.wait(lock, [this] { return !merging_; });
+}
+
+double BM25Indexer::idf(size_t df) const {
+    return idf(df, data_.live_docs);
+}
+
+double BM25Indexer::idf(size_t df, size_t live_docs) const {
+    double n = (double)live_docs;
+    double d = (double)df;
+    return std::log(1.0 + (n - d + 0.5) / (d + 0.5));
+}
+
+double BM25Indexer::term_score(double idf_v, uint32_t tf, uint32_t doclen) const {
+    return term_score(idf_v, tf, doclen, avgdl_);
+}
+
+double BM25Indexer::term_score(double idf_v, uint32_t tf, uint32_t doclen, double avgdl) const {
+    double f = (double)tf;
+    double denom = f + k1_ * (1.0 - b_ + b_ * (doclen / (avgdl > 0 ? avgdl : 1.0)));
+    return denom > 0 ? idf_v * (f * (k1_ + 1.0)) / denom : 0.0;
+}
+
+std::vector<std::pair<size_t, double>> BM25Indexer::query(const std::vector<std::string>& terms, size_t topK,
+                                                          const DocBitmap* filter) {
+    auto lock = read_lock();
+    std::vector<TermId> ids;
+    ids.reserve(terms.size());
+    for (const auto &term : terms) {
+        TermId id = data_.vocab.lookup(term);
+        if (id != kInvalidTermId) ids.push_back(id);
+    }
+    return query_ids_locked(ids, topK, filter);
+}
+
+std::vector<std::vector<std::pair<size_t, double>>> BM25Indexer::query_batch(const std::vector<std::vector<std::string>>& queries, size_t topK) {
+    std::vector<std::vector<std::pair<size_t, double>>> results(queries.size());
+    if (topK == 0) return results;
+
+    // 按去重排序后的词项列表排序，含相同词项的查询相邻，落在同一批内
+    std::vector<std::vector<std::string>> keys(queries.size());
+    for (size_t q = 0; q < queries.size(); ++q) {
+        keys[q] = queries[q];
+        std::sort(keys[q].begin(), keys[q].end());
+        keys[q].erase(std::unique(keys[q].begin(), keys[q].end()), keys[q].end());
+    }
+    std::vector<size_t> order(queries.size());
+    for (size_t q = 0; q < order.size(); ++q) order[q] = q;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return keys[a] < keys[b]; });
+
+    for (size_t begin = 0; begin < order.size(); begin += kBatchQueries) {
+        size_t end = std::min(order.size(), begin + kBatchQueries);
+        auto lock = read_lock();
+
+        // 与 query_ids_locked 相同：查询词保持原顺序（含重复），分数按相同顺序累加
+        std::vector<std::vector<QueryTerm>> batch(end - begin);
+        for (size_t i = begin; i < end; ++i) {
+            for (const auto &term : queries[order[i]]) {
+                TermId id = data_.vocab.lookup(term);
+                if (id != kInvalidTermId && id < data_.df.size() && data_.df[id] > 0) {
+                    batch[i - begin].push_back({id, idf(data_.df[id])});
+                }
+            }
+        }
+
+        if (mode_ == BM25QueryMode::IMPACT) {
+            // 影响值查询本身已没有浮点计算，只共享加锁
+            for (size_t i = begin; i < end; ++i) {
+                results[order[i]] = query_impact(batch[i - begin], topK, nullptr);
+            }
+            continue;
+        }
+
+        std::vector<TopK<size_t>> tops(batch.size(), TopK<size_t>(topK));
+        query_batch_locked(batch, tops);
+        for (size_t i = begin; i < end; ++i) {
+            results[order[i]] = tops[i - begin].take_sorted();
+        }
+    }
+    return results;
+}
+
+void BM25Indexer::query_batch_locked(const std::vector<std::vector<QueryTerm>>& batch, std::vector<TopK<size_t>>& tops) const {
+    // 已解码的倒排表：只保留存活文档，分数在解码时算好，各查询直接累加
+    struct ScoredPostings {
+        std::vector<uint32_t> docs;
+        std::vector<double> scores;
+    };
+
+    // 各段按文档区间顺序处理，与 query_ids_locked 一样每个查询跨段共用一个top-K
+    std::vector<double> acc;
+    std::vector<uint8_t> seen;
+    std::vector<uint32_t> touched;
+    for (const auto &segment : data_.segments) {
+        // 词项在本段剩余的使用次数，用完即释放
+        std::unordered_map<TermId, size_t> uses;
+        for (const auto &terms : batch) {
+            for (const auto &term : terms) ++uses[term.id];
+        }
+        std::unordered_map<TermId, ScoredPostings> cache;
+        size_t cached = 0;
+
+        acc.assign(segment->docs(), 0.0);
+        seen.assign(segment->docs(), 0);
+        for (size_t q = 0; q < batch.size(); ++q) {
+            for (const auto &term : batch[q]) {
+                auto it = cache.find(term.id);
+                if (it == cache.end()) {
+                    if (cached > kBatchCachePostings) {
+                        cache.clear();
+                        cached = 0;
+                    }
+                    it = cache.emplace(term.id, ScoredPostings()).first;
+                    auto &scored = it->second;
+                    if (const TermEntry* entry = segment->find(term.id)) {
+                        scored.docs.reserve(entry->postings.size());
+                        scored.scores.reserve(entry->postings.size());
+                        entry->postings.for_each([&](uint32_t doc, uint32_t tf) {
+                            if (!data_.live[doc]) return;
+                            scored.docs.push_back(doc - segment->doc_begin);
+                            scored.scores.push_back(term_score(term.idf, tf, data_.doc_len[doc]));
+                        });
+                    }
+                    cached += scored.docs.size();
+                }
+
+                const auto &scored = it->second;
+                for (size_t i = 0; i < scored.docs.size(); ++i) {
+                    uint32_t d = scored.docs[i];
+                    if (!seen[d]) {
+                        seen[d] = 1;
+                        touched.push_back(d);
+                    }
+                    acc[d] += scored.scores[i];
+                }
+                if (--uses[term.id] == 0) {
+                    cached -= it->second.docs.size();
+                    cache.erase(it);
+                }
+            }
+
+            for (uint32_t d : touched) {
+                tops[q].push(segment->doc_begin + d, acc[d]);
+                acc[d] = 0.0;
+                seen[d] = 0;
+            }
+            touched.clear();
+        }
+    }
+}
+
+std::vector<std::pair<size_t, double>> BM25Indexer::query_phrase(const std::vector<std::string>& terms, size_t topK, uint32_t slop) {
+    auto lock = read_lock();
+    if (topK == 0 || terms.empty()) return {};
+    if (!data_.positions) {
+        std::cerr << "BM25Indexer: phrase query requires bm25.store_positions" << std::endl;
+        return {};
+    }
+
+    // 任一词不在词典中或没有存活文档时短语不可能匹配
+    std::vector<QueryTerm> query_terms;
+    query_terms.reserve(terms.size());
+    for (const auto &term : terms) {
+        TermId id = data_.vocab.lookup(term);
+        if (id == kInvalidTermId || id >= data_.df.size() || data_.df[id] == 0) return {};
+        query_terms.push_back({id, idf(data_.df[id])});
+    }
+
+    TopK<size_t> top(topK);
+    for (const auto &segment : data_.segments) {
+        query_phrase_segment(*segment, query_terms, slop, top);
+    }
+    return top.take_sorted();
+}
+
+std::vector<std::pair<size_t, double>> BM25Indexer::query_phrase_text(const std::string& text, size_t topK, uint32_t slop,
+                                                                      Language lang) {
+    return query_phrase(tokenize(text, lang), topK, slop);
+}
+
+std::vector<std::pair<size_t, double>> BM25Indexer::query_ids(const std::vector<TermId>& term_ids, size_t topK,
+                                                              const DocBitmap* filter) {
+    auto lock = read_lock();
+    return query_ids_locked(term_ids, topK, filter);
+}
+
+std::vector<std::pair<size_t, double>> BM25Indexer::query_text(const std::string& query_text, size_t topK, Language lang,
+                                                               const DocBitmap* filter) {
+    // 使用tokenizer直接得到词项ID
+    auto lock = read_lock();
+    return query_ids_locked(lookup_tokens(query_text, lang), topK, filter);
+}
+
+size_t BM25Indexer::vocabulary_size() {
+    auto lock = read_lock();
+    return data_.vocab.size();
+}
+
+size_t BM25Indexer::document_count() {
+    auto lock = read_lock();
+    return data_.live_docs;
+}
+
+size_t BM25Indexer::allocated_documents() {
+    auto lock = read_lock();
+    return data_.doc_len.size();
+}
+
+
+BM25Indexer::PostingStats BM25Indexer::posting_stats() {
+    auto lock = read_lock();
+    PostingStats stats;
+    for (const auto &segment : data_.segments) {
+        for (const auto &entry : segment->terms) {
+            stats.postings += entry.postings.size();
+            stats.bytes += entry.postings.memory_usage();
+            stats.position_bytes += entry.positions.memory_usage() + entry.position_blocks.memory_usage();
+        }
+    }
+    return stats;
+}
+
+size_t BM25Indexer::segment_count() {
+    auto lock = read_lock();
+    return data_.segments.size();
+}
+
+void BM25Indexer::save_snapshot(SnapshotWriter& writer) {
+    auto lock = read_lock();
+    const auto &data = data_;
+
+    writer.write<uint32_t>(static_cast<uint32_t>(data.codec));
+    writer.write<uint32_t>(data.positions ? 1 : 0);
+    writer.write<uint32_t>(data.impacts ? 1 : 0);
+    writer.write<double>(data.impact_unit);
+    writer.write<uint64_t>(data.live_docs);
+    writer.write<double>(data.total_len);
+    data.vocab.save_snapshot(writer);
+    writer.write_array(data.df);
+    writer.write_array(data.doc_len);
+    writer.write_array(data.live);
+    writer.write_array(data.fwd_terms);
+    writer.write_array(data.fwd_offsets);
+
+    // doc_id -> 文档下标：合并快照中的条目与之后新增的条目，只保留存活文档，按 doc_id 排序
+    std::map<std::string_view, std::vector<uint32_t>> doc_table;
+    for (size_t i = 0; i < data.snapshot_doc_ids.size(); ++i) {
+        for (uint64_t k = data.snapshot_doc_offsets[i]; k < data.snapshot_doc_offsets[i + 1]; ++k) {
+            uint32_t doc = data.snapshot_docs[k];
+            if (data.live[doc]) doc_table[data.snapshot_doc_ids[i]].push_back(doc);
+        }
+    }
+    for (const auto &[doc_id, docs] : data.doc_chunks) {
+        for (uint32_t doc : docs) {
+            if (data.live[doc]) doc_table[doc_id].push_back(doc);
+        }
+    }
+    StringColumn doc_ids;
+    std::vector<uint64_t> doc_offsets{0};
+    std::vector<uint32_t> doc_list;
+    for (const auto &[doc_id, docs] : doc_table) {
+        doc_ids.push_back(doc_id);
+        doc_list.insert(doc_list.end(), docs.begin(), docs.end());
+        doc_offsets.push_back(doc_list.size());
+    }
+    writer.write_strings(doc_ids);
+    writer.write_array(doc_offsets);
+    writer.write_array(doc_list);
+
+    writer.write<uint64_t>(data.segments.size());
+    for (const auto &segment : data.segments) save_segment(writer, *segment);
+}
+
+void BM25Indexer::save_segment(SnapshotWriter& writer, const Segment& segment) {
+    // 每次写操作结束前都会 seal() 涉及的倒排表，这里所有条目都已编码
+    // 可变段按词项ID排序写出，加载后即为封存段
+    std::vector<uint32_t> order(segment.terms.size());
+    std::vector<TermId> term_ids;
+    if (segment.dense || segment.sealed) {
+        for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+        if (!segment.dense) term_ids.assign(segment.term_ids.begin(), segment.term_ids.end());
+    } else {
+        std::vector<std::pair<TermId, uint32_t>> sorted(segment.term_index.begin(), segment.term_index.end());
+        std::sort(sorted.begin(), sorted.end());
+        for (size_t i = 0; i < sorted.size(); ++i) {
+            term_ids.push_back(sorted[i].first);
+            order[i] = sorted[i].second;
+        }
+    }
+
+    // 词项统计量与各倒排表在拼接数组中的位置
+    size_t num_terms = order.size();
+    std::vector<uint32_t> max_tf(num_terms), min_len(num_terms), sizes(num_terms);
+    std::vector<uint64_t> byte_offsets(num_terms + 1, 0), block_offsets(num_terms + 1, 0);
+    std::vector<uint64_t> position_offsets(num_terms + 1, 0);
+    std::vector<uint64_t> impact_offsets(num_terms + 1, 0), run_offsets(num_terms + 1, 0);
+    for (size_t t = 0; t < num_terms; ++t) {
+        const auto &entry = segment.terms[order[t]];
+        max_tf[t] = entry.max_tf;
+        min_len[t] = entry.min_len;
+        sizes[t] = static_cast<uint32_t>(entry.postings.size());
+        byte_offsets[t + 1] = byte_offsets[t] + entry.postings.encoded_bytes().size();
+        block_offsets[t + 1] = block_offsets[t] + entry.postings.block_refs().size();
+        position_offsets[t + 1] = position_offsets[t] + entry.positions.size();
+        impact_offsets[t + 1] = impact_offsets[t] + entry.impact_bytes.size();
+        run_offsets[t + 1] = run_offsets[t] + entry.impact_runs.size();
+    }
+
+    writer.write<uint32_t>(segment.doc_begin);
+    writer.write<uint32_t>(segment.doc_end);
+    writer.write<uint32_t>(segment.dead_docs);
+    writer.write<uint32_t>(segment.dense ? 1 : 0);
+    writer.write_array(term_ids);
+    writer.write_array(max_tf);
+    writer.write_array(min_len);
+    writer.write_array(sizes);
+    writer.write_array(byte_offsets);
+    writer.write_array(block_offsets);
+    writer.write_array(position_offsets);
+    writer.write_array(impact_offsets);
+    writer.write_array(run_offsets);
+
+    writer.begin_array(byte_offsets.back());
+    for (uint32_t i : order) {
+        const auto &bytes = segment.terms[i].postings.encoded_bytes();
+        writer.append(bytes.data(), bytes.size());
+    }
+    writer.begin_array(block_offsets.back());
+    for (uint32_t i : order) {
+        const auto &refs = segment.terms[i].postings.block_refs();
+        writer.append(refs.data(), refs.size());
+    }
+    writer.begin_array(block_offsets.back());
+    for (uint32_t i : order) {
+        const auto &blocks = segment.terms[i].blocks;
+        writer.append(blocks.data(), blocks.size());
+    }
+
+    // 词位置：未开启时为空数组
+    writer.begin_array(position_offsets.back());
+    for (uint32_t i : order) {
+        const auto &positions = segment.terms[i].positions;
+        writer.append(positions.data(), positions.size());
+    }
+    writer.begin_array(position_offsets.back() ? block_offsets.back() : 0);
+    for (uint32_t i : order) {
+        const auto &position_blocks = segment.terms[i].position_blocks;
+        writer.append(position_blocks.data(), position_blocks.size());
+    }
+
+    // 按影响值排序的倒排表：可变段与未开启时为空
+    writer.begin_array(impact_offsets.back());
+    for (uint32_t i : order) {
+        const auto &bytes = segment.terms[i].impact_bytes;
+        writer.append(bytes.data(), bytes.size());
+    }
+    writer.begin_array(run_offsets.back());
+    for (uint32_t i : order) {
+        const auto &runs = segment.terms[i].impact_runs;
+        writer.append(runs.data(), runs.size());
+    }
+}
+
+bool BM25Indexer::load_snapshot(SectionReader& reader) {
+    IndexData data;
+    uint32_t codec = 0;
+    uint32_t positions = 0;
+    uint32_t impacts = 0;
+    uint64_t live_docs = 0;
+    bool ok = reader.read(codec) && reader.read(positions) && reader.read(impacts) && reader.read(data.impact_unit) &&
+              reader.read(live_docs) && reader.read(data.total_len) &&
+              data.vocab.load_snapshot(reader) && reader.read_array(data.df) &&
+              reader.read_array(data.doc_len) && reader.read_array(data.live) &&
+              reader.read_array(data.fwd_terms) && reader.read_array(data.fwd_offsets) &&
+              reader.read_strings(data.snapshot_doc_ids) && reader.read_array(data.snapshot_doc_offsets) &&
+              reader.read_array(data.snapshot_docs);
+
+    // 只校验结构（数组长度与偏移量），倒排表内容按写入时的状态信任
+    size_t num_docs = data.doc_len.size();
+    ok = ok && codec <= static_cast<uint32_t>(PostingCodec::BITPACK) && live_docs <= num_docs &&
+         data.df.size() == data.vocab.size() && data.live.size() == num_docs &&
+         monotone(data.fwd_offsets, num_docs, data.fwd_terms.size()) &&
+         monotone(data.snapshot_doc_offsets, data.snapshot_doc_ids.size(), data.snapshot_docs.size());
+    for (size_t i = 0; ok && i < data.snapshot_docs.size(); ++i) {
+        ok = data.snapshot_docs[i] < num_docs;
+    }
+    data.codec = static_cast<PostingCodec>(codec);
+    data.positions = positions != 0;
+    data.impacts = impacts != 0;
+    data.live_docs = live_docs;
+
+    // 各段的文档区间必须从0开始首尾相接，覆盖全部文档
+    uint64_t num_segments = 0;
+    ok = ok && reader.read(num_segments) && num_segments <= num_docs + 1;
+    uint32_t next_doc = 0;
+    for (uint64_t s = 0; ok && s < num_segments; ++s) {
+        auto segment = std::make_shared<Segment>();
+        ok = load_segment(reader, data, *segment) && segment->doc_begin == next_doc;
+        next_doc = segment->doc_end;
+        segment->mapping = reader.file();
+        data.segments.push_back(std::move(segment));
+    }
+    ok = ok && next_doc == num_docs;
+    if (!ok) {
+        reader.fail();
+        std::cerr << "BM25Indexer: corrupt BM25 snapshot section" << std::endl;
+        return false;
+    }
+    data.mapping = reader.file();
+
+    std::lock_guard<std::mutex> writer(write_mutex_);
+    auto lock = write_lock();
+    data_ = std::move(data);
+    ++generation_;
+    avgdl_ = data_.live_docs ? (data_.total_len / (double)data_.live_docs) : 0.0;
+    return true;
+}
+
+bool BM25Indexer::load_segment(SectionReader& reader, const IndexData& data, Segment& segment) {
+    uint32_t dense = 0;
+    MappedArray<uint32_t> max_tf, min_len, sizes;
+    MappedArray<uint64_t> byte_offsets, block_offsets, position_offsets, impact_offsets, run_offsets;
+    MappedArray<uint8_t> bytes, positions, impact_bytes;
+    MappedArray<ImpactRun> impact_runs;
+    MappedArray<PostingList::BlockRef> refs;
+    MappedArray<BlockMax> blocks;
+    MappedArray<uint32_t> position_blocks;
+    bool ok = reader.read(segment.doc_begin) && reader.read(segment.doc_end) &&
+              reader.read(segment.dead_docs) && reader.read(dense) &&
+              reader.read_array(segment.term_ids) &&
+              reader.read_array(max_tf) && reader.read_array(min_len) && reader.read_array(sizes) &&
+              reader.read_array(byte_offsets) && reader.read_array(block_offsets) &&
+              reader.read_array(position_offsets) && reader.read_array(impact_offsets) && reader.read_array(run_offsets) &&
+              reader.read_array(bytes) && reader.read_array(refs) && reader.read_array(blocks) &&
+              reader.read_array(positions) && reader.read_array(position_blocks) &&
+              reader.read_array(impact_bytes) && reader.read_array(impact_runs);
+    if (!ok) return false;
+
+    size_t num_terms = max_tf.size();
+    segment.dense = dense != 0;
+    segment.sealed = true;
+    ok = segment.doc_begin <= segment.doc_end && segment.doc_end <= data.doc_len.size() &&
+         segment.dead_docs <= segment.docs() && num_terms <= data.vocab.size() &&
+         (segment.dense ? segment.term_ids.empty() : segment.term_ids.size() == num_terms) &&
+         min_len.size() == num_terms && sizes.size() == num_terms &&
+         monotone(byte_offsets, num_terms, bytes.size()) &&
+         monotone(block_offsets, num_terms, refs.size()) && blocks.size() == refs.size() &&
+         monotone(position_offsets, num_terms, positions.size()) &&
+         (data.positions ? position_blocks.size() == refs.size() : positions.empty() && position_blocks.empty()) &&
+         monotone(impact_offsets, num_terms, impact_bytes.size()) &&
+         monotone(run_offsets, num_terms, impact_runs.size());
+    for (size_t t = 0; ok && !segment.dense && t < num_terms; ++t) {
+        ok = segment.term_ids[t] < data.vocab.size() && (t == 0 || segment.term_ids[t - 1] < segment.term_ids[t]);
+    }
+    for (size_t t = 0; ok && t < num_terms; ++t) {
+        size_t num_blocks = block_offsets[t + 1] - block_offsets[t];
+        size_t num_bytes = byte_offsets[t + 1] - byte_offsets[t];
+        ok = sizes[t] <= segment.docs() && num_blocks == (sizes[t] + kBlockSize - 1) / kBlockSize;
+        for (size_t b = block_offsets[t]; ok && b < block_offsets[t + 1]; ++b) {
+            ok = refs[b].doc_offset <= refs[b].tf_offset && refs[b].tf_offset < num_bytes;
+        }
+        // 每个倒排项至少一个位置，各块起点递增且落在本词项的位置数据内
+        size_t num_positions = position_offsets[t + 1] - position_offsets[t];
+        ok = ok && (!data.positions || num_positions >= sizes[t]);
+        for (size_t b = block_offsets[t]; ok && data.positions && b < block_offsets[t + 1]; ++b) {
+            ok = position_blocks[b] < num_positions &&
+                 (b == block_offsets[t] ? position_blocks[b] == 0 : position_blocks[b - 1] < position_blocks[b]);
+        }
+        // 影响值分组：没有分组（查询时现算），或各组文档数之和等于倒排项数、结束位置递增且不超出编码数据
+        size_t num_impact_bytes = impact_offsets[t + 1] - impact_offsets[t];
+        uint64_t grouped = 0;
+        for (size_t r = run_offsets[t]; ok && r < run_offsets[t + 1]; ++r) {
+            const auto &run = impact_runs[r];
+            grouped += run.count;
+            ok = run.impact >= 1 && run.impact <= 255 && run.end <= num_impact_bytes &&
+                 (r == run_offsets[t] || impact_runs[r - 1].end <= run.end);
+        }
+        ok = ok && (run_offsets[t] == run_offsets[t + 1] ? num_impact_bytes == 0 :
+                    grouped == sizes[t] && impact_runs[run_offsets[t + 1] - 1].end == num_impact_bytes);
+    }
+    if (!ok) return false;
+
+    segment.terms.resize(num_terms);
+    for (size_t t = 0; t < num_terms; ++t) {
+        auto &entry = segment.terms[t];
+        size_t first_block = block_offsets[t];
+        size_t num_blocks = block_offsets[t + 1] - first_block;
+        entry.max_tf = max_tf[t];
+        entry.min_len = min_len[t];
+        entry.postings = PostingList::view(data.codec, sizes[t],
+                                           bytes.data() + byte_offsets[t], byte_offsets[t + 1] - byte_offsets[t],
+                                           refs.data() + first_block, num_blocks);
+        entry.blocks.assign_view(blocks.data() + first_block, num_blocks);
+        if (data.positions) {
+            entry.positions.assign_view(positions.data() + position_offsets[t], position_offsets[t + 1] - position_offsets[t]);
+            entry.position_blocks.assign_view(position_blocks.data() + first_block, num_blocks);
+        }
+        entry.impact_bytes.assign_view(impact_bytes.data() + impact_offsets[t], impact_offsets[t + 1] - impact_offsets[t]);
+        entry.impact_runs.assign_view(impact_runs.data() + run_offsets[t], run_offsets[t + 1] - run_offsets[t]);
+    }
+    return true;
+}
+
+std::vector<std::pair<size_t, double>> BM25Indexer::query_ids_locked(const std::vector<TermId>& term_ids, size_t topK,
+                                                                     const DocBitmap* filter) const {
+    if (topK == 0 || (filter && filter->empty())) return {};
+
+    // IDF 由全局df计算，各段共用，分段不影响分数
+    std::vector<QueryTerm> terms;
+    terms.reserve(term_ids.size());
+    for (TermId id : term_ids) {
+        if (id < data_.df.size() && data_.df[id] > 0) terms.push_back({id, idf(data_.df[id])});
+    }
+    if (terms.empty()) return {};
+    if (mode_ == BM25QueryMode::IMPACT) return query_impact(terms, topK, filter);
+
+    size_t num_docs = data_.doc_len.size();
+    if (thread_pool_ && num_docs >= parallel_query_min_docs_) {
+        size_t shards = std::min(query_shards_ ? query_shards_ : thread_pool_->size(), num_docs);
+        if (shards > 1) return query_sharded(terms, shards, topK, filter);
+    }
+
+    TopK<size_t> top(topK);
+    query_range(terms, 0, static_cast<uint32_t>(num_docs), filter, top);
+    return top.take_sorted();
+}
+
+void BM25Indexer::query_range(const std::vector<QueryTerm>& terms, uint32_t lo, uint32_t hi, const DocBitmap* filter,
+                              TopK<size_t>& top) const {
+    // 各段按文档区间顺序遍历，共用一个top-K，前面段得到的阈值直接用于后面段的剪枝
+    for (const auto &segment : data_.segments) {
+        uint32_t begin = std::max(lo, segment->doc_begin);
+        uint32_t end = std::min(hi, segment->doc_end);
+        if (begin >= end) continue;
+        switch (mode_) {
+            case BM25QueryMode::WAND:
+                query_wand(*segment, terms, begin, end, filter, top, false);
+                break;
+            case BM25QueryMode::BLOCK_MAX_WAND:
+                query_wand(*segment, terms, begin, end, filter, top, true);
+                break;
+            case BM25QueryMode::EXHAUSTIVE:
+            case BM25QueryMode::IMPACT:
+            default:
+                query_exhaustive(*segment, terms, begin, end, filter, top);
+                break;
+        }
+    }
+}
+
+std::vector<std::pair<size_t, double>> BM25Indexer::query_sharded(const std::vector<QueryTerm>& terms, size_t shards,
+                                                                  size_t topK, const DocBitmap* filter) const {
+    // 调用线程与线程池任务从同一个计数器领取分片，调用线程只等待已被工作线程领走的分片，
+    // 线程池被其他任务（如等待写锁的后台合并）占满时也不会阻塞在排队上
+    // 晚于查询结束才开始执行的任务领不到分片，只访问共享状态，不再访问 terms、filter 与索引
+    struct State {
+        std::atomic<size_t> next{0};
+        size_t done = 0;
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::vector<std::vector<std::pair<size_t, double>>> results;
+    };
+    auto state = std::make_shared<State>();
+    state->results.resize(shards);
+    uint64_t num_docs = data_.doc_len.size();
+
+    auto work = [this, state, &terms, filter, shards, topK, num_docs] {
+        for (size_t s; (s = state->next.fetch_add(1)) < shards; ) {
+            TopK<size_t> top(topK);
+            query_range(terms, static_cast<uint32_t>(num_docs * s / shards),
+                        static_cast<uint32_t>(num_docs * (s + 1) / shards), filter, top);
+            auto result = top.take_sorted();
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->results[s] = std::move(result);
+            if (++state->done == shards) state->cv.notify_all();
+        }
+    };
+    for (size_t i = 1; i < shards; ++i) thread_pool_->submit(work);
+    work();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cv.wait(lock, [&] { return state->done == shards; });
+
+    // 各分片的局部top-K包含了全局top-K中落在该分片的全部文档，按相同的排序规则归并即得到完整结果
+    TopK<size_t> top(topK);
+    for (const auto &result : state->results) {
+        for (const auto &[doc, score] : result) top.push(doc, score);
+    }
+    return top.take_sorted();
+}
+
+std::vector<std::pair<size_t, double>> BM25Indexer::query_impact(const std::vector<QueryTerm>& terms, size_t topK,
+                                                                 const DocBitmap* filter) const {
+    // 没有预计算影响值的词项（可变段、不是以 IMPACT 模式建的段）查询时按当前统计量现算
+    double unit = data_.impact_unit;
+    if (unit <= 0) {
+        double max_score = 0.0;
         for (const auto &term : terms) {
-            double f = 0.0;
-            auto it = tfs_[i].find(term);
-            if (it != tfs_[i].end()) f = (double)it->second;
-            double idf_v = idf(term);
-            double denom = f + k1_ * (1.0 - b_ + b_ * (doclen / (avgdl_ > 0 ? avgdl_ : 1.0)));
-            if (denom > 0) score += idf_v * (f * (k1_ + 1.0)) / denom;
+            for (const auto &segment : data_.segments) {
+                const TermEntry* entry = segment->find(term.id);
+                if (entry && !entry->postings.empty()) {
+                    max_score = std::max(max_score, term_score(term.idf, entry->max_tf, entry->min_len));
+                }
+            }
+        }
+        unit = max_score > 0 ? max_score / 255.0 : 1.0;
+    }
+
+    struct Run {
+        uint32_t impact;
+        uint32_t count;
+        const uint8_t* bytes;
+    };
+    std::vector<Run> runs;
+    std::vector<std::vector<uint8_t>> computed_bytes;
+    std::vector<ImpactRun> computed_runs;
+    for (const auto &term : terms) {
+        for (const auto &segment : data_.segments) {
+            const TermEntry* entry = segment->find(term.id);
+            if (!entry || entry->postings.empty()) continue;
+            const uint8_t* bytes = entry->impact_bytes.data();
+            const ImpactRun* first = entry->impact_runs.data();
+            size_t num_runs = entry->impact_runs.size();
+            if (num_runs == 0) {
+                computed_bytes.emplace_back();
+                computed_runs.clear();
+                encode_impacts(*entry, term.idf, avgdl_, unit, data_.doc_len.data(), 0, computed_bytes.back(), computed_runs);
+                bytes = computed_bytes.back().data();
+                first = computed_runs.data();
+                num_runs = computed_runs.size();
+            }
+            uint32_t begin = 0;
+            for (size_t r = 0; r < num_runs; ++r) {
+                runs.push_back({first[r].impact, first[r].count, bytes + begin});
+                begin = first[r].end;
+            }
+        }
+    }
+
+    // score-at-a-time：所有查询词的组按影响值降序处理，分数只做整数累加；达到倒排项上限时提前结束
+    std::stable_sort(runs.begin(), runs.end(), [](const Run& a, const Run& b) { return a.impact > b.impact; });
+    static thread_local std::vector<uint32_t> acc;
+    static thread_local std::vector<uint32_t> touched;
+    reserve_scratch(acc, data_.doc_len.size());
+    size_t budget = impact_budget_ ? impact_budget_ : std::numeric_limits<size_t>::max();
+    uint32_t docs[kBlockSize];
+    for (const auto &run : runs) {
+        if (budget == 0) break;
+        const uint8_t* p = run.bytes;
+        size_t remaining = std::min<size_t>(run.count, budget);
+        budget -= remaining;
+        uint32_t doc = 0;
+        while (remaining > 0) {
+            size_t n = std::min(remaining, kBlockSize);
+            p = codec::decode_varbyte(p, n, docs);
+            for (size_t i = 0; i < n; ++i) {
+                doc += docs[i];
+                if (acc[doc] == 0) touched.push_back(doc);
+                acc[doc] += run.impact;
+            }
+            remaining -= n;
+        }
+    }
+
+    TopK<size_t> top(topK);
+    for (uint32_t doc : touched) {
+        if (data_.live[doc] && (!filter || filter->contains(doc))) top.push(doc, acc[doc] * unit);
+        acc[doc] = 0;
+    }
+    touched.clear();
+    return top.take_sorted();
+}
+
+void BM25Indexer::query_exhaustive(const Segment& segment, const std::vector<QueryTerm>& terms, uint32_t lo, uint32_t hi,
+                                   const DocBitmap* filter, TopK<size_t>& top) const {
+    // 只遍历包含查询词的文档；不含任何查询词的文档得分为0，不进入结果
+    // 已删除的文档在倒排表中可能还有残留项，与过滤掉的文档一样跳过
+    // 区间只覆盖段的一部分时，按块元数据定位第一块，越过 hi 后停止
+    // 分数累加在按文档编号索引的线程局部数组上，touched 记录得分非0的文档，输出后清零复用
+    static thread_local std::vector<double> acc;
+    static thread_local std::vector<uint32_t> touched;
+    reserve_scratch(acc, data_.doc_len.size());
+    uint32_t docs[kBlockSize];
+    uint32_t tfs[kBlockSize];
+    for (const auto &term : terms) {
+        const TermEntry* entry = segment.find(term.id);
+        if (!entry) continue;
+        const auto &blocks = entry->blocks;
+        size_t b = std::lower_bound(blocks.begin(), blocks.end(), lo,
+                                    [](const BlockMax& blk, uint32_t d) { return blk.last_doc < d; }) - blocks.begin();
+        for (; b < blocks.size(); ++b) {
+            size_t n = entry->postings.decode_docs(b, docs);
+            if (docs[0] >= hi) break;
+            entry->postings.decode_tfs(b, tfs);
+            for (size_t i = 0; i < n && docs[i] < hi; ++i) {
+                uint32_t doc = docs[i];
+                if (doc >= lo && data_.live[doc] && (!filter || filter->contains(doc))) {
+                    if (acc[doc] == 0.0) touched.push_back(doc);
+                    acc[doc] += term_score(term.idf, tfs[i], data_.doc_len[doc]);
+                }
+            }
         }
-        scores.emplace_back(i, score);
     }
-    std::sort(scores.begin(), scores.end(), [](auto &a, auto &b){return a.second > b.second;});
-    if (scores.size() > topK) scores.resize(topK);
-    return scores;
+
+    for (uint32_t doc : touched) {
+        top.push(doc, acc[doc]);
+        acc[doc] = 0.0;
+    }
+    touched.clear();
 }
 
-std::vector<std::pair<size_t, double>> BM25Indexer::query_text(const std::string& query_text, size_t topK, Language lang) {
-    // 使用tokenizer对查询文本进行分词
-    auto terms = tokenize(query_text, lang);
-    return query(terms, topK);
+struct BM25Indexer::Cursor {
+    const TermEntry* entry;
+    size_t qpos;        // 在查询中的位置，用于按查询顺序累加分数
+    double idf;         // 按当前存活文档数计算的IDF
+    size_t block = 0;   // 当前块
+    size_t count = 0;   // 当前块条目数，0 表示已遍历完
+    size_t pos = 0;     // 块内位置
+    bool tfs_loaded = false;
+    const uint8_t* positions_at = nullptr;  // 块内第 positions_item 项的位置数据
+    size_t positions_item = 0;
+    uint32_t docs[kBlockSize];
+    uint32_t tfs[kBlockSize];
+
+    Cursor(const TermEntry* e, size_t q, double idf_v) : entry(e), qpos(q), idf(idf_v) {
+        load(0);
+    }
+
+    void load(size_t b) {
+        block = b;
+        pos = 0;
+        tfs_loaded = false;
+        positions_at = nullptr;
+        count = b < entry->blocks.size() ? entry->postings.decode_docs(b, docs) : 0;
+    }
+
+    uint32_t doc() const {
+        return pos < count ? docs[pos] : kEndDoc;
+    }
+
+    uint32_t tf() {
+        if (!tfs_loaded) {
+            entry->postings.decode_tfs(block, tfs);
+            tfs_loaded = true;
+        }
+        return tfs[pos];
+    }
+
+    // 浅移动：定位包含 target 的块，不解码
+    size_t find_block(uint32_t target) const {
+        const auto &blocks = entry->blocks;
+        if (block >= blocks.size() || blocks[block].last_doc >= target) return block;
+        // 倍增查找确定区间，再二分
+        size_t lo = block, step = 1;
+        while (lo + step < blocks.size() && blocks[lo + step].last_doc < target) {
+            lo += step;
+            step <<= 1;
+        }
+        size_t hi = std::min(lo + step, blocks.size());
+        return std::lower_bound(blocks.begin() + lo + 1, blocks.begin() + hi, target,
+                                [](const BlockMax& blk, uint32_t d) { return blk.last_doc < d; }) - blocks.begin();
+    }
+
+    // 前进到第一个 doc >= target 的倒排项
+    void advance(uint32_t target) {
+        if (doc() >= target) return;
+        size_t b = find_block(target);
+        if (b != block) load(b);
+        if (count == 0) return;
+        pos = std::lower_bound(docs + pos, docs + count, target) - docs;
+    }
+
+    void next() {
+        if (++pos >= count && count > 0) load(block + 1);
+    }
+
+    // 当前倒排项的词位置（升序）；从块起点依次跳过前面各项的位置，块内只前进不回退
+    void positions(std::vector<uint32_t>& out) {
+        uint32_t n = tf();
+        if (!positions_at) {
+            positions_at = entry->positions.data() + entry->position_blocks[block];
+            positions_item = 0;
+        }
+        for (; positions_item < pos; ++positions_item) {
+            positions_at = skip_varbytes(positions_at, tfs[positions_item]);
+        }
+        out.resize(n);
+        codec::decode_varbyte(positions_at, n, out.data());
+        for (size_t i = 1; i < n; ++i) out[i] += out[i - 1];
+    }
+};
+
+void BM25Indexer::query_phrase_segment(const Segment& segment, const std::vector<QueryTerm>& terms, uint32_t slop,
+                                       TopK<size_t>& top) const {
+    std::vector<Cursor> cursors;
+    cursors.reserve(terms.size());
+    double phrase_idf = 0.0;
+    for (const auto &term : terms) {
+        const TermEntry* entry = segment.find(term.id);
+        if (!entry || entry->postings.empty()) return;
+        cursors.emplace_back(entry, cursors.size(), term.idf);
+        phrase_idf += term.idf;
+    }
+
+    // 文档求交：最短的倒排表领跑，其余游标用块级倍增查找跟进，超过时领跑游标跳到该文档
+    size_t lead = 0;
+    for (size_t i = 1; i < cursors.size(); ++i) {
+        if (cursors[i].entry->postings.size() < cursors[lead].entry->postings.size()) lead = i;
+    }
+
+    std::vector<std::vector<uint32_t>> positions(cursors.size());
+    std::vector<size_t> at(cursors.size());
+    uint32_t doc = cursors[lead].doc();
+    while (doc != kEndDoc) {
+        uint32_t next = doc;
+        for (auto &cursor : cursors) {
+            cursor.advance(doc);
+            if (cursor.doc() != doc) {
+                next = cursor.doc();
+                break;
+            }
+        }
+        if (next != doc) {
+            cursors[lead].advance(next);
+            doc = cursors[lead].doc();
+            continue;
+        }
+
+        if (data_.live[doc]) {
+            // 位置匹配：以第一个词的每个位置为起点，后面各词依次取前一个词之后最近的位置（倍增查找），
+            // 得到该起点下跨度最小的匹配；起点递增时各词的查找位置也只增不减
+            for (size_t i = 0; i < cursors.size(); ++i) {
+                cursors[i].positions(positions[i]);
+                at[i] = 0;
+            }
+            uint32_t matches = 0;
+            uint32_t min_gap = std::numeric_limits<uint32_t>::max();
+            for (uint32_t start : positions[0]) {
+                uint32_t prev = start;
+                bool found = true;
+                for (size_t i = 1; i < cursors.size(); ++i) {
+                    at[i] = gallop(positions[i], at[i], prev + 1);
+                    if (at[i] == positions[i].size()) {
+                        found = false;
+                        break;
+                    }
+                    prev = positions[i][at[i]];
+                }
+                if (!found) break;  // 更靠后的起点也找不到
+                uint32_t gap = prev - start - static_cast<uint32_t>(cursors.size() - 1);
+                if (gap <= slop) {
+                    ++matches;
+                    min_gap = std::min(min_gap, gap);
+                }
+            }
+
+            if (matches > 0) {
+                // 各词的BM25分数按短语顺序累加，再加上把短语当作一个词（IDF取各词之和）的BM25分数，按跨度衰减
+                uint32_t len = data_.doc_len[doc];
+                double score = 0.0;
+                for (auto &cursor : cursors) score += term_score(cursor.idf, cursor.tf(), len);
+                score += term_score(phrase_idf, matches, len) / (1.0 + min_gap);
+                top.push(doc, score);
+            }
+        }
+        cursors[lead].next();
+        doc = cursors[lead].doc();
+    }
+}
+
+void BM25Indexer::query_wand(const Segment& segment, const std::vector<QueryTerm>& terms, uint32_t lo, uint32_t hi,
+                             const DocBitmap* filter, TopK<size_t>& top, bool block_max) const {
+    // 每个查询词（含重复词）一个游标，与 EXHAUSTIVE 的累加方式保持一致
+    // 游标从 lo 开始，到达 hi 的游标视为已遍历完
+    std::vector<Cursor> cursors;
+    cursors.reserve(terms.size());
+    std::vector<double> term_ub;
+    for (const auto &term : terms) {
+        const TermEntry* entry = segment.find(term.id);
+        if (!entry || entry->postings.empty()) continue;
+        cursors.emplace_back(entry, cursors.size(), term.idf);
+        cursors.back().advance(lo);
+        term_ub.push_back(term_score(term.idf, entry->max_tf, entry->min_len));
+    }
+    if (cursors.empty()) return;
+
+    // 结果排序规则：分数降序，分数相同时文档下标升序
+    // 文档按下标升序访问（各段也按文档区间顺序遍历），新文档只有分数严格高于阈值才能进入top-K
+    auto competitive = [&](double bound) {
+        return !top.full() || bound * (1.0 + kBoundSlack) > top.threshold();
+    };
+
+    // order[i] 为按当前文档排序后的游标编号
+    std::vector<size_t> order(cursors.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::vector<size_t> at_pivot;
+
+    while (true) {
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return cursors[a].doc() < cursors[b].doc();
+        });
+
+        // 寻找pivot：按文档顺序累加词项上界，直到可能超过阈值
+        double acc_ub = 0.0;
+        size_t p = order.size();
+        for (size_t i = 0; i < order.size(); ++i) {
+            if (cursors[order[i]].doc() >= hi) break;
+            acc_ub += term_ub[order[i]];
+            if (competitive(acc_ub)) {
+                p = i;
+                break;
+            }
+        }
+        if (p == order.size()) break;
+
+        uint32_t pivot = cursors[order[p]].doc();
+        while (p + 1 < order.size() && cursors[order[p + 1]].doc() == pivot) ++p;
+
+        if (filter && !filter->contains(pivot)) {
+            // pivot 之前的文档不可能进入top-K，pivot 到过滤位图中下一个文档之间的文档都被过滤，一起跳过
+            uint32_t next = filter->next(pivot);
+            for (size_t i = 0; i <= p; ++i) cursors[order[i]].advance(next);
+            continue;
+        }
+
+        if (block_max) {
+            // 用pivot所在块的上界做二次检查
+            // 倒排表在pivot之后已无文档的词项不贡献上界，也不限制跳跃范围
+            double block_ub = 0.0;
+            uint32_t next = kEndDoc;
+            for (size_t i = 0; i <= p; ++i) {
+                const auto &c = cursors[order[i]];
+                size_t b = c.find_block(pivot);
+                if (b >= c.entry->blocks.size()) continue;
+                const auto &blk = c.entry->blocks[b];
+                block_ub += term_score(c.idf, blk.max_tf, blk.min_len);
+                next = std::min(next, blk.last_doc + 1);
+            }
+            if (!competitive(block_ub)) {
+                // [pivot, next) 内的文档只可能出现在这些块中，整体跳过
+                if (p + 1 < order.size()) next = std::min(next, cursors[order[p + 1]].doc());
+                for (size_t i = 0; i <= p; ++i) cursors[order[i]].advance(next);
+                continue;
+            }
+        }
+
+        if (cursors[order[0]].doc() == pivot) {
+            at_pivot.assign(order.begin(), order.begin() + p + 1);
+            if (!data_.live[pivot]) {
+                // 已删除文档的残留项，直接越过
+                for (size_t c : at_pivot) cursors[c].next();
+                continue;
+            }
+
+            // 所有到达pivot的游标按查询顺序累加分数
+            std::sort(at_pivot.begin(), at_pivot.end(), [&](size_t a, size_t b) {
+                return cursors[a].qpos < cursors[b].qpos;
+            });
+            double score = 0.0;
+            for (size_t c : at_pivot) {
+                score += term_score(cursors[c].idf, cursors[c].tf(), data_.doc_len[pivot]);
+            }
+
+            top.push(pivot, score);
+
+            for (size_t c : at_pivot) cursors[c].next();
+        } else {
+            // pivot之前的游标直接跳到pivot
+            for (size_t i = 0; i < p && cursors[order[i]].doc() < pivot; ++i) {
+                cursors[order[i]].advance(pivot);
+            }
+        }
+    }
 }
 
 } // namespace rag
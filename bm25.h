@@ -1,47 +1,348 @@
 #pragma once
 #include "chunk.h"
 #include "config.h"
+#include "doc_bitmap.h"
+#include "mapped_array.h"
+#include "posting_codec.h"
+#include "snapshot.h"
+#include "thread_pool.h"
 #include "tokenizer.h"
+#include "top_k.h"
+#include "vocabulary.h"
 #include <vector>
 #include <string>
 #include <unordered_map>
 #include <shared_mutex>
+#include <mutex>
 #include <sstream>
 #include <memory>
+#include <condition_variable>
+#include <cstdint>
 
 namespace rag {
 
+// BM25查询模式
+enum class BM25QueryMode {
+    EXHAUSTIVE,      // 逐词项累加所有命中文档
+    WAND,            // WAND动态剪枝（词项级分数上界）
+    BLOCK_MAX_WAND,  // Block-Max WAND（词项级 + 块级分数上界）
+    IMPACT           // 按量化影响值排序的倒排表，score-at-a-time，可设处理的倒排项上限（近似）
+};
+
+// 解析 BM25Config::query_mode，未知取值回退为 EXHAUSTIVE
+BM25QueryMode parse_bm25_query_mode(const std::string& mode);
+
+// 倒排表按文档区间分段（LSM）：新文档写入可变段，写满 segment_docs 后封存为不可变段，
+// 相近大小的封存段凑满 merge_factor 个时在后台合并；查询依次遍历各段，共用一个top-K
+// 词典、df、文档长度等全局统计量不分段，分段前后的查询结果完全一致
 class BM25Indexer {
 public:
     BM25Indexer(const BM25Config& config = BM25Config{});
     BM25Indexer(double k1 = 1.5, double b = 0.75);  // Keep backward compatibility
+    ~BM25Indexer();
 
     // 设置Tokenizer
     void set_tokenizer(std::shared_ptr<Tokenizer> tokenizer);
     void set_tokenizer_config(const TokenizerConfig& config);
 
+    // 设置查询模式，剪枝模式与 EXHAUSTIVE 返回完全相同的结果
+    // IMPACT 模式使用建索引时量化的分数：以 IMPACT 模式构造时 fit() / 封存段 / 合并段会预计算影响值，
+    // 否则查询时现算（结果相同但较慢）
+    void set_query_mode(BM25QueryMode mode);
+
+    // 设置建索引、后台合并段与并行查询使用的线程池，为空时单线程构建与查询、合并在写操作返回前同步完成
+    void set_thread_pool(std::shared_ptr<ThreadPool> pool);
+
+    // 全量重建：在锁外构建新索引，完成后整体替换，重建后只有一个段
+    // 设置了线程池时语料按下标切分为多个分片并行构建，再按分片顺序合并，结果与单线程构建完全一致
     void fit(const std::vector<Chunk>& chunks);
-    std::vector<std::pair<size_t, double>> query(const std::vector<std::string>& terms, size_t topK);
+
+    // 增量追加文档，返回第一个新文档的下标（新文档下标连续分配）
+    // 分词在锁外完成，只在写入可变段时短暂持有写锁，耗时与已有语料规模无关
+    size_t add_documents(const std::vector<Chunk>& chunks);
+
+    // 删除 doc_id 对应的所有文档块，返回被删除的文档下标（下标不会被复用）
+    // 倒排表中的残留项在合并段时清理
+    std::vector<size_t> remove_document(const std::string& doc_id);
+
+    // 等待正在进行的后台合并完成
+    void wait_for_merges();
+
+    // 设置了线程池且文档数达到 BM25Config::parallel_query_min_docs 时，文档空间按下标切成
+    // query_shards 个区间并行打分，各区间的局部top-K归并为最终结果，与单线程查询完全相同
+    // filter 不为空时只返回其中的文档：打分时直接跳过不在其中的文档（WAND 按位图跳到下一个候选），
+    // 结果与不过滤查询全部文档后再筛选相同；IDF 等统计量不受过滤影响
+    std::vector<std::pair<size_t, double>> query(const std::vector<std::string>& terms, size_t topK,
+                                                 const DocBitmap* filter = nullptr);
+
+    // 批量查询，结果与逐条调用 query() 完全相同
+    // 查询按词项分组后分批处理，每批只加一次读锁，批内每个倒排表只解码一次、每个倒排项的分数只计算一次
+    std::vector<std::vector<std::pair<size_t, double>>> query_batch(const std::vector<std::vector<std::string>>& queries, size_t topK);
+
+    // 短语/邻近查询（需开启 BM25Config::store_positions）：terms 须按顺序出现在文档中，
+    // 相邻词之间总共最多插入 slop 个其他词，slop = 0 为精确短语；位置按分词结果计数
+    // 分数 = 各词的BM25分数之和 + 邻近加分（把短语当作一个词计算BM25，匹配越紧凑加分越高）
+    std::vector<std::pair<size_t, double>> query_phrase(const std::vector<std::string>& terms, size_t topK, uint32_t slop = 0);
+    std::vector<std::pair<size_t, double>> query_phrase_text(const std::string& text, size_t topK, uint32_t slop = 0,
+                                                             Language lang = Language::AUTO);
+
+    // 使用词项ID查询（ID来自本索引的词典）
+    std::vector<std::pair<size_t, double>> query_ids(const std::vector<TermId>& term_ids, size_t topK,
+                                                     const DocBitmap* filter = nullptr);
 
     // 使用文本查询（自动分词）
-    std::vector<std::pair<size_t, double>> query_text(const std::string& query_text, size_t topK, Language lang = Language::AUTO);
+    std::vector<std::pair<size_t, double>> query_text(const std::string& query_text, size_t topK, Language lang = Language::AUTO,
+                                                      const DocBitmap* filter = nullptr);
+
+    // 词典大小
+    size_t vocabulary_size();
+
+    // 存活文档数
+    size_t document_count();
+
+    // 已分配的文档下标数（含已删除的文档），即下一个新文档的下标
+    size_t allocated_documents();
+
+    // 倒排表统计：条目总数（含未压缩掉的已删除文档）与占用的字节数（不含词位置）
+    struct PostingStats {
+        size_t postings = 0;
+        size_t bytes = 0;
+        size_t position_bytes = 0;   // 词位置占用的字节数
+    };
+    PostingStats posting_stats();
+
+    // 段数（含可变段）
+    size_t segment_count();
+
+    // 快照：写入当前索引；加载时倒排表、词典等直接引用快照的映射内存，之后仍可增删文档
+    // 加载失败时保持原索引不变
+    void save_snapshot(SnapshotWriter& writer);
+    bool load_snapshot(SectionReader& reader);
 
 private:
-    double idf(const std::string& term) const;
+    // 倒排表按固定大小分块压缩，每块记录用于计算分数上界的统计量
+    static constexpr size_t kBlockSize = PostingList::kBlockSize;
+
+    // 块元数据：块内最大文档下标、最大词频、最短文档长度
+    // 分数上界由 (max_tf, min_len) 在查询时计算，不依赖 IDF 和 avgdl 的当前取值，
+    // 增删文档后仍然是合法上界
+    struct BlockMax {
+        uint32_t last_doc;
+        uint32_t max_tf;
+        uint32_t min_len;
+    };
+
+    // 影响值相同的一组文档：编码数据在 impact_bytes 中结束的位置、文档数、影响值
+    struct ImpactRun {
+        uint32_t end;
+        uint32_t count;
+        uint32_t impact;
+    };
+
+    // 词项条目：段内按文档下标（全局下标）升序的倒排表
+    // 已删除文档的倒排项先保留，合并段时再清理
+    struct TermEntry {
+        PostingList postings;
+        MappedArray<BlockMax> blocks;
+        uint32_t max_tf = 0;     // 整个倒排表的最大词频
+        uint32_t min_len = UINT32_MAX;  // 整个倒排表的最短文档长度
+        // 词位置（IndexData::positions 开启时）：按倒排项顺序存放，每项 tf 个位置，项内差分后变长字节编码
+        // position_blocks[b] 为第 b 块第一项的位置数据在 positions 中的起始字节
+        MappedArray<uint8_t> positions;
+        MappedArray<uint32_t> position_blocks;
+        // 按影响值排序的倒排表（IndexData::impacts 开启且段已封存时）：影响值为量化到 1..255 的BM25分数，
+        // 影响值相同的文档为一组，组按影响值降序排列，组内文档下标升序、差分后变长字节编码
+        MappedArray<uint8_t> impact_bytes;
+        MappedArray<ImpactRun> impact_runs;
+    };
+
+    // 段：文档区间 [doc_begin, doc_end) 的倒排表
+    // 稠密段（fit() 构建）的 terms 下标即词项ID；稀疏段只包含段内出现的词项：
+    // 可变段通过 term_index 查找，封存后按词项ID排序存入 term_ids，二分查找
+    // 封存段的倒排表不再修改，后台合并时可以在锁外读取
+    struct Segment {
+        uint32_t doc_begin = 0;
+        uint32_t doc_end = 0;
+        uint32_t dead_docs = 0;    // 倒排表中仍有残留项的已删除文档数（持有写锁修改）
+        bool dense = false;
+        bool sealed = false;
+        std::vector<TermEntry> terms;
+        MappedArray<TermId> term_ids;                      // 封存的稀疏段：terms[i] 的词项ID，升序
+        std::unordered_map<TermId, uint32_t> term_index;   // 可变的稀疏段：词项ID -> terms 下标
+        std::shared_ptr<const MappedFile> mapping;         // 引用的快照映射（合并时段可能比 IndexData 活得久）
+
+        size_t docs() const { return doc_end - doc_begin; }
+
+        // 查找词项的倒排表，不存在返回 nullptr
+        const TermEntry* find(TermId id) const;
+
+        // 可变段：取得词项的倒排表，不存在时创建
+        TermEntry& get_or_add(TermId id, PostingCodec codec);
+    };
+
+    // 索引数据，fit() 在锁外构建一份新的再整体替换
+    // 从快照加载时数组直接引用映射内存，修改时写时复制
+    struct IndexData {
+        PostingCodec codec = PostingCodec::BITPACK;
+        bool positions = false;              // 是否保存词位置
+        bool impacts = false;                // 封存段是否预计算影响值
+        double impact_unit = 0.0;            // 影响值的量化单位（分数 = 影响值 × unit），fit() 时确定
+        Vocabulary vocab;                    // 词项 <-> TermId
+        MappedArray<uint32_t> df;            // TermId -> 存活文档数，IDF在查询时由它计算
+        std::vector<std::shared_ptr<Segment>> segments;  // 按文档区间排列，最后一段可能是可变段
+        MappedArray<uint32_t> doc_len;       // 预计算的文档长度（含已删除文档）
+        MappedArray<uint8_t> live;           // 文档是否存活
+        MappedArray<TermId> fwd_terms;       // 正排表：每个文档的去重词项，删除时用于更新df
+        MappedArray<uint64_t> fwd_offsets{0};
+        std::unordered_map<std::string, std::vector<uint32_t>> doc_chunks;  // doc_id -> 文档下标
+        // 快照中的 doc_id -> 文档下标，按 doc_id 排序，查找时与 doc_chunks 合并
+        StringColumn snapshot_doc_ids;
+        MappedArray<uint64_t> snapshot_doc_offsets{0};
+        MappedArray<uint32_t> snapshot_docs;
+        size_t live_docs = 0;
+        double total_len = 0.0;              // 存活文档总长度
+        std::shared_ptr<const MappedFile> mapping;  // 引用的快照映射
+    };
+
+    // WAND遍历使用的倒排表游标
+    struct Cursor;
+
+    // 计算影响值所用的统计量：建段（fit / 封存 / 合并）时的 df、存活文档数与平均文档长度
+    // 之后增删文档不再更新已建段的影响值，合并段时按当时的统计量重算
+    struct ImpactStats {
+        const uint32_t* df = nullptr;
+        size_t live_docs = 0;
+        double avgdl = 0.0;
+        double unit = 0.0;
+    };
+
+    // 查询词：词项ID与按当前存活文档数计算的IDF
+    struct QueryTerm {
+        TermId id;
+        double idf;
+    };
+
+    // 构建 [begin, end) 范围内文档的索引（文档下标从0开始，只有一个稠密段）
+    IndexData build_shard(const std::vector<Chunk>& chunks, size_t begin, size_t end) const;
+
+    // 按分片顺序合并分片索引，结果与单线程构建完全一致（需要线程池）
+    IndexData merge_shards(std::vector<IndexData>&& shards) const;
+
+    // 把一个文档追加到最后一段（必须是可变段），ids 为已映射的词项ID
+    // 追加完一批文档后需对涉及的词项调用 PostingList::seal()
+    static void append_document(IndexData& data, std::vector<TermId> ids, const std::string& doc_id);
+
+    // 封存段：编码所有尾部条目，稀疏段按词项ID排序
+    static void seal_segment(Segment& segment);
+
+    // 重新计算词项的块元数据（含词位置的块起点），doc_len[i] 为文档 doc_base + i 的长度
+    static void build_blocks(TermEntry& entry, const uint32_t* doc_len, uint32_t doc_base);
+
+    // 取出 doc_id 的所有文档下标（含已删除的），并从 doc_chunks 中移除
+    static std::vector<uint32_t> take_doc_chunks(IndexData& data, const std::string& doc_id);
+
+    // 包含文档 doc 的段
+    static Segment& segment_of(IndexData& data, uint32_t doc);
+
+    // 合并相邻的封存段，live / doc_len 为合并开始时这些段文档区间内的状态，已删除文档的倒排项被丢弃
+    // impacts 不为空时为合并结果计算影响值
+    std::shared_ptr<Segment> merge_segments(const std::vector<std::shared_ptr<Segment>>& run,
+                                            const std::vector<uint8_t>& live,
+                                            const std::vector<uint32_t>& doc_len,
+                                            PostingCodec codec, const ImpactStats* impacts) const;
+
+    // 影响值：data 当前的统计量；量化单位取所有词项分数上界的最大值对应 255
+    ImpactStats impact_stats(const IndexData& data) const;
+    double impact_unit(const IndexData& data, const Segment& segment) const;
+
+    // 按影响值编码词项的倒排表，doc_len[i] 为文档 doc_base + i 的长度
+    void encode_impacts(const TermEntry& entry, double idf_v, double avgdl, double unit,
+                        const uint32_t* doc_len, uint32_t doc_base,
+                        std::vector<uint8_t>& bytes, std::vector<ImpactRun>& runs) const;
+    void build_impacts(TermEntry& entry, TermId id, const ImpactStats& stats,
+                       const uint32_t* doc_len, uint32_t doc_base) const;
+
+    // 为封存段的所有词项计算影响值；parallel 为 true 时使用线程池（调用方不能持有锁）
+    void build_segment_impacts(IndexData& data, Segment& segment, bool parallel) const;
+
+    // 段的快照读写
+    static void save_segment(SnapshotWriter& writer, const Segment& segment);
+    static bool load_segment(SectionReader& reader, const IndexData& data, Segment& segment);
+
+    // 合并策略：返回待合并的相邻封存段区间 [first, last)，不需要合并时 first == last
+    std::pair<size_t, size_t> pick_merge(const IndexData& data) const;
+
+    // 执行一次合并，没有可合并的段时返回 false
+    bool merge_once();
+
+    // 写操作结束后调用：有线程池时在后台合并，否则同步合并
+    void schedule_merges();
+
+    double idf(size_t df) const;
+    double idf(size_t df, size_t live_docs) const;
+
+    // 调用方需持有读锁；filter 为空时不过滤
+    std::vector<std::pair<size_t, double>> query_ids_locked(const std::vector<TermId>& term_ids, size_t topK,
+                                                            const DocBitmap* filter) const;
+    // 对文档区间 [lo, hi) 打分，区间可以跨段；段内只处理落在区间内的倒排项
+    void query_range(const std::vector<QueryTerm>& terms, uint32_t lo, uint32_t hi, const DocBitmap* filter,
+                     TopK<size_t>& top) const;
+    void query_exhaustive(const Segment& segment, const std::vector<QueryTerm>& terms, uint32_t lo, uint32_t hi,
+                          const DocBitmap* filter, TopK<size_t>& top) const;
+    void query_wand(const Segment& segment, const std::vector<QueryTerm>& terms, uint32_t lo, uint32_t hi,
+                    const DocBitmap* filter, TopK<size_t>& top, bool block_max) const;
+    // 各分片的局部top-K在线程池上并行计算后归并
+    std::vector<std::pair<size_t, double>> query_sharded(const std::vector<QueryTerm>& terms, size_t shards,
+                                                         size_t topK, const DocBitmap* filter) const;
+    void query_phrase_segment(const Segment& segment, const std::vector<QueryTerm>& terms, uint32_t slop,
+                              TopK<size_t>& top) const;
+    std::vector<std::pair<size_t, double>> query_impact(const std::vector<QueryTerm>& terms, size_t topK,
+                                                        const DocBitmap* filter) const;
+    void query_batch_locked(const std::vector<std::vector<QueryTerm>>& batch, std::vector<TopK<size_t>>& tops) const;
+
+    // 单个词项对文档的BM25贡献
+    double term_score(double idf_v, uint32_t tf, uint32_t doclen) const;
+    double term_score(double idf_v, uint32_t tf, uint32_t doclen, double avgdl) const;
 
     // 分词函数
     std::vector<std::string> tokenize(const std::string& text, Language lang = Language::AUTO) const;
 
+    // 分词并映射为词项ID（建索引时写入词典，查询时只查找）
+    std::vector<TermId> intern_tokens(const std::string& text, Vocabulary& vocab) const;
+    std::vector<TermId> lookup_tokens(const std::string& text, Language lang) const;
+
+    // 加锁：写者在 gate_ 上排队时新到的读者先等待，避免读者连续到达导致写者饿死
+    std::shared_lock<std::shared_mutex> read_lock();
+    std::unique_lock<std::shared_mutex> write_lock();
+
     double k1_;
     double b_;
+    BM25QueryMode mode_ = BM25QueryMode::EXHAUSTIVE;
+    PostingCodec codec_ = PostingCodec::BITPACK;
+    bool store_positions_ = false;
+    size_t impact_budget_ = 0;   // IMPACT 模式每次查询最多处理的倒排项数，0 为不限
+    size_t query_shards_ = 0;    // 并行查询的分片数，0 为线程池大小
+    size_t parallel_query_min_docs_ = 100000;
+    size_t segment_docs_ = 4096;
+    size_t merge_factor_ = 8;
     double avgdl_ = 0.0;
-    size_t N_ = 0;
-    std::unordered_map<std::string, size_t> df_;
-    std::vector<std::unordered_map<std::string, size_t>> tfs_;
-    std::shared_mutex mutex_;
+    IndexData data_;
+    uint64_t generation_ = 0;   // fit() / 加载快照替换索引时递增，丢弃基于旧索引的合并结果
+    std::shared_mutex mutex_;   // 保护 data_：查询持读锁，修改倒排表时持写锁
+    std::mutex write_mutex_;    // 串行化写操作（fit / add_documents / remove_document）
+    std::mutex gate_;
 
     // Tokenizer
     std::shared_ptr<Tokenizer> tokenizer_;
+
+    // 建索引、合并与并行查询的线程池
+    std::shared_ptr<ThreadPool> thread_pool_;
+
+    // 后台合并：同一时刻最多一个合并任务
+    std::mutex merge_mutex_;
+    std::condition_variable merge_cv_;
+    bool merging_ = false;
+    bool merge_pending_ = false;  // 合并任务运行期间又有写操作，结束前需再检查一次
 };
 
 } // namespace rag
@@ -0,0 +1,89 @@
+#include "chunk_store.h"
+#include <iostream>
+
+namespace rag {
+
+void ChunkStore::push_back(const Chunk& chunk) {
+    text_.push_back(chunk.text);
+    doc_id_.push_back(chunk.doc_id);
+    topic_.push_back(chunk.topic);
+    language_.push_back(chunk.language);
+    seq_no_.push_back(chunk.seq_no);
+    created_at_.push_back(static_cast<int64_t>(chunk.created_at));
+    live_.push_back(1);
+}
+
+void ChunkStore::assign(const std::vector<Chunk>& chunks) {
+    clear();
+    size_t text_bytes = 0;
+    for (const auto &chunk : chunks) text_bytes += chunk.text.size();
+    text_.chars.reserve(text_bytes);
+    text_.offsets.reserve(chunks.size() + 1);
+    seq_no_.reserve(chunks.size());
+    created_at_.reserve(chunks.size());
+    live_.reserve(chunks.size());
+    for (const auto &chunk : chunks) push_back(chunk);
+}
+
+void ChunkStore::clear() {
+    text_.clear();
+    doc_id_.clear();
+    topic_.clear();
+    language_.clear();
+    seq_no_.clear();
+    created_at_.clear();
+    live_.clear();
+    mapping_.reset();
+}
+
+Chunk ChunkStore::get(size_t i) const {
+    Chunk chunk;
+    chunk.text = std::string(text(i));
+    chunk.doc_id = std::string(doc_id(i));
+    chunk.seq_no = seq_no(i);
+    chunk.topic = std::string(topic(i));
+    chunk.language = std::string(language(i));
+    chunk.created_at = created_at(i);
+    return chunk;
+}
+
+void ChunkStore::save_snapshot(SnapshotWriter& writer) const {
+    writer.write<uint64_t>(size());
+    writer.write_strings(text_);
+    writer.write_strings(doc_id_);
+    writer.write_strings(topic_);
+    writer.write_strings(language_);
+    writer.write_array(seq_no_);
+    writer.write_array(created_at_);
+    writer.write_array(live_);
+}
+
+bool ChunkStore::load_snapshot(SectionReader& reader) {
+    uint64_t n = 0;
+    ChunkStore store;
+    bool ok = reader.read(n) &&
+              reader.read_strings(store.text_) && reader.read_strings(store.doc_id_) &&
+              reader.read_strings(store.topic_) && reader.read_strings(store.language_) &&
+              reader.read_array(store.seq_no_) && reader.read_array(store.created_at_) &&
+              reader.read_array(store.live_);
+    ok = ok && store.text_.size() == n && store.doc_id_.size() == n && store.topic_.size() == n &&
+         store.language_.size() == n && store.seq_no_.size() == n &&
+         store.created_at_.size() == n && store.live_.size() == n;
+    if (!ok) {
+        reader.fail();
+        std::cerr << "ChunkStore: corrupt chunk snapshot section" << std::endl;
+        return false;
+    }
+
+    store.mapping_ = reader.file();
+    *this = std::move(store);
+    return true;
+}
+
+size_t ChunkStore::memory_usage() const {
+    return text_.memory_usage() + doc_id_.memory_usage() + topic_.memory_usage() +
+           language_.memory_usage() + seq_no_.memory_usage() + created_at_.memory_usage() +
+           live_.memory_usage();
+}
+
+} // namespace rag
@@ -0,0 +1,54 @@
+#pragma once
+#include "chunk.h"
+#include "mapped_array.h"
+#include "snapshot.h"
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace rag {
+
+// 按列存放的chunk存储，下标即文档下标
+// 从快照加载时各列直接引用映射内存，之后追加或删除时写时复制
+// 非线程安全，由使用方（如 FusionRetriever）负责加锁
+class ChunkStore {
+public:
+    size_t size() const { return seq_no_.size(); }
+    bool empty() const { return size() == 0; }
+
+    void push_back(const Chunk& chunk);
+    void assign(const std::vector<Chunk>& chunks);
+    void clear();
+
+    std::string_view text(size_t i) const { return text_[i]; }
+    std::string_view doc_id(size_t i) const { return doc_id_[i]; }
+    size_t seq_no(size_t i) const { return static_cast<size_t>(seq_no_[i]); }
+    std::string_view topic(size_t i) const { return topic_[i]; }
+    std::string_view language(size_t i) const { return language_[i]; }
+    std::time_t created_at(size_t i) const { return static_cast<std::time_t>(created_at_[i]); }
+
+    // chunk是否存活（删除后下标不复用）
+    bool live(size_t i) const { return live_[i] != 0; }
+    void remove(size_t i) { live_.writable()[i] = 0; }
+
+    Chunk get(size_t i) const;
+
+    // 快照读写；加载失败时保持原内容不变
+    void save_snapshot(SnapshotWriter& writer) const;
+    bool load_snapshot(SectionReader& reader);
+
+    size_t memory_usage() const;
+
+private:
+    StringColumn text_;
+    StringColumn doc_id_;
+    StringColumn topic_;
+    StringColumn language_;
+    MappedArray<uint64_t> seq_no_;
+    MappedArray<int64_t> created_at_;
+    MappedArray<uint8_t> live_;
+    std::shared_ptr<const MappedFile> mapping_;  // 引用的快照映射
+};
+
+} // namespace rag
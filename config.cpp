@@ -36,6 +36,30 @@ std::shared_ptr<RAGConfig> ConfigLoader::load(const std::string& config_path) {
             if (bm25_table.contains("b")) {
                 config->bm25.b = bm25_table["b"].as_floating_point()->get();
             }
+            if (bm25_table.contains("query_mode")) {
+                config->bm25.query_mode = bm25_table["query_mode"].as_string()->get();
+            }
+            if (bm25_table.contains("posting_codec")) {
+                config->bm25.posting_codec = bm25_table["posting_codec"].as_string()->get();
+            }
+            if (bm25_table.contains("segment_docs")) {
+                config->bm25.segment_docs = bm25_table["segment_docs"].as_integer()->get();
+            }
+            if (bm25_table.contains("merge_factor")) {
+                config->bm25.merge_factor = bm25_table["merge_factor"].as_integer()->get();
+            }
+            if (bm25_table.contains("store_positions")) {
+                config->bm25.store_positions = bm25_table["store_positions"].as_boolean()->get();
+            }
+            if (bm25_table.contains("impact_budget")) {
+                config->bm25.impact_budget = bm25_table["impact_budget"].as_integer()->get();
+            }
+            if (bm25_table.contains("query_shards")) {
+                config->bm25.query_shards = bm25_table["query_shards"].as_integer()->get();
+            }
+            if (bm25_table.contains("parallel_query_min_docs")) {
+                config->bm25.parallel_query_min_docs = bm25_table["parallel_query_min_docs"].as_integer()->get();
+            }
         }
 
         // Load HNSW config
@@ -56,6 +80,46 @@ std::shared_ptr<RAGConfig> ConfigLoader::load(const std::string& config_path) {
             if (hnsw_table.contains("max_elements")) {
                 config->hnsw.max_elements = hnsw_table["max_elements"].as_integer()->get();
             }
+            if (hnsw_table.contains("compaction_threshold")) {
+                config->hnsw.compaction_threshold = hnsw_table["compaction_threshold"].as_floating_point()->get();
+            }
+        }
+
+        // Load IVF-PQ config
+        if (data.contains("ivf_pq")) {
+            const auto& ivf_table = *data["ivf_pq"].as_table();
+            if (ivf_table.contains("nlist")) {
+                config->ivf_pq.nlist = ivf_table["nlist"].as_integer()->get();
+            }
+            if (ivf_table.contains("nprobe")) {
+                config->ivf_pq.nprobe = ivf_table["nprobe"].as_integer()->get();
+            }
+            if (ivf_table.contains("m")) {
+                config->ivf_pq.m = ivf_table["m"].as_integer()->get();
+            }
+            if (ivf_table.contains("nbits")) {
+                config->ivf_pq.nbits = ivf_table["nbits"].as_integer()->get();
+            }
+            if (ivf_table.contains("train_size")) {
+                config->ivf_pq.train_size = ivf_table["train_size"].as_integer()->get();
+            }
+        }
+
+        // Load vector index config
+        if (data.contains("vector")) {
+            const auto& vector_table = *data["vector"].as_table();
+            if (vector_table.contains("index")) {
+                config->vector.index = vector_table["index"].as_string()->get();
+            }
+            if (vector_table.contains("quantization")) {
+                config->vector.quantization = vector_table["quantization"].as_string()->get();
+            }
+            if (vector_table.contains("rerank_factor")) {
+                config->vector.rerank_factor = vector_table["rerank_factor"].as_integer()->get();
+            }
+            if (vector_table.contains("filter_brute_force_ratio")) {
+                config->vector.filter_brute_force_ratio = vector_table["filter_brute_force_ratio"].as_floating_point()->get();
+            }
         }
 
         // Load fusion config
@@ -13,6 +13,14 @@ struct ChunkConfig {
 struct BM25Config {
     double k1 = 1.5;
     double b = 0.75;
+    std::string query_mode = "exhaustive";  // "exhaustive", "wand", "block_max_wand", "impact"
+    std::string posting_codec = "bitpack";  // "raw", "varbyte", "bitpack"
+    int segment_docs = 4096;   // 可变段写满多少文档后封存
+    int merge_factor = 8;      // 同一层的封存段凑满多少个时合并
+    bool store_positions = false;  // 保存词位置，支持短语/邻近查询
+    int impact_budget = 0;     // impact 模式每次查询最多处理的倒排项数，0 为不限
+    int query_shards = 0;      // 单条查询按文档区间切分、在线程池上并行打分的分片数，0 为线程池大小
+    int parallel_query_min_docs = 100000;  // 文档数达到该值才并行查询，小索引仍单线程
 };
 
 struct HNSWConfig {
@@ -21,6 +29,23 @@ struct HNSWConfig {
     int ef_query = 50;
     int vector_dim = 768;
     int max_elements = 10000;
+    double compaction_threshold = 0.1;  // 已删除但仍在图中的节点占比超过该值时修复邻居表，0 表示每次删除后都修复
+};
+
+// IVF-PQ：粗量化 k-means 分桶 + 残差乘积量化，每个向量只存 m * nbits 位的码
+struct IVFPQConfig {
+    int nlist = 1024;        // 倒排桶（粗量化中心）数
+    int nprobe = 32;         // 查询时扫描的桶数
+    int m = 96;              // 子空间数，须整除向量维度（否则取不超过 m 的最大约数）
+    int nbits = 8;           // 每个子码的位数（1~8），每个子空间 2^nbits 个中心
+    int train_size = 40000;  // 累计到这么多向量时训练，之前精确检索
+};
+
+struct VectorConfig {
+    std::string index = "flat";   // 向量索引："flat"（暴力检索）、"hnsw"（参数见 HNSWConfig）、"ivf_pq"（参数见 IVFPQConfig）
+    std::string quantization = "none";  // flat 索引的向量量化："none"、"int8"（标量量化 + float32 重排）、"binary"（符号位汉明距离预筛 + float32 重排）
+    int rerank_factor = 4;        // int8 / binary / ivf_pq 时取 top_k * rerank_factor 个候选用原始向量重排，0 表示不重排也不保留原始向量
+    double filter_brute_force_ratio = 0.05;  // hnsw / ivf_pq 检索时过滤条件允许的向量占比低于该值，改为只对允许的向量暴力检索
 };
 
 struct FusionConfig {
@@ -66,6 +91,8 @@ struct RAGConfig {
     ChunkConfig chunk;
     BM25Config bm25;
     HNSWConfig hnsw;
+    IVFPQConfig ivf_pq;
+    VectorConfig vector;
     FusionConfig fusion;
     CacheConfig cache;
     ThreadPoolConfig threadpool;
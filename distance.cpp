@@ -0,0 +1,657 @@
+#include "distance.h"
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RAG_DISTANCE_X86 1
+#include <immintrin.h>
+#endif
+
+namespace rag {
+namespace distance {
+
+namespace {
+
+// 标量实现：4路累加打断加法依赖链
+float dot_scalar(const float* a, const float* b, size_t n) {
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    for (; i < n; ++i) s0 += a[i] * b[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+float l2_sq_scalar(const float* a, const float* b, size_t n) {
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float d0 = a[i] - b[i], d1 = a[i + 1] - b[i + 1];
+        float d2 = a[i + 2] - b[i + 2], d3 = a[i + 3] - b[i + 3];
+        s0 += d0 * d0;
+        s1 += d1 * d1;
+        s2 += d2 * d2;
+        s3 += d3 * d3;
+    }
+    for (; i < n; ++i) {
+        float d = a[i] - b[i];
+        s0 += d * d;
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+// kNormA 为 false 时不计算 a·a（aa 可以为空）
+template <bool kNormA>
+void norms_scalar(const float* a, const float* b, size_t n, float* ab, float* aa, float* bb) {
+    float sab = 0.0f, saa = 0.0f, sbb = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        sab += a[i] * b[i];
+        if (kNormA) saa += a[i] * a[i];
+        sbb += b[i] * b[i];
+    }
+    *ab = sab;
+    if (kNormA) *aa = saa;
+    *bb = sbb;
+}
+
+void dot_block_scalar(const float* a, size_t na, size_t a_stride, const float* b, size_t nb, size_t b_stride,
+                      size_t n, float* out) {
+    for (size_t i = 0; i < na; ++i) {
+        for (size_t j = 0; j < nb; ++j) out[i * nb + j] = dot_scalar(a + i * a_stride, b + j * b_stride, n);
+    }
+}
+
+int32_t dot_i8_scalar(const int8_t* a, const int8_t* b, size_t n) {
+    int32_t sum = 0;
+    for (size_t i = 0; i < n; ++i) sum += int32_t(a[i]) * b[i];
+    return sum;
+}
+
+// 汉明距离：按64位字异或后计数
+void hamming_scan_scalar(const uint8_t* query, const uint8_t* codes, size_t bytes, size_t n, uint32_t* out) {
+    for (size_t i = 0; i < n; ++i) {
+        const uint8_t* row = codes + i * bytes;
+        uint32_t d = 0;
+        for (size_t b = 0; b < bytes; b += 8) {
+            uint64_t q, r;
+            std::memcpy(&q, query + b, 8);
+            std::memcpy(&r, row + b, 8);
+            d += static_cast<uint32_t>(__builtin_popcountll(q ^ r));
+        }
+        out[i] = d;
+    }
+}
+
+// 分块转置布局中第 lane 行的第 j 个子码：从第 j * nbits 位开始，跨到下一字节时再取高位
+inline uint32_t pq_code(const uint8_t* block, size_t lane, size_t bit, size_t nbits) {
+    size_t byte = bit >> 3, shift = bit & 7;
+    uint32_t word = block[byte * kAdcBlock + lane];
+    if (shift + nbits > 8) word |= uint32_t(block[(byte + 1) * kAdcBlock + lane]) << 8;
+    return (word >> shift) & ((1u << nbits) - 1);
+}
+
+void adc_scan_scalar(const float* lut, size_t m, size_t nbits, const uint8_t* codes, size_t code_size, size_t blocks,
+                     float* out) {
+    size_t ksub = size_t(1) << nbits;
+    for (size_t b = 0; b < blocks; ++b) {
+        const uint8_t* block = codes + b * code_size * kAdcBlock;
+        for (size_t lane = 0; lane < kAdcBlock; ++lane) {
+            float s0 = 0.0f, s1 = 0.0f;
+            size_t j = 0;
+            if (nbits == 8) {
+                for (; j + 2 <= m; j += 2) {
+                    s0 += lut[j * 256 + block[j * kAdcBlock + lane]];
+                    s1 += lut[(j + 1) * 256 + block[(j + 1) * kAdcBlock + lane]];
+                }
+                if (j < m) s0 += lut[j * 256 + block[j * kAdcBlock + lane]];
+            } else {
+                for (; j < m; ++j) s0 += lut[j * ksub + pq_code(block, lane, j * nbits, nbits)];
+            }
+            out[b * kAdcBlock + lane] = s0 + s1;
+        }
+    }
+}
+
+#ifdef RAG_DISTANCE_X86
+
+__attribute__((target("avx2,fma")))
+inline float hsum_avx2(__m256 v) {
+    __m128 lo = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+    lo = _mm_add_ss(lo, _mm_movehdup_ps(lo));
+    return _mm_cvtss_f32(lo);
+}
+
+// 每轮32个分量，4个累加器掩盖FMA延迟
+__attribute__((target("avx2,fma")))
+float dot_avx2(const float* a, const float* b, size_t n) {
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    __m256 s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+        s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), s1);
+        s2 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16), s2);
+        s3 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24), s3);
+    }
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+    }
+    float sum = hsum_avx2(_mm256_add_ps(_mm256_add_ps(s0, s1), _mm256_add_ps(s2, s3)));
+    for (; i < n; ++i) sum += a[i] * b[i];
+    return sum;
+}
+
+__attribute__((target("avx2,fma")))
+float l2_sq_avx2(const float* a, const float* b, size_t n) {
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    __m256 s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+        __m256 d2 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16));
+        __m256 d3 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24));
+        s0 = _mm256_fmadd_ps(d0, d0, s0);
+        s1 = _mm256_fmadd_ps(d1, d1, s1);
+        s2 = _mm256_fmadd_ps(d2, d2, s2);
+        s3 = _mm256_fmadd_ps(d3, d3, s3);
+    }
+    for (; i + 8 <= n; i += 8) {
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        s0 = _mm256_fmadd_ps(d, d, s0);
+    }
+    float sum = hsum_avx2(_mm256_add_ps(_mm256_add_ps(s0, s1), _mm256_add_ps(s2, s3)));
+    for (; i < n; ++i) {
+        float d = a[i] - b[i];
+        sum += d * d;
+    }
+    return sum;
+}
+
+template <bool kNormA>
+__attribute__((target("avx2,fma")))
+void norms_avx2(const float* a, const float* b, size_t n, float* ab, float* aa, float* bb) {
+    __m256 sab0 = _mm256_setzero_ps(), sab1 = _mm256_setzero_ps();
+    __m256 saa0 = _mm256_setzero_ps(), saa1 = _mm256_setzero_ps();
+    __m256 sbb0 = _mm256_setzero_ps(), sbb1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 a0 = _mm256_loadu_ps(a + i), a1 = _mm256_loadu_ps(a + i + 8);
+        __m256 b0 = _mm256_loadu_ps(b + i), b1 = _mm256_loadu_ps(b + i + 8);
+        sab0 = _mm256_fmadd_ps(a0, b0, sab0);
+        sab1 = _mm256_fmadd_ps(a1, b1, sab1);
+        if (kNormA) {
+            saa0 = _mm256_fmadd_ps(a0, a0, saa0);
+            saa1 = _mm256_fmadd_ps(a1, a1, saa1);
+        }
+        sbb0 = _mm256_fmadd_ps(b0, b0, sbb0);
+        sbb1 = _mm256_fmadd_ps(b1, b1, sbb1);
+    }
+    float sab = hsum_avx2(_mm256_add_ps(sab0, sab1));
+    float saa = hsum_avx2(_mm256_add_ps(saa0, saa1));
+    float sbb = hsum_avx2(_mm256_add_ps(sbb0, sbb1));
+    for (; i < n; ++i) {
+        sab += a[i] * b[i];
+        if (kNormA) saa += a[i] * a[i];
+        sbb += b[i] * b[i];
+    }
+    *ab = sab;
+    if (kNormA) *aa = saa;
+    *bb = sbb;
+}
+
+// int8 内积：maddubs 要求一侧无符号，取 |a| 并把 a 的符号转移到 b 上；
+// 分量不超过127时相邻两对乘积之和不超过 2 * 127 * 127，16位不会饱和，再用 madd 累加为32位
+
+__attribute__((target("avx2,fma")))
+int32_t dot_i8_avx2(const int8_t* a, const int8_t* b, size_t n) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        __m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i + 32));
+        __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i + 32));
+        __m256i p0 = _mm256_maddubs_epi16(_mm256_abs_epi8(a0), _mm256_sign_epi8(b0, a0));
+        __m256i p1 = _mm256_maddubs_epi16(_mm256_abs_epi8(a1), _mm256_sign_epi8(b1, a1));
+        acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(p0, ones));
+        acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(p1, ones));
+    }
+    for (; i + 32 <= n; i += 32) {
+        __m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        __m256i p0 = _mm256_maddubs_epi16(_mm256_abs_epi8(a0), _mm256_sign_epi8(b0, a0));
+        acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(p0, ones));
+    }
+    __m256i acc = _mm256_add_epi32(acc0, acc1);
+    __m128i s4 = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    s4 = _mm_add_epi32(s4, _mm_shuffle_epi32(s4, _MM_SHUFFLE(1, 0, 3, 2)));
+    s4 = _mm_add_epi32(s4, _mm_shuffle_epi32(s4, _MM_SHUFFLE(2, 3, 0, 1)));
+    int32_t sum = _mm_cvtsi128_si32(s4);
+    for (; i < n; ++i) sum += int32_t(a[i]) * b[i];
+    return sum;
+}
+
+// 4条 a 行 × 2条 b 行共8个累加器：每8个分量加载6次、做8次FMA（逐对计算为2次加载1次FMA）
+// 不足 4×2 的边角逐对计算
+__attribute__((target("avx2,fma")))
+void dot_block_avx2(const float* a, size_t na, size_t a_stride, const float* b, size_t nb, size_t b_stride,
+                    size_t n, float* out) {
+    size_t i = 0;
+    for (; i + 4 <= na; i += 4) {
+        const float* a0 = a + i * a_stride;
+        const float* a1 = a0 + a_stride;
+        const float* a2 = a1 + a_stride;
+        const float* a3 = a2 + a_stride;
+        float* o = out + i * nb;
+        size_t j = 0;
+        for (; j + 2 <= nb; j += 2) {
+            const float* b0 = b + j * b_stride;
+            const float* b1 = b0 + b_stride;
+            __m256 s00 = _mm256_setzero_ps(), s01 = _mm256_setzero_ps(), s10 = _mm256_setzero_ps();
+            __m256 s11 = _mm256_setzero_ps(), s20 = _mm256_setzero_ps(), s21 = _mm256_setzero_ps();
+            __m256 s30 = _mm256_setzero_ps(), s31 = _mm256_setzero_ps();
+            size_t k = 0;
+            for (; k + 8 <= n; k += 8) {
+                __m256 x0 = _mm256_loadu_ps(b0 + k), x1 = _mm256_loadu_ps(b1 + k);
+                __m256 y = _mm256_loadu_ps(a0 + k);
+                s00 = _mm256_fmadd_ps(y, x0, s00);
+                s01 = _mm256_fmadd_ps(y, x1, s01);
+                y = _mm256_loadu_ps(a1 + k);
+                s10 = _mm256_fmadd_ps(y, x0, s10);
+                s11 = _mm256_fmadd_ps(y, x1, s11);
+                y = _mm256_loadu_ps(a2 + k);
+                s20 = _mm256_fmadd_ps(y, x0, s20);
+                s21 = _mm256_fmadd_ps(y, x1, s21);
+                y = _mm256_loadu_ps(a3 + k);
+                s30 = _mm256_fmadd_ps(y, x0, s30);
+                s31 = _mm256_fmadd_ps(y, x1, s31);
+            }
+            float r[8] = {hsum_avx2(s00), hsum_avx2(s01), hsum_avx2(s10), hsum_avx2(s11),
+                          hsum_avx2(s20), hsum_avx2(s21), hsum_avx2(s30), hsum_avx2(s31)};
+            for (; k < n; ++k) {
+                r[0] += a0[k] * b0[k];
+                r[1] += a0[k] * b1[k];
+                r[2] += a1[k] * b0[k];
+                r[3] += a1[k] * b1[k];
+                r[4] += a2[k] * b0[k];
+                r[5] += a2[k] * b1[k];
+                r[6] += a3[k] * b0[k];
+                r[7] += a3[k] * b1[k];
+            }
+            for (size_t row = 0; row < 4; ++row) {
+                o[row * nb + j] = r[row * 2];
+                o[row * nb + j + 1] = r[row * 2 + 1];
+            }
+        }
+        for (; j < nb; ++j) {
+            for (size_t row = 0; row < 4; ++row) o[row * nb + j] = dot_avx2(a0 + row * a_stride, b + j * b_stride, n);
+        }
+    }
+    for (; i < na; ++i) {
+        for (size_t j = 0; j < nb; ++j) out[i * nb + j] = dot_avx2(a + i * a_stride, b + j * b_stride, n);
+    }
+}
+
+// ADC 查表：每块的16行分两半，每个子码读8字节码字（一行一字节）扩展为索引，再 gather 查找表
+__attribute__((target("avx2,fma")))
+void adc_scan_avx2(const float* lut, size_t m, size_t nbits, const uint8_t* codes, size_t code_size, size_t blocks,
+                   float* out) {
+    size_t ksub = size_t(1) << nbits;
+    const __m256i mask = _mm256_set1_epi32(static_cast<int>(ksub - 1));
+    for (size_t b = 0; b < blocks; ++b) {
+        const uint8_t* block = codes + b * code_size * kAdcBlock;
+        for (size_t half = 0; half < kAdcBlock; half += 8) {
+            __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+            for (size_t j = 0; j < m; ++j) {
+                size_t bit = j * nbits, byte = bit >> 3, shift = bit & 7;
+                const uint8_t* lo = block + byte * kAdcBlock + half;
+                __m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(lo)));
+                if (nbits != 8) {
+                    if (shift + nbits > 8) {
+                        __m256i hi = _mm256_cvtepu8_epi32(
+                            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(lo + kAdcBlock)));
+                        idx = _mm256_or_si256(idx, _mm256_slli_epi32(hi, 8));
+                    }
+                    idx = _mm256_and_si256(_mm256_srl_epi32(idx, _mm_cvtsi32_si128(static_cast<int>(shift))), mask);
+                }
+                __m256 v = _mm256_i32gather_ps(lut + j * ksub, idx, 4);
+                if (j & 1) {
+                    acc1 = _mm256_add_ps(acc1, v);
+                } else {
+                    acc0 = _mm256_add_ps(acc0, v);
+                }
+            }
+            _mm256_storeu_ps(out + b * kAdcBlock + half, _mm256_add_ps(acc0, acc1));
+        }
+    }
+}
+
+// 汉明距离：每32字节异或后按半字节查表（shuffle）计数，再用 sad 把字节计数横向累加为64位；不足32字节的行尾按64位字计数
+__attribute__((target("avx2,fma,popcnt")))
+void hamming_scan_avx2(const uint8_t* query, const uint8_t* codes, size_t bytes, size_t n, uint32_t* out) {
+    const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                         0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    for (size_t i = 0; i < n; ++i) {
+        const uint8_t* row = codes + i * bytes;
+        __m256i acc = _mm256_setzero_si256();
+        size_t b = 0;
+        for (; b + 32 <= bytes; b += 32) {
+            __m256i x = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(query + b)),
+                                         _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + b)));
+            __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(x, nibble));
+            __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), nibble));
+            acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_add_epi8(lo, hi), zero));
+        }
+        __m128i s2 = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        uint64_t d = static_cast<uint64_t>(_mm_cvtsi128_si64(s2)) + static_cast<uint64_t>(_mm_extract_epi64(s2, 1));
+        for (; b < bytes; b += 8) {
+            uint64_t q, r;
+            std::memcpy(&q, query + b, 8);
+            std::memcpy(&r, row + b, 8);
+            d += _mm_popcnt_u64(q ^ r);
+        }
+        out[i] = static_cast<uint32_t>(d);
+    }
+}
+
+// GCC 12 的 AVX-512 头文件用自赋值的 _mm512_undefined_*() 填充无掩码指令的源操作数，
+// 内联后会误报未初始化；只在 AVX-512 部分关闭这两个告警
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+// AVX-512：每轮32个分量，尾部用掩码加载，不再走标量循环
+inline __mmask16 tail_mask(size_t rest) {
+    return static_cast<__mmask16>((1u << rest) - 1);
+}
+
+__attribute__((target("avx512f")))
+float dot_avx512(const float* a, const float* b, size_t n) {
+    __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        s0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), s0);
+        s1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), s1);
+    }
+    for (; i + 16 <= n; i += 16) {
+        s0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), s0);
+    }
+    if (i < n) {
+        __mmask16 m = tail_mask(n - i);
+        s1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, a + i), _mm512_maskz_loadu_ps(m, b + i), s1);
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(s0, s1));
+}
+
+__attribute__((target("avx512f")))
+float l2_sq_avx512(const float* a, const float* b, size_t n) {
+    __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+        s0 = _mm512_fmadd_ps(d0, d0, s0);
+        s1 = _mm512_fmadd_ps(d1, d1, s1);
+    }
+    for (; i + 16 <= n; i += 16) {
+        __m512 d = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        s0 = _mm512_fmadd_ps(d, d, s0);
+    }
+    if (i < n) {
+        __mmask16 m = tail_mask(n - i);
+        __m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, a + i), _mm512_maskz_loadu_ps(m, b + i));
+        s1 = _mm512_fmadd_ps(d, d, s1);
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(s0, s1));
+}
+
+template <bool kNormA>
+__attribute__((target("avx512f")))
+void norms_avx512(const float* a, const float* b, size_t n, float* ab, float* aa, float* bb) {
+    __m512 sab0 = _mm512_setzero_ps(), sab1 = _mm512_setzero_ps();
+    __m512 saa0 = _mm512_setzero_ps(), saa1 = _mm512_setzero_ps();
+    __m512 sbb0 = _mm512_setzero_ps(), sbb1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512 a0 = _mm512_loadu_ps(a + i), a1 = _mm512_loadu_ps(a + i + 16);
+        __m512 b0 = _mm512_loadu_ps(b + i), b1 = _mm512_loadu_ps(b + i + 16);
+        sab0 = _mm512_fmadd_ps(a0, b0, sab0);
+        sab1 = _mm512_fmadd_ps(a1, b1, sab1);
+        if (kNormA) {
+            saa0 = _mm512_fmadd_ps(a0, a0, saa0);
+            saa1 = _mm512_fmadd_ps(a1, a1, saa1);
+        }
+        sbb0 = _mm512_fmadd_ps(b0, b0, sbb0);
+        sbb1 = _mm512_fmadd_ps(b1, b1, sbb1);
+    }
+    for (; i < n; i += 16) {
+        __mmask16 m = n - i >= 16 ? static_cast<__mmask16>(0xFFFF) : tail_mask(n - i);
+        __m512 va = _mm512_maskz_loadu_ps(m, a + i);
+        __m512 vb = _mm512_maskz_loadu_ps(m, b + i);
+        sab0 = _mm512_fmadd_ps(va, vb, sab0);
+        if (kNormA) saa0 = _mm512_fmadd_ps(va, va, saa0);
+        sbb0 = _mm512_fmadd_ps(vb, vb, sbb0);
+    }
+    *ab = _mm512_reduce_add_ps(_mm512_add_ps(sab0, sab1));
+    if (kNormA) *aa = _mm512_reduce_add_ps(_mm512_add_ps(saa0, saa1));
+    *bb = _mm512_reduce_add_ps(_mm512_add_ps(sbb0, sbb1));
+}
+
+// AVX-512 没有 sign_epi8，用掩码把 a 为负的位置上的 b 取反
+__attribute__((target("avx512f,avx512bw")))
+int32_t dot_i8_avx512(const int8_t* a, const int8_t* b, size_t n) {
+    const __m512i ones = _mm512_set1_epi16(1);
+    const __m512i zero = _mm512_setzero_si512();
+    __m512i acc = _mm512_setzero_si512();
+    for (size_t i = 0; i < n; i += 64) {
+        __mmask64 m = n - i >= 64 ? ~__mmask64(0) : (__mmask64(1) << (n - i)) - 1;
+        __m512i va = _mm512_maskz_loadu_epi8(m, a + i);
+        __m512i vb = _mm512_maskz_loadu_epi8(m, b + i);
+        __m512i sb = _mm512_mask_sub_epi8(vb, _mm512_movepi8_mask(va), zero, vb);
+        __m512i p = _mm512_maddubs_epi16(_mm512_abs_epi8(va), sb);
+        acc = _mm512_add_epi32(acc, _mm512_madd_epi16(p, ones));
+    }
+    return _mm512_reduce_add_epi32(acc);
+}
+
+// 4条 a 行 × 4条 b 行共16个累加器：每16个分量加载8次、做16次FMA；尾部掩码加载
+__attribute__((target("avx512f")))
+void dot_block_avx512(const float* a, size_t na, size_t a_stride, const float* b, size_t nb, size_t b_stride,
+                      size_t n, float* out) {
+    size_t i = 0;
+    for (; i + 4 <= na; i += 4) {
+        const float* ar[4] = {a + i * a_stride, a + (i + 1) * a_stride, a + (i + 2) * a_stride,
+                              a + (i + 3) * a_stride};
+        float* o = out + i * nb;
+        size_t j = 0;
+        for (; j + 4 <= nb; j += 4) {
+            const float* b0 = b + j * b_stride;
+            const float* b1 = b0 + b_stride;
+            const float* b2 = b1 + b_stride;
+            const float* b3 = b2 + b_stride;
+            __m512 s[4][4];
+            for (size_t r = 0; r < 4; ++r) {
+                for (size_t c = 0; c < 4; ++c) s[r][c] = _mm512_setzero_ps();
+            }
+            for (size_t k = 0; k < n; k += 16) {
+                __mmask16 m = n - k >= 16 ? __mmask16(0xFFFF) : tail_mask(n - k);
+                __m512 x0 = _mm512_maskz_loadu_ps(m, b0 + k), x1 = _mm512_maskz_loadu_ps(m, b1 + k);
+                __m512 x2 = _mm512_maskz_loadu_ps(m, b2 + k), x3 = _mm512_maskz_loadu_ps(m, b3 + k);
+                for (size_t r = 0; r < 4; ++r) {
+                    __m512 y = _mm512_maskz_loadu_ps(m, ar[r] + k);
+                    s[r][0] = _mm512_fmadd_ps(y, x0, s[r][0]);
+                    s[r][1] = _mm512_fmadd_ps(y, x1, s[r][1]);
+                    s[r][2] = _mm512_fmadd_ps(y, x2, s[r][2]);
+                    s[r][3] = _mm512_fmadd_ps(y, x3, s[r][3]);
+                }
+            }
+            for (size_t r = 0; r < 4; ++r) {
+                for (size_t c = 0; c < 4; ++c) o[r * nb + j + c] = _mm512_reduce_add_ps(s[r][c]);
+            }
+        }
+        for (; j < nb; ++j) {
+            for (size_t r = 0; r < 4; ++r) o[r * nb + j] = dot_avx512(ar[r], b + j * b_stride, n);
+        }
+    }
+    for (; i < na; ++i) {
+        for (size_t j = 0; j < nb; ++j) out[i * nb + j] = dot_avx512(a + i * a_stride, b + j * b_stride, n);
+    }
+}
+
+__attribute__((target("avx512f")))
+void adc_scan_avx512(const float* lut, size_t m, size_t nbits, const uint8_t* codes, size_t code_size, size_t blocks,
+                     float* out) {
+    size_t ksub = size_t(1) << nbits;
+    const __m512i mask = _mm512_set1_epi32(static_cast<int>(ksub - 1));
+    for (size_t b = 0; b < blocks; ++b) {
+        const uint8_t* block = codes + b * code_size * kAdcBlock;
+        __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+        for (size_t j = 0; j < m; ++j) {
+            size_t bit = j * nbits, byte = bit >> 3, shift = bit & 7;
+            const uint8_t* lo = block + byte * kAdcBlock;
+            __m512i idx = _mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lo)));
+            if (nbits != 8) {
+                if (shift + nbits > 8) {
+                    __m512i hi = _mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lo + kAdcBlock)));
+                    idx = _mm512_or_si512(idx, _mm512_slli_epi32(hi, 8));
+                }
+                idx = _mm512_and_si512(_mm512_srl_epi32(idx, _mm_cvtsi32_si128(static_cast<int>(shift))), mask);
+            }
+            __m512 v = _mm512_i32gather_ps(idx, lut + j * ksub, 4);
+            if (j & 1) {
+                acc1 = _mm512_add_ps(acc1, v);
+            } else {
+                acc0 = _mm512_add_ps(acc0, v);
+            }
+        }
+        _mm512_storeu_ps(out + b * kAdcBlock, _mm512_add_ps(acc0, acc1));
+    }
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif // RAG_DISTANCE_X86
+
+struct Kernels {
+    Isa isa;
+    float (*dot)(const float*, const float*, size_t);
+    float (*l2_sq)(const float*, const float*, size_t);
+    void (*dot_norm)(const float*, const float*, size_t, float*, float*, float*);
+    void (*dot_norms)(const float*, const float*, size_t, float*, float*, float*);
+    void (*dot_block)(const float*, size_t, size_t, const float*, size_t, size_t, size_t, float*);
+    int32_t (*dot_i8)(const int8_t*, const int8_t*, size_t);
+    void (*adc_scan)(const float*, size_t, size_t, const uint8_t*, size_t, size_t, float*);
+    void (*hamming_scan)(const uint8_t*, const uint8_t*, size_t, size_t, uint32_t*);
+};
+
+const Kernels kScalar = {Isa::SCALAR, dot_scalar, l2_sq_scalar, norms_scalar<false>, norms_scalar<true>,
+                         dot_block_scalar, dot_i8_scalar, adc_scan_scalar, hamming_scan_scalar};
+#ifdef RAG_DISTANCE_X86
+const Kernels kAvx2 = {Isa::AVX2, dot_avx2, l2_sq_avx2, norms_avx2<false>, norms_avx2<true>, dot_block_avx2,
+                       dot_i8_avx2, adc_scan_avx2, hamming_scan_avx2};
+// 汉明距离沿用 AVX2 实现：768维的码为96字节，正好3次256位加载，512位加载要掩码且横向求和更慢
+const Kernels kAvx512 = {Isa::AVX512, dot_avx512, l2_sq_avx512, norms_avx512<false>, norms_avx512<true>,
+                         dot_block_avx512, dot_i8_avx512, adc_scan_avx512, hamming_scan_avx2};
+#endif
+
+Isa detect_isa() {
+#ifdef RAG_DISTANCE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) return Isa::AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return Isa::AVX2;
+#endif
+    return Isa::SCALAR;
+}
+
+const Kernels* kernels_for(Isa isa) {
+#ifdef RAG_DISTANCE_X86
+    if (isa == Isa::AVX512) return &kAvx512;
+    if (isa == Isa::AVX2) return &kAvx2;
+#endif
+    return &kScalar;
+}
+
+const Isa g_best_isa = detect_isa();
+std::atomic<const Kernels*> g_kernels{kernels_for(g_best_isa)};
+
+inline const Kernels& kernels() {
+    return *g_kernels.load(std::memory_order_relaxed);
+}
+
+} // namespace
+
+float dot(const float* a, const float* b, size_t n) {
+    return kernels().dot(a, b, n);
+}
+
+float l2_sq(const float* a, const float* b, size_t n) {
+    return kernels().l2_sq(a, b, n);
+}
+
+float cosine(const float* a, const float* b, size_t n) {
+    float ab, aa, bb;
+    kernels().dot_norms(a, b, n, &ab, &aa, &bb);
+    if (aa <= 0.0f || bb <= 0.0f) return 0.0f;
+    return ab / std::sqrt(aa * bb);
+}
+
+void dot_norm(const float* a, const float* b, size_t n, float* ab, float* bb) {
+    kernels().dot_norm(a, b, n, ab, nullptr, bb);
+}
+
+void dot_block(const float* a, size_t na, size_t a_stride, const float* b, size_t nb, size_t b_stride, size_t n,
+               float* out) {
+    kernels().dot_block(a, na, a_stride, b, nb, b_stride, n, out);
+}
+
+int32_t dot_i8(const int8_t* a, const int8_t* b, size_t n) {
+    return kernels().dot_i8(a, b, n);
+}
+
+void adc_scan(const float* lut, size_t m, size_t nbits, const uint8_t* codes, size_t code_size, size_t blocks,
+              float* out) {
+    kernels().adc_scan(lut, m, nbits, codes, code_size, blocks, out);
+}
+
+void hamming_scan(const uint8_t* query, const uint8_t* codes, size_t bytes, size_t n, uint32_t* out) {
+    kernels().hamming_scan(query, codes, bytes, n, out);
+}
+
+Isa isa() {
+    return kernels().isa;
+}
+
+Isa best_isa() {
+    return g_best_isa;
+}
+
+void set_isa(Isa isa) {
+    if (static_cast<int>(isa) > static_cast<int>(g_best_isa)) isa = g_best_isa;
+    g_kernels.store(kernels_for(isa), std::memory_order_relaxed);
+}
+
+const char* isa_name(Isa isa) {
+    switch (isa) {
+        case Isa::AVX512: return "avx512";
+        case Isa::AVX2: return "avx2";
+        case Isa::SCALAR:
+        default: return "scalar";
+    }
+}
+
+} // namespace distance
+} // namespace rag
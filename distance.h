@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace rag {
+
+// 向量距离内核：float32 的内积、L2 距离平方、余弦相似度，以及量化向量用的 int8 内积、乘积量化查表与二值码汉明距离
+// 运行时检测CPU，按 AVX-512（F+BW） > AVX2+FMA > 标量 的顺序选择实现
+// 输入不要求对齐，n 可以为任意长度
+namespace distance {
+
+enum class Isa { SCALAR, AVX2, AVX512 };
+
+// Σ a[i] * b[i]
+float dot(const float* a, const float* b, size_t n);
+
+// Σ (a[i] - b[i])²
+float l2_sq(const float* a, const float* b, size_t n);
+
+// 余弦相似度，任一向量为零向量时返回 0
+float cosine(const float* a, const float* b, size_t n);
+
+// 一次遍历同时计算 a·b 与 b·b：查询向量的模长只需计算一次，逐行比较时用它省去一半的访存
+void dot_norm(const float* a, const float* b, size_t n, float* ab, float* bb);
+
+// 分块内积：out[i * nb + j] = a_i · b_j，a_i = a + i * a_stride，b_j = b + j * b_stride（跨度以 float 计）
+// 多条 a 行与多条 b 行在寄存器中组成小块（AVX2 为 4×2，AVX-512 为 4×4），每次加载的分量参与多次乘加，
+// 调用方把 a、b 都切成能放进缓存的块时，每条 b 行从内存读一次即可与整块 a 行计算
+void dot_block(const float* a, size_t na, size_t a_stride, const float* b, size_t nb, size_t b_stride, size_t n,
+               float* out);
+
+// int8 内积，分量须在 [-127, 127] 内（SIMD 实现把两对乘积按16位累加，-128 可能溢出）
+int32_t dot_i8(const int8_t* a, const int8_t* b, size_t n);
+
+// 乘积量化的非对称距离（ADC）查表：out[i] = Σ_j lut[j * 2^nbits + code_j(i)]，j < m，nbits 取 1~8
+// 每行的码占 code_size 字节，第 j 个子码为从第 j * nbits 位开始的 nbits 位（低位在前）；
+// 码按 kAdcBlock 行一块转置存放：块内第 r 行的第 k 字节位于 k * kAdcBlock + r，同一子码的16行连续，
+// 一次加载即可得到整块的查表索引。blocks 为块数，out 须能容纳 blocks * kAdcBlock 个结果
+constexpr size_t kAdcBlock = 16;
+void adc_scan(const float* lut, size_t m, size_t nbits, const uint8_t* codes, size_t code_size, size_t blocks,
+              float* out);
+
+// 汉明距离扫描：out[i] = popcount(query xor codes[i])，codes 为 n 行连续存放的二值码，每行 bytes 字节（8的倍数）
+void hamming_scan(const uint8_t* query, const uint8_t* codes, size_t bytes, size_t n, uint32_t* out);
+
+// 当前使用的实现；set_isa 用于对比测试，超出CPU支持范围时降级为支持的最高实现
+Isa isa();
+Isa best_isa();
+void set_isa(Isa isa);
+const char* isa_name(Isa isa);
+
+} // namespace distance
+
+} // namespace rag
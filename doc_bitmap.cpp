@@ -0,0 +1,258 @@
+#include "doc_bitmap.h"
+#include <algorithm>
+#include <iterator>
+
+namespace rag {
+
+bool DocBitmap::Container::contains(uint16_t low) const {
+    if (bits.empty()) return std::binary_search(array.begin(), array.end(), low);
+    return (bits[low >> 6] >> (low & 63)) & 1;
+}
+
+void DocBitmap::Container::add(uint16_t low) {
+    if (!bits.empty()) {
+        uint64_t mask = uint64_t(1) << (low & 63);
+        if (!(bits[low >> 6] & mask)) {
+            bits[low >> 6] |= mask;
+            ++cardinality;
+        }
+        return;
+    }
+    if (array.empty() || array.back() < low) {
+        array.push_back(low);
+    } else {
+        auto it = std::lower_bound(array.begin(), array.end(), low);
+        if (*it == low) return;
+        array.insert(it, low);
+    }
+    ++cardinality;
+    if (array.size() > kArrayMax) to_bitset();
+}
+
+int32_t DocBitmap::Container::next(uint32_t low) const {
+    if (low > 0xFFFF) return -1;
+    if (bits.empty()) {
+        auto it = std::lower_bound(array.begin(), array.end(), static_cast<uint16_t>(low));
+        return it == array.end() ? -1 : *it;
+    }
+    size_t w = low >> 6;
+    uint64_t word = bits[w] & (~uint64_t(0) << (low & 63));
+    while (true) {
+        if (word) return static_cast<int32_t>(w * 64 + __builtin_ctzll(word));
+        if (++w == kWords) return -1;
+        word = bits[w];
+    }
+}
+
+void DocBitmap::Container::to_bitset() {
+    bits.assign(kWords, 0);
+    for (uint16_t low : array) bits[low >> 6] |= uint64_t(1) << (low & 63);
+    std::vector<uint16_t>().swap(array);
+}
+
+void DocBitmap::Container::normalize() {
+    if (bits.empty() || cardinality > kArrayMax) return;
+    array.reserve(cardinality);
+    for (size_t w = 0; w < kWords; ++w) {
+        for (uint64_t word = bits[w]; word; word &= word - 1) {
+            array.push_back(static_cast<uint16_t>(w * 64 + __builtin_ctzll(word)));
+        }
+    }
+    std::vector<uint64_t>().swap(bits);
+}
+
+DocBitmap DocBitmap::all(uint32_t n) {
+    DocBitmap result;
+    for (uint64_t begin = 0; begin < n; begin += 65536) {
+        Container c;
+        c.key = static_cast<uint16_t>(begin >> 16);
+        uint32_t count = static_cast<uint32_t>(std::min<uint64_t>(n - begin, 65536));
+        c.bits.assign(kWords, 0);
+        for (size_t w = 0; w < count / 64; ++w) c.bits[w] = ~uint64_t(0);
+        if (count % 64) c.bits[count / 64] = (uint64_t(1) << (count % 64)) - 1;
+        c.cardinality = count;
+        c.normalize();
+        result.containers_.push_back(std::move(c));
+    }
+    return result;
+}
+
+size_t DocBitmap::cardinality() const {
+    size_t n = 0;
+    for (const auto &c : containers_) n += c.cardinality;
+    return n;
+}
+
+size_t DocBitmap::lower_bound(uint16_t key) const {
+    // 文档下标通常是稠密的，容器下标往往就等于 key
+    if (key < containers_.size() && containers_[key].key == key) return key;
+    return std::lower_bound(containers_.begin(), containers_.end(), key,
+                            [](const Container& c, uint16_t k) { return c.key < k; }) - containers_.begin();
+}
+
+const DocBitmap::Container* DocBitmap::find(uint16_t key) const {
+    size_t i = lower_bound(key);
+    return i < containers_.size() && containers_[i].key == key ? &containers_[i] : nullptr;
+}
+
+void DocBitmap::add(uint32_t doc) {
+    uint16_t key = static_cast<uint16_t>(doc >> 16);
+    if (containers_.empty() || containers_.back().key < key) {
+        containers_.emplace_back();
+        containers_.back().key = key;
+        containers_.back().add(static_cast<uint16_t>(doc));
+        return;
+    }
+    size_t i = containers_.back().key == key ? containers_.size() - 1 : lower_bound(key);
+    if (containers_[i].key != key) {
+        containers_.insert(containers_.begin() + i, Container());
+        containers_[i].key = key;
+    }
+    containers_[i].add(static_cast<uint16_t>(doc));
+}
+
+bool DocBitmap::contains(uint32_t doc) const {
+    const Container* c = find(static_cast<uint16_t>(doc >> 16));
+    return c && c->contains(static_cast<uint16_t>(doc));
+}
+
+uint32_t DocBitmap::next(uint32_t doc) const {
+    if (doc == kEnd) return kEnd;
+    uint16_t key = static_cast<uint16_t>(doc >> 16);
+    uint32_t low = doc & 0xFFFF;
+    for (size_t i = lower_bound(key); i < containers_.size(); ++i) {
+        const auto &c = containers_[i];
+        if (c.key != key) low = 0;  // 后面的容器从头开始
+        int32_t found = c.next(low);
+        if (found >= 0) return (static_cast<uint32_t>(c.key) << 16) | static_cast<uint32_t>(found);
+    }
+    return kEnd;
+}
+
+DocBitmap DocBitmap::operator&(const DocBitmap& other) const {
+    DocBitmap result;
+    size_t i = 0, j = 0;
+    while (i < containers_.size() && j < other.containers_.size()) {
+        const auto &a = containers_[i];
+        const auto &b = other.containers_[j];
+        if (a.key < b.key) { ++i; continue; }
+        if (b.key < a.key) { ++j; continue; }
+
+        Container c;
+        c.key = a.key;
+        if (a.bits.empty() && b.bits.empty()) {
+            std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                                  std::back_inserter(c.array));
+            c.cardinality = static_cast<uint32_t>(c.array.size());
+        } else if (a.bits.empty() || b.bits.empty()) {
+            const auto &arr = a.bits.empty() ? a : b;
+            const auto &set = a.bits.empty() ? b : a;
+            for (uint16_t low : arr.array) {
+                if (set.contains(low)) c.array.push_back(low);
+            }
+            c.cardinality = static_cast<uint32_t>(c.array.size());
+        } else {
+            c.bits.resize(kWords);
+            for (size_t w = 0; w < kWords; ++w) {
+                c.bits[w] = a.bits[w] & b.bits[w];
+                c.cardinality += static_cast<uint32_t>(__builtin_popcountll(c.bits[w]));
+            }
+            c.normalize();
+        }
+        if (c.cardinality > 0) result.containers_.push_back(std::move(c));
+        ++i;
+        ++j;
+    }
+    return result;
+}
+
+DocBitmap DocBitmap::operator|(const DocBitmap& other) const {
+    DocBitmap result;
+    size_t i = 0, j = 0;
+    while (i < containers_.size() || j < other.containers_.size()) {
+        if (j == other.containers_.size() || (i < containers_.size() && containers_[i].key < other.containers_[j].key)) {
+            result.containers_.push_back(containers_[i++]);
+            continue;
+        }
+        if (i == containers_.size() || other.containers_[j].key < containers_[i].key) {
+            result.containers_.push_back(other.containers_[j++]);
+            continue;
+        }
+
+        const auto &a = containers_[i++];
+        const auto &b = other.containers_[j++];
+        Container c;
+        c.key = a.key;
+        if (a.bits.empty() && b.bits.empty()) {
+            std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                           std::back_inserter(c.array));
+            c.cardinality = static_cast<uint32_t>(c.array.size());
+            if (c.array.size() > kArrayMax) c.to_bitset();
+        } else {
+            c.bits.assign(kWords, 0);
+            for (const Container* src : {&a, &b}) {
+                if (src->bits.empty()) {
+                    for (uint16_t low : src->array) c.bits[low >> 6] |= uint64_t(1) << (low & 63);
+                } else {
+                    for (size_t w = 0; w < kWords; ++w) c.bits[w] |= src->bits[w];
+                }
+            }
+            for (uint64_t word : c.bits) c.cardinality += static_cast<uint32_t>(__builtin_popcountll(word));
+        }
+        result.containers_.push_back(std::move(c));
+    }
+    return result;
+}
+
+DocBitmap DocBitmap::and_not(const DocBitmap& other) const {
+    DocBitmap result;
+    for (const auto &a : containers_) {
+        const Container* b = other.find(a.key);
+        if (!b) {
+            result.containers_.push_back(a);
+            continue;
+        }
+
+        Container c;
+        c.key = a.key;
+        if (a.bits.empty()) {
+            if (b->bits.empty()) {
+                std::set_difference(a.array.begin(), a.array.end(), b->array.begin(), b->array.end(),
+                                    std::back_inserter(c.array));
+            } else {
+                for (uint16_t low : a.array) {
+                    if (!b->contains(low)) c.array.push_back(low);
+                }
+            }
+            c.cardinality = static_cast<uint32_t>(c.array.size());
+        } else {
+            c.bits = a.bits;
+            if (b->bits.empty()) {
+                for (uint16_t low : b->array) c.bits[low >> 6] &= ~(uint64_t(1) << (low & 63));
+            } else {
+                for (size_t w = 0; w < kWords; ++w) c.bits[w] &= ~b->bits[w];
+            }
+            for (uint64_t word : c.bits) c.cardinality += static_cast<uint32_t>(__builtin_popcountll(word));
+            c.normalize();
+        }
+        if (c.cardinality > 0) result.containers_.push_back(std::move(c));
+    }
+    return result;
+}
+
+std::vector<uint32_t> DocBitmap::to_vector() const {
+    std::vector<uint32_t> out;
+    out.reserve(cardinality());
+    for_each([&](uint32_t doc) { out.push_back(doc); });
+    return out;
+}
+
+size_t DocBitmap::memory_usage() const {
+    size_t bytes = containers_.capacity() * sizeof(Container);
+    for (const auto &c : containers_) {
+        bytes += c.array.capacity() * sizeof(uint16_t) + c.bits.capacity() * sizeof(uint64_t);
+    }
+    return bytes;
+}
+
+} // namespace rag
@@ -0,0 +1,84 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace rag {
+
+// 文档下标集合（roaring 风格的压缩位图）
+// 下标按高16位分成容器，每个容器保存低16位：
+//   元素不超过 kArrayMax 个时为有序的 uint16 数组，超过时转为 65536 位的位图
+// 稀疏集合按数组存放，稠密集合按位图存放，集合运算按容器逐对进行
+// 非线程安全；构建完成后只读访问可以并发
+class DocBitmap {
+public:
+    static constexpr uint32_t kEnd = std::numeric_limits<uint32_t>::max();
+
+    // [0, n) 的全部下标
+    static DocBitmap all(uint32_t n);
+
+    bool empty() const { return containers_.empty(); }
+    size_t cardinality() const;
+
+    // 加入一个下标，按升序加入时为均摊 O(1)
+    void add(uint32_t doc);
+    bool contains(uint32_t doc) const;
+
+    // 第一个 >= doc 的下标，不存在时返回 kEnd
+    uint32_t next(uint32_t doc) const;
+
+    void clear() { containers_.clear(); }
+
+    // 集合运算
+    DocBitmap operator&(const DocBitmap& other) const;
+    DocBitmap operator|(const DocBitmap& other) const;
+    DocBitmap and_not(const DocBitmap& other) const;
+
+    // 按升序遍历
+    template <typename F>
+    void for_each(F&& f) const {
+        for (const auto &c : containers_) {
+            uint32_t base = static_cast<uint32_t>(c.key) << 16;
+            if (c.bits.empty()) {
+                for (uint16_t low : c.array) f(base | low);
+            } else {
+                for (size_t w = 0; w < kWords; ++w) {
+                    for (uint64_t word = c.bits[w]; word; word &= word - 1) {
+                        f(base | static_cast<uint32_t>(w * 64 + __builtin_ctzll(word)));
+                    }
+                }
+            }
+        }
+    }
+
+    std::vector<uint32_t> to_vector() const;
+
+    size_t memory_usage() const;
+
+private:
+    static constexpr size_t kArrayMax = 4096;   // 数组容器的元素上限，超过后位图更省空间
+    static constexpr size_t kWords = 1024;      // 位图容器的 64 位字数
+
+    struct Container {
+        uint16_t key = 0;                 // 下标的高16位
+        uint32_t cardinality = 0;
+        std::vector<uint16_t> array;      // 数组容器：升序的低16位（位图容器时为空）
+        std::vector<uint64_t> bits;       // 位图容器（数组容器时为空）
+
+        bool contains(uint16_t low) const;
+        void add(uint16_t low);
+        // 第一个 >= low 的低16位，不存在时返回 -1
+        int32_t next(uint32_t low) const;
+        void to_bitset();
+        void normalize();                 // 元素数降到 kArrayMax 以下时转回数组
+    };
+
+    // 高16位为 key 的容器，不存在返回 nullptr
+    const Container* find(uint16_t key) const;
+    size_t lower_bound(uint16_t key) const;
+
+    std::vector<Container> containers_;   // 按 key 升序
+};
+
+} // namespace rag
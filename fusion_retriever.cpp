@@ -1,133 +1,16 @@
 #include "fusion_retriever.h"
+#include "top_k.h"
+#include "vector_store.h"
 #include <algorithm>
+#include <numeric>
 #include <unordered_map>
 #include <set>
 #include <sstream>
+#include <iostream>
 #include <cmath>  // 添加数学函数
-
-// 包含具体的实现头文件
-namespace humanus {
-    // 简单的mock类，避免依赖复杂的humanus框架
-    enum class EmbeddingType { DOCUMENT, QUERY };
-
-    struct VectorStoreConfig {
-        int vector_dim = 768;
-        int max_elements = 10000;
-        int ef_construction = 200;
-        int M = 16;
-    };
-
-    struct EmbeddingModelConfig {
-        std::string provider = "tfidf";
-    };
-
-    struct MemoryItem {
-        size_t id;
-        std::string content;
-        std::unordered_map<std::string, std::string> metadata;
-        double similarity = 0.0;
-    };
-
-    class VectorStore {
-    public:
-        virtual ~VectorStore() = default;
-        virtual void reset() = 0;
-        virtual void insert(const std::vector<float>& vector, size_t vector_id, const MemoryItem& metadata) = 0;
-        virtual std::vector<MemoryItem> search(const std::vector<float>& query, size_t limit) = 0;
-    };
-
-    class EmbeddingModel {
-    public:
-        virtual ~EmbeddingModel() = default;
-        virtual std::vector<float> embed(const std::string& text, EmbeddingType type) = 0;
-        static std::shared_ptr<EmbeddingModel> get_instance(const std::string& name, std::shared_ptr<EmbeddingModelConfig> config);
-    };
-
-    // 简单的mock实现
-    class MockVectorStore : public VectorStore {
-    private:
-        std::vector<std::pair<std::vector<float>, MemoryItem>> data_;
-
-    public:
-        void reset() override { data_.clear(); }
-
-        void insert(const std::vector<float>& vector, size_t vector_id, const MemoryItem& metadata) override {
-            data_.emplace_back(vector, metadata);
-        }
-
-        std::vector<MemoryItem> search(const std::vector<float>& query, size_t limit) override {
-            std::vector<std::pair<double, MemoryItem>> scored_results;
-
-            for (const auto& item : data_) {
-                // 简单的余弦相似度计算
-                double dot_product = 0.0;
-                double norm_query = 0.0;
-                double norm_doc = 0.0;
-
-                for (size_t i = 0; i < std::min(query.size(), item.first.size()); ++i) {
-                    dot_product += query[i] * item.first[i];
-                    norm_query += query[i] * query[i];
-                    norm_doc += item.first[i] * item.first[i];
-                }
-
-                double similarity = 0.0;
-                if (norm_query > 0 && norm_doc > 0) {
-                    similarity = dot_product / (std::sqrt(norm_query) * std::sqrt(norm_doc));
-                }
-
-                auto memory_item = item.second;
-                memory_item.similarity = similarity;
-                scored_results.emplace_back(similarity, memory_item);
-            }
-
-            // 按相似度排序
-            std::sort(scored_results.begin(), scored_results.end(),
-                     [](const auto& a, const auto& b) { return a.first > b.first; });
-
-            std::vector<MemoryItem> results;
-            for (size_t i = 0; i < std::min(limit, scored_results.size()); ++i) {
-                results.push_back(scored_results[i].second);
-            }
-
-            return results;
-        }
-    };
-
-    class MockEmbeddingModel : public EmbeddingModel {
-    public:
-        std::vector<float> embed(const std::string& text, EmbeddingType type) override {
-            // 简单的TF-IDF式embedding
-            std::vector<float> embedding(768, 0.0f);
-
-            // 基于文本hash生成特征向量
-            std::hash<std::string> hasher;
-            auto hash_val = hasher(text);
-
-            for (size_t i = 0; i < embedding.size(); ++i) {
-                embedding[i] = static_cast<float>((hash_val + i) % 1000) / 1000.0f;
-            }
-
-            // 归一化
-            float norm = 0.0f;
-            for (float val : embedding) {
-                norm += val * val;
-            }
-            norm = std::sqrt(norm);
-
-            if (norm > 0) {
-                for (float& val : embedding) {
-                    val /= norm;
-                }
-            }
-
-            return embedding;
-        }
-    };
-
-    std::shared_ptr<EmbeddingModel> EmbeddingModel::get_instance(const std::string& name, std::shared_ptr<EmbeddingModelConfig> config) {
-        return std::make_shared<MockEmbeddingModel>();
-    }
-}
+#include <mutex>
+#include <shared_mutex>
+#include <typeinfo>
 
 namespace rag {
 
@@ -136,10 +19,16 @@ FusionRetriever::FusionRetriever(const FusionRetrieverConfig& config,
                                std::shared_ptr<humanus::EmbeddingModel> embedding_model)
     : config_(config), vector_store_(vector_store), embedding_model_(embedding_model) {
 
-    // 如果没有提供vector_store，创建默认的Mock实现
+    if (config_.threadpool.num_workers > 1) {
+        thread_pool_ = std::make_shared<ThreadPool>(config_.threadpool);
+    }
+    bm25_indexer_ = make_bm25_indexer();
+
+    // 如果没有提供vector_store，按配置创建；之后重建时沿用它的类型与参数
     if (!vector_store_) {
-        vector_store_ = std::make_shared<humanus::MockVectorStore>();
+        vector_store_ = humanus::VectorStore::create(config_.vector, config_.hnsw, config_.ivf_pq);
     }
+    if (thread_pool_) vector_store_->set_thread_pool(thread_pool_);
 
     // 如果没有提供embedding_model，创建Mock模型
     if (!embedding_model_) {
@@ -152,60 +41,249 @@ FusionRetriever::FusionRetriever(const FusionRetrieverConfig& config,
 std::shared_ptr<FusionRetriever> FusionRetriever::from_config(const RAGConfig& config) {
     auto fusion_config = FusionRetrieverConfig::from_rag_config(config);
 
-    // 创建mock vector store和embedding model
-    auto vector_store = std::make_shared<humanus::MockVectorStore>();
+    // 按配置创建向量索引，embedding使用mock模型
+    auto vector_store = humanus::VectorStore::create(fusion_config.vector, fusion_config.hnsw, fusion_config.ivf_pq);
     auto embedding_model = humanus::EmbeddingModel::get_instance("fusion_tfidf", nullptr);
 
     return std::make_shared<FusionRetriever>(fusion_config, vector_store, embedding_model);
 }
 
+std::shared_ptr<BM25Indexer> FusionRetriever::make_bm25_indexer() const {
+    auto indexer = std::make_shared<BM25Indexer>(config_.bm25);
+    if (thread_pool_) indexer->set_thread_pool(thread_pool_);
+    return indexer;
+}
+
+std::shared_ptr<humanus::VectorStore> FusionRetriever::make_vector_store() const {
+    // 与当前索引同类型、同参数，构造时注入的索引不会被按配置创建的索引替换；
+    // 派生类没有覆盖 clone_empty() 时得到的是基类对象，按不支持处理
+    auto store = vector_store_->clone_empty();
+    if (!store || typeid(*store) != typeid(*vector_store_)) return nullptr;
+    if (thread_pool_) store->set_thread_pool(thread_pool_);
+    return store;
+}
+
 void FusionRetriever::fit(const std::vector<Chunk>& chunks) {
-    chunks_ = chunks;
+    std::lock_guard<std::mutex> writer(write_mutex_);
 
-    // 构建BM25索引
-    bm25_indexer_ = std::make_shared<BM25Indexer>(BM25Config());
-    bm25_indexer_->fit(chunks);
+    // BM25、向量索引与chunk存储都在新对象中建好，最后在写锁下一起替换，期间查询使用旧的三者
+    std::vector<std::vector<float>> embeddings;
+    embeddings.reserve(chunks.size());
+    for (const auto& chunk : chunks) {
+        embeddings.push_back(embedding_model_->embed(chunk.text, humanus::EmbeddingType::DOCUMENT));
+    }
 
-    // 构建向量索引
-    vector_store_->reset();
-    doc_to_vector_id_.clear();
+    auto bm25 = make_bm25_indexer();
+    bm25->fit(chunks);
 
+    // 批量插入向量存储（HNSW 在线程池上并行建图）：chunk 文本与元数据由 chunks_ 保存，向量存储只需要ID
+    auto vectors = make_vector_store();
+    std::vector<size_t> ids(chunks.size());
+    std::iota(ids.begin(), ids.end(), size_t(0));
+    if (vectors) {
+        vectors->reserve(chunks.size());
+        vectors->insert_batch(embeddings, ids);
+    }
+
+    ChunkStore store;
+    store.assign(chunks);
+    MetadataIndex metadata;
     for (size_t i = 0; i < chunks.size(); ++i) {
         const auto& chunk = chunks[i];
+        metadata.add(static_cast<uint32_t>(i), chunk.topic, chunk.language, chunk.doc_id, chunk.created_at);
+    }
 
-        // 生成embedding
-        auto embedding = embedding_model_->embed(chunk.text, humanus::EmbeddingType::DOCUMENT);
+    // 旧索引在锁外析构
+    std::unique_lock<std::shared_mutex> lock(chunks_mutex_);
+    std::swap(bm25_indexer_, bm25);
+    if (vectors) {
+        std::swap(vector_store_, vectors);
+    } else {
+        // 不支持 clone_empty() 的自定义索引只能原地重建，期间检索被阻塞
+        vector_store_->reset();
+        vector_store_->reserve(chunks.size());
+        vector_store_->insert_batch(embeddings, ids);
+    }
+    chunks_ = std::move(store);
+    metadata_ = std::move(metadata);
+    lock.unlock();
+}
+
+bool FusionRetriever::add_documents(const std::vector<Chunk>& chunks) {
+    if (chunks.empty()) return true;
+
+    // embedding 计算不持有任何锁
+    std::vector<std::vector<float>> embeddings;
+    embeddings.reserve(chunks.size());
+    for (const auto& chunk : chunks) {
+        embeddings.push_back(embedding_model_->embed(chunk.text, humanus::EmbeddingType::DOCUMENT));
+    }
+
+    std::lock_guard<std::mutex> writer(write_mutex_);
+
+    // BM25与向量存储先分配下标（写操作已串行，chunks_ 的大小不会变）；chunks_ 追加之前
+    // 查到的新下标会被 resolve_bm25 / vector_retrieve 的越界检查过滤，建图期间检索不被阻塞
+    // 两者的下标已经不一致时拒绝写入，否则之后的BM25结果都会对应到错误的chunk
+    size_t base = chunks_.size();
+    size_t first = bm25_indexer_->allocated_documents();
+    if (first != base) {
+        std::cerr << "FusionRetriever: BM25 document index out of sync ("
+                  << first << " vs " << base << "), documents not added" << std::endl;
+        return false;
+    }
+    bm25_indexer_->add_documents(chunks);
+    std::vector<size_t> ids(chunks.size());
+    std::iota(ids.begin(), ids.end(), base);
+    vector_store_->insert_batch(embeddings, ids);
+
+    std::unique_lock<std::shared_mutex> lock(chunks_mutex_);
+    for (size_t j = 0; j < chunks.size(); ++j) {
+        size_t i = chunks_.size();
+        const auto& chunk = chunks[j];
+
+        chunks_.push_back(chunk);
+        metadata_.add(static_cast<uint32_t>(i), chunk.topic, chunk.language, chunk.doc_id, chunk.created_at);
+    }
+    return true;
+}
+
+size_t FusionRetriever::remove_document(const std::string& doc_id) {
+    std::lock_guard<std::mutex> writer(write_mutex_);
 
-        // 插入向量存储
-        humanus::MemoryItem memory_item;
-        memory_item.id = i;
-        memory_item.content = chunk.text;
-        memory_item.metadata["doc_id"] = chunk.doc_id;
-        memory_item.metadata["seq_no"] = std::to_string(chunk.seq_no);
+    auto removed = bm25_indexer_->remove_document(doc_id);
 
-        vector_store_->insert(embedding, i, memory_item);
-        doc_to_vector_id_[get_doc_key(chunk.doc_id, chunk.seq_no)] = i;
+    // 向量存储打墓碑在 chunks_mutex_ 之外进行（写操作已串行），没有线程池时 HNSW 整理在调用线程中运行，不阻塞检索；
+    // 不支持删除的向量索引仍按chunk存储的删除标记在检索结果中过滤
+    for (size_t i : removed) vector_store_->remove(i);
+
+    std::unique_lock<std::shared_mutex> lock(chunks_mutex_);
+    for (size_t i : removed) {
+        if (i < chunks_.size()) chunks_.remove(i);
     }
+    return removed.size();
+}
+
+bool FusionRetriever::save_snapshot(const std::string& path) {
+    // 与写操作串行，三部分来自同一时刻的状态
+    std::lock_guard<std::mutex> writer_guard(write_mutex_);
+
+    SnapshotWriter writer(path);
+    if (!writer.ok()) return false;
+
+    {
+        std::shared_lock<std::shared_mutex> lock(chunks_mutex_);
+        writer.begin_section(SnapshotSection::CHUNKS);
+        chunks_.save_snapshot(writer);
+        writer.end_section();
+    }
+
+    writer.begin_section(SnapshotSection::BM25);
+    bm25_indexer_->save_snapshot(writer);
+    writer.end_section();
+
+    // 向量段以索引类型开头，打开时先比对类型再交给索引解析
+    writer.begin_section(SnapshotSection::VECTORS);
+    writer.write<uint32_t>(static_cast<uint32_t>(vector_store_->kind()));
+    if (!vector_store_->save_snapshot(writer)) {
+        std::cerr << "FusionRetriever: vector store does not support snapshots" << std::endl;
+        return false;
+    }
+    writer.end_section();
+
+    return writer.finish();
+}
+
+bool FusionRetriever::open_snapshot(const std::string& path) {
+    std::lock_guard<std::mutex> writer(write_mutex_);
+
+    SnapshotReader reader;
+    if (!reader.open(path)) return false;
+    for (auto tag : {SnapshotSection::CHUNKS, SnapshotSection::BM25, SnapshotSection::VECTORS}) {
+        if (!reader.has_section(tag)) {
+            std::cerr << "FusionRetriever: snapshot " << path << " is missing section "
+                      << static_cast<uint32_t>(tag) << std::endl;
+            return false;
+        }
+    }
+
+    // 三部分都加载到新对象，全部成功后再一起替换；任何一部分失败时当前内容不变
+    ChunkStore chunks;
+    auto chunk_section = reader.section(SnapshotSection::CHUNKS);
+    if (!chunks.load_snapshot(chunk_section)) return false;
+
+    auto bm25 = make_bm25_indexer();
+    auto bm25_section = reader.section(SnapshotSection::BM25);
+    if (!bm25->load_snapshot(bm25_section)) return false;
+
+    auto vectors = make_vector_store();
+    if (!vectors) {
+        std::cerr << "FusionRetriever: vector store does not support clone_empty(), cannot open " << path << std::endl;
+        return false;
+    }
+    auto vector_section = reader.section(SnapshotSection::VECTORS);
+    uint32_t kind = 0;
+    if (!vector_section.read(kind)) {
+        std::cerr << "FusionRetriever: corrupt vector section in " << path << std::endl;
+        return false;
+    }
+    if (kind != static_cast<uint32_t>(vectors->kind())) {
+        std::cerr << "FusionRetriever: snapshot " << path << " holds a "
+                  << humanus::vector_index_kind_name(static_cast<humanus::VectorIndexKind>(kind))
+                  << " vector index, current index is " << humanus::vector_index_kind_name(vectors->kind()) << std::endl;
+        return false;
+    }
+    if (!vectors->load_snapshot(vector_section)) {
+        std::cerr << "FusionRetriever: cannot load vectors from " << path << std::endl;
+        return false;
+    }
+
+    // 元数据位图不随快照保存，按chunk存储的列重建
+    MetadataIndex metadata;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        metadata.add(static_cast<uint32_t>(i), chunks.topic(i), chunks.language(i), chunks.doc_id(i), chunks.created_at(i));
+    }
+
+    // 旧索引在锁外析构
+    std::unique_lock<std::shared_mutex> lock(chunks_mutex_);
+    std::swap(bm25_indexer_, bm25);
+    std::swap(vector_store_, vectors);
+    chunks_ = std::move(chunks);
+    metadata_ = std::move(metadata);
+    lock.unlock();
+    return true;
 }
 
 std::vector<RetrievalResult> FusionRetriever::query(const std::string& query_text, int top_k) {
+    return query(query_text, MetadataFilter(), top_k);
+}
+
+std::vector<RetrievalResult> FusionRetriever::query(const std::string& query_text, const MetadataFilter& filter, int top_k) {
+    // 过滤条件求值为位图，两路检索共用；之后追加的chunk不在位图中，不会被返回
+    DocBitmap bitmap;
+    const DocBitmap* docs = nullptr;
+    if (!filter.empty()) {
+        std::shared_lock<std::shared_mutex> lock(chunks_mutex_);
+        bitmap = metadata_.evaluate(filter);
+        docs = &bitmap;
+    }
+
     switch (config_.strategy) {
         case FusionStrategy::BM25_ONLY:
-            return bm25_retrieve(query_text, top_k);
+            return bm25_retrieve(query_text, top_k, docs);
 
         case FusionStrategy::VECTOR_ONLY:
-            return vector_retrieve(query_text, top_k);
+            return vector_retrieve(query_text, top_k, docs);
 
         case FusionStrategy::HYBRID:
         case FusionStrategy::RRF:
         case FusionStrategy::WEIGHTED: {
             // 并行检索
-            auto bm25_future = std::async(std::launch::async, [this, query_text, top_k]() {
-                return bm25_retrieve(query_text, config_.max_candidates);
+            auto bm25_future = std::async(std::launch::async, [this, query_text, docs]() {
+                return bm25_retrieve(query_text, config_.max_candidates, docs);
             });
 
-            auto vector_future = std::async(std::launch::async, [this, query_text, top_k]() {
-                return vector_retrieve(query_text, config_.max_candidates);
+            auto vector_future = std::async(std::launch::async, [this, query_text, docs]() {
+                return vector_retrieve(query_text, config_.max_candidates, docs);
             });
 
             auto bm25_results = bm25_future.get();
@@ -224,53 +302,63 @@ std::future<std::vector<RetrievalResult>> FusionRetriever::query_async(const std
     });
 }
 
-std::vector<RetrievalResult> FusionRetriever::bm25_retrieve(const std::string& query_text, int top_k) {
+std::vector<RetrievalResult> FusionRetriever::bm25_retrieve(const std::string& query_text, int top_k, const DocBitmap* filter) {
+    // 检索与下标解析在同一把共享锁下：fit / open_snapshot 替换索引时，下标不会对到另一份chunks上
+    std::shared_lock<std::shared_mutex> lock(chunks_mutex_);
     if (!bm25_indexer_) {
         return {};
     }
 
-    // 简单的查询分词
-    std::vector<std::string> terms;
-    std::istringstream iss(query_text);
-    std::string term;
-    while (iss >> term) {
-        terms.push_back(term);
-    }
+    // 与建索引使用同一个tokenizer，直接得到词项ID
+    return resolve_bm25(bm25_indexer_->query_text(query_text, top_k, Language::AUTO, filter));
+}
 
-    auto bm25_scores = bm25_indexer_->query(terms, top_k);
+std::vector<RetrievalResult> FusionRetriever::query_phrase(const std::string& phrase, int top_k, uint32_t slop) {
+    std::shared_lock<std::shared_mutex> lock(chunks_mutex_);
+    if (!bm25_indexer_ || top_k <= 0) {
+        return {};
+    }
+    return resolve_bm25(bm25_indexer_->query_phrase_text(phrase, top_k, slop));
+}
 
+std::vector<RetrievalResult> FusionRetriever::resolve_bm25(const std::vector<std::pair<size_t, double>>& scores) {
     std::vector<RetrievalResult> results;
-    for (const auto& score_pair : bm25_scores) {
+    for (const auto& score_pair : scores) {
         size_t chunk_idx = score_pair.first;
         double score = score_pair.second;
 
         if (chunk_idx < chunks_.size()) {
-            const auto& chunk = chunks_[chunk_idx];
-            results.emplace_back(chunk.doc_id, chunk.seq_no, score, chunk.text);
+            results.emplace_back(std::string(chunks_.doc_id(chunk_idx)), static_cast<int>(chunks_.seq_no(chunk_idx)),
+                                 score, std::string(chunks_.text(chunk_idx)));
         }
     }
 
     return results;
 }
 
-std::vector<RetrievalResult> FusionRetriever::vector_retrieve(const std::string& query_text, int top_k) {
-    if (!vector_store_ || !embedding_model_) {
+std::vector<RetrievalResult> FusionRetriever::vector_retrieve(const std::string& query_text, int top_k, const DocBitmap* filter) {
+    if (!embedding_model_) {
         return {};
     }
 
     // 生成查询向量
     auto query_embedding = embedding_model_->embed(query_text, humanus::EmbeddingType::QUERY);
 
-    // 向量检索
-    auto memory_items = vector_store_->search(query_embedding, top_k);
+    // 向量检索，与ID解析在同一把共享锁下
+    std::shared_lock<std::shared_mutex> lock(chunks_mutex_);
+    if (!vector_store_) {
+        return {};
+    }
+    auto memory_items = vector_store_->search(query_embedding, top_k, filter);
 
     std::vector<RetrievalResult> results;
     for (const auto& item : memory_items) {
-        std::string doc_id = item.metadata.at("doc_id");
-        int seq_no = std::stoi(item.metadata.at("seq_no"));
-        double score = item.similarity;  // 相似度分数
+        // 向量ID即chunk下标；跳过已删除的chunk
+        if (item.id >= chunks_.size() || !chunks_.live(item.id)) continue;
 
-        results.emplace_back(doc_id, seq_no, score, item.content);
+        double score = item.similarity;  // 相似度分数
+        results.emplace_back(std::string(chunks_.doc_id(item.id)), static_cast<int>(chunks_.seq_no(item.id)),
+                             score, std::string(chunks_.text(item.id)));
     }
 
     return results;
@@ -321,16 +409,14 @@ std::vector<RetrievalResult> FusionRetriever::rrf_fusion(
         }
     }
 
-    // 排序并返回top_k
-    std::vector<std::pair<std::string, double>> sorted_docs(doc_scores.begin(), doc_scores.end());
-    std::sort(sorted_docs.begin(), sorted_docs.end(),
-              [](const auto& a, const auto& b) { return a.second > b.second; });
+    // 选出top_k
+    TopK<std::string> top(static_cast<size_t>(std::max(top_k, 0)));
+    for (const auto& [doc_key, score] : doc_scores) {
+        top.push(doc_key, score);
+    }
 
     std::vector<RetrievalResult> results;
-    for (size_t i = 0; i < std::min(static_cast<size_t>(top_k), sorted_docs.size()); ++i) {
-        const std::string& doc_key = sorted_docs[i].first;
-        double score = sorted_docs[i].second;
-
+    for (const auto& [doc_key, score] : top.take_sorted()) {
         auto result = doc_map[doc_key];
         result.score = score;  // 更新为融合分数
         results.push_back(result);
@@ -370,16 +456,14 @@ std::vector<RetrievalResult> FusionRetriever::weighted_fusion(
         }
     }
 
-    // 排序并返回top_k
-    std::vector<std::pair<std::string, double>> sorted_docs(doc_scores.begin(), doc_scores.end());
-    std::sort(sorted_docs.begin(), sorted_docs.end(),
-              [](const auto& a, const auto& b) { return a.second > b.second; });
+    // 选出top_k
+    TopK<std::string> top(static_cast<size_t>(std::max(top_k, 0)));
+    for (const auto& [doc_key, score] : doc_scores) {
+        top.push(doc_key, score);
+    }
 
     std::vector<RetrievalResult> results;
-    for (size_t i = 0; i < std::min(static_cast<size_t>(top_k), sorted_docs.size()); ++i) {
-        const std::string& doc_key = sorted_docs[i].first;
-        double score = sorted_docs[i].second;
-
+    for (const auto& [doc_key, score] : top.take_sorted()) {
         auto result = doc_map[doc_key];
         result.score = score;  // 更新为融合分数
         results.push_back(result);
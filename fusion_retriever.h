@@ -2,11 +2,16 @@
 #define RAG_FUSION_RETRIEVER_H
 
 #include "chunk.h"
+#include "chunk_store.h"
 #include "bm25.h"
 #include "config.h"
+#include "metadata_index.h"
+#include "thread_pool.h"
 #include <vector>
 #include <memory>
 #include <future>
+#include <mutex>
+#include <shared_mutex>
 #include <unordered_set>
 
 // 前向声明，避免完整包含
@@ -49,6 +54,11 @@ struct FusionRetrieverConfig {
     int max_candidates = 100;           // 候选结果最大数量
     double rrf_k = 60.0;               // RRF参数k值
     bool enable_rerank = true;          // 是否启用重排序
+    BM25Config bm25;                    // BM25索引配置
+    HNSWConfig hnsw;                    // HNSW图参数
+    IVFPQConfig ivf_pq;                 // IVF-PQ 参数
+    VectorConfig vector;                // 向量索引类型
+    ThreadPoolConfig threadpool;        // 建索引线程池配置
 
     // 从RAGConfig读取
     static FusionRetrieverConfig from_rag_config(const RAGConfig& config) {
@@ -68,21 +78,30 @@ struct FusionRetrieverConfig {
         fusion_config.max_candidates = config.fusion.max_candidates;
         fusion_config.rrf_k = config.fusion.rrf_k;
         fusion_config.enable_rerank = config.fusion.enable_rerank;
+        fusion_config.bm25 = config.bm25;
+        fusion_config.hnsw = config.hnsw;
+        fusion_config.ivf_pq = config.ivf_pq;
+        fusion_config.vector = config.vector;
+        fusion_config.threadpool = config.threadpool;
 
         return fusion_config;
     }
 };
 
-// BM25+HNSW融合检索器
+// BM25+向量（flat / HNSW / IVF-PQ）融合检索器
 class FusionRetriever {
 private:
+    // bm25_indexer_ 与 vector_store_ 在 fit / open_snapshot 时整体替换，检索时在 chunks_mutex_ 共享锁下访问
     std::shared_ptr<BM25Indexer> bm25_indexer_;
+    std::shared_ptr<ThreadPool> thread_pool_;   // 并行建索引
     std::shared_ptr<humanus::VectorStore> vector_store_;
     std::shared_ptr<humanus::EmbeddingModel> embedding_model_;
     FusionRetrieverConfig config_;
 
-    std::vector<Chunk> chunks_;  // 保存所有chunks的引用
-    std::unordered_map<std::string, size_t> doc_to_vector_id_;  // 文档ID到向量ID的映射
+    ChunkStore chunks_;  // 保存所有chunks，下标与BM25文档下标、向量ID一致
+    MetadataIndex metadata_;  // chunks_ 的元数据位图，下标与 chunks_ 一致
+    mutable std::shared_mutex chunks_mutex_;  // 保护 chunks_、metadata_ 与两个索引指针
+    std::mutex write_mutex_;                  // 串行化 fit / add_documents / remove_document / 快照
 
 public:
     // 构造函数
@@ -93,21 +112,50 @@ public:
     // 从RAGConfig构造
     static std::shared_ptr<FusionRetriever> from_config(const RAGConfig& config);
 
-    // 构建索引
+    // 构建索引：在新的 BM25 与向量索引（与当前向量索引同类型、同参数）上建好后与chunks一起替换，检索可以与之并发进行；
+    // 向量索引不支持 clone_empty() 时在写锁下原地重建
     void fit(const std::vector<Chunk>& chunks);
 
+    // 增量追加chunks，检索可以与之并发进行；BM25与chunk存储的下标不一致时不写入并返回 false
+    bool add_documents(const std::vector<Chunk>& chunks);
+
+    // 删除 doc_id 的所有chunks，返回删除的chunk数量
+    size_t remove_document(const std::string& doc_id);
+
+    // 把chunk存储、BM25索引和向量数据写入一个快照文件
+    bool save_snapshot(const std::string& path);
+
+    // mmap打开快照并直接在映射内存上检索，替换当前内容，之后仍可增删文档
+    // 检索配置（融合策略、BM25参数与查询模式）使用当前配置；embedding模型需与保存时一致
+    // 三部分加载到新的 BM25 与向量索引（与当前向量索引同类型、同参数）中，全部成功后一起替换；
+    // 快照中的向量索引类型与当前的不同、或当前索引不支持 clone_empty() 时失败；失败时返回 false，当前内容不变
+    bool open_snapshot(const std::string& path);
+
     // 查询接口
     std::vector<RetrievalResult> query(const std::string& query_text, int top_k = 10);
 
+    // 只在满足元数据过滤条件的chunk中检索：条件先求值为文档位图，BM25与向量打分时直接跳过位图外的chunk
+    std::vector<RetrievalResult> query(const std::string& query_text, const MetadataFilter& filter, int top_k = 10);
+
     // 异步查询
     std::future<std::vector<RetrievalResult>> query_async(const std::string& query_text, int top_k = 10);
 
+    // 短语/邻近查询，只走BM25倒排表（需开启 bm25.store_positions），slop 为允许插入的词数
+    std::vector<RetrievalResult> query_phrase(const std::string& phrase, int top_k = 10, uint32_t slop = 0);
+
 private:
-    // BM25检索
-    std::vector<RetrievalResult> bm25_retrieve(const std::string& query_text, int top_k);
+    // 创建空的索引并设置线程池：BM25 按配置创建，向量索引与当前的同类型、同参数（不支持时返回空指针）
+    std::shared_ptr<BM25Indexer> make_bm25_indexer() const;
+    std::shared_ptr<humanus::VectorStore> make_vector_store() const;
+
+    // BM25检索，filter 为空时不过滤
+    std::vector<RetrievalResult> bm25_retrieve(const std::string& query_text, int top_k, const DocBitmap* filter = nullptr);
+
+    // BM25结果（chunk下标, 分数）转为检索结果，调用方持有 chunks_mutex_ 共享锁
+    std::vector<RetrievalResult> resolve_bm25(const std::vector<std::pair<size_t, double>>& scores);
 
-    // 向量检索
-    std::vector<RetrievalResult> vector_retrieve(const std::string& query_text, int top_k);
+    // 向量检索，filter 为空时不过滤
+    std::vector<RetrievalResult> vector_retrieve(const std::string& query_text, int top_k, const DocBitmap* filter = nullptr);
 
     // 结果融合
     std::vector<RetrievalResult> fuse_results(
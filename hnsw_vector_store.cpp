@@ -0,0 +1,761 @@
+#include "hnsw_vector_store.h"
+#include "distance.h"
+#include "top_k.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <mutex>
+#include <queue>
+
+namespace humanus {
+
+namespace {
+
+// 搜索时的访问标记，每线程一份；按轮次区分，不需要每次查询清零
+struct VisitedSet {
+    std::vector<uint32_t> tags;
+    uint32_t epoch = 0;
+
+    void reset(size_t n) {
+        if (tags.size() < n) tags.resize(n, 0);
+        if (++epoch == 0) {
+            std::fill(tags.begin(), tags.end(), 0);
+            epoch = 1;
+        }
+    }
+
+    // 首次访问返回 true
+    bool insert(uint32_t node) {
+        if (tags[node] == epoch) return false;
+        tags[node] = epoch;
+        return true;
+    }
+};
+
+thread_local VisitedSet visited;
+
+// 归一化，零向量保持为零
+void normalize(const float* in, size_t n, float* out) {
+    float norm = rag::distance::dot(in, in, n);
+    float scale = norm > 0 ? 1.0f / std::sqrt(norm) : 0.0f;
+    for (size_t i = 0; i < n; ++i) out[i] = in[i] * scale;
+}
+
+} // namespace
+
+HNSWVectorStore::HNSWVectorStore(const rag::HNSWConfig& config, const rag::VectorConfig& vector)
+    : config_dim_(static_cast<size_t>(std::max(config.vector_dim, 1))),
+      config_M_(static_cast<size_t>(std::max(config.M, 2))),
+      ef_construction_(static_cast<size_t>(std::max(config.ef_construction, 1))),
+      ef_query_(static_cast<size_t>(std::max(config.ef_query, 1))),
+      max_elements_(static_cast<size_t>(std::max(config.max_elements, 0))),
+      compaction_threshold_(std::max(config.compaction_threshold, 0.0)),
+      filter_brute_force_ratio_(std::max(vector.filter_brute_force_ratio, 0.0)),
+      rng_(100) {
+    reset();
+}
+
+HNSWVectorStore::~HNSWVectorStore() {
+    // 后台整理任务引用 this，析构前等待其结束
+    wait_for_compaction();
+}
+
+void HNSWVectorStore::set_graph_params(size_t dim, size_t M) {
+    dim_ = dim;
+    M_ = M;
+    max_links0_ = 2 * M_;
+    level_mult_ = 1.0 / std::log(static_cast<double>(M_));
+}
+
+void HNSWVectorStore::reset() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    // 打开快照时图参数取自快照，重置后恢复为构造时的配置
+    set_graph_params(config_dim_, config_M_);
+    vectors_.reset(dim_);
+    ids_.clear();
+    items_.clear();
+    levels_.clear();
+    links0_.clear();
+    upper_offsets_.clear();
+    upper_links_.clear();
+    tombstones_.clear();
+    free_.clear();
+    free_slots_.clear();
+    free_count_ = 0;
+    ++generation_;
+    entry_point_ = 0;
+    max_level_ = -1;
+    rng_.seed(100);
+    mapping_.reset();
+
+    // 按 max_elements 预分配，超出后由 vector 自动扩容
+    vectors_.reserve(max_elements_);
+    ids_.reserve(max_elements_);
+    levels_.reserve(max_elements_);
+    links0_.reserve(max_elements_ * (max_links0_ + 1));
+    upper_offsets_.reserve(max_elements_);
+}
+
+void HNSWVectorStore::reserve(size_t n) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    vectors_.reserve(n);
+    ids_.reserve(n);
+    levels_.reserve(n);
+    links0_.reserve(n * (max_links0_ + 1));
+    upper_offsets_.reserve(n);
+}
+
+void HNSWVectorStore::set_thread_pool(std::shared_ptr<rag::ThreadPool> pool) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    thread_pool_ = std::move(pool);
+}
+
+std::shared_ptr<VectorStore> HNSWVectorStore::clone_empty() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    rag::HNSWConfig config;
+    config.vector_dim = static_cast<int>(config_dim_);
+    config.M = static_cast<int>(config_M_);
+    config.ef_construction = static_cast<int>(ef_construction_);
+    config.ef_query = static_cast<int>(ef_query_);
+    config.max_elements = static_cast<int>(max_elements_);
+    config.compaction_threshold = compaction_threshold_;
+    rag::VectorConfig vector;
+    vector.filter_brute_force_ratio = filter_brute_force_ratio_;
+    return std::make_shared<HNSWVectorStore>(config, vector);
+}
+
+void HNSWVectorStore::set_ef_query(size_t ef) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    ef_query_ = std::max<size_t>(ef, 1);
+}
+
+size_t HNSWVectorStore::size() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return ids_.size() - tombstones_.count();
+}
+
+size_t HNSWVectorStore::pending_deletes() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return tombstones_.count() - free_count_;
+}
+
+float HNSWVectorStore::distance(const float* a, const float* b) const {
+    return 1.0f - rag::distance::dot(a, b, dim_);
+}
+
+uint32_t* HNSWVectorStore::links(uint32_t node, int level) {
+    if (level == 0) return links0_.writable().data() + static_cast<size_t>(node) * (max_links0_ + 1);
+    return upper_links_.writable().data() + upper_offsets_[node] + static_cast<size_t>(level - 1) * (M_ + 1);
+}
+
+const uint32_t* HNSWVectorStore::links(uint32_t node, int level) const {
+    if (level == 0) return links0_.data() + static_cast<size_t>(node) * (max_links0_ + 1);
+    return upper_links_.data() + upper_offsets_[node] + static_cast<size_t>(level - 1) * (M_ + 1);
+}
+
+int HNSWVectorStore::random_level() {
+    // u 取 (0, 1]，避免 log(0)
+    double u = 1.0 - std::uniform_real_distribution<double>(0.0, 1.0)(rng_);
+    return static_cast<int>(-std::log(u) * level_mult_);
+}
+
+uint32_t HNSWVectorStore::greedy_search(const float* query, uint32_t entry, int top, int bottom,
+                                        bool parallel) const {
+    std::vector<uint32_t> copy;
+    uint32_t cur = entry;
+    float cur_dist = distance(query, vector_at(cur));
+    for (int level = top; level >= bottom; --level) {
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            const uint32_t* l = links(cur, level);
+            if (parallel) {
+                std::lock_guard<std::mutex> guard(link_lock(cur));
+                copy.assign(l, l + l[0] + 1);
+                l = copy.data();
+            }
+            for (uint32_t i = 1; i <= l[0]; ++i) {
+                float d = distance(query, vector_at(l[i]));
+                if (d < cur_dist) {
+                    cur_dist = d;
+                    cur = l[i];
+                    changed = true;
+                }
+            }
+        }
+    }
+    return cur;
+}
+
+std::vector<HNSWVectorStore::Candidate> HNSWVectorStore::search_layer(const float* query, uint32_t entry,
+                                                                      size_t ef, int level, bool parallel) const {
+    return search_layer(query, entry, ef, level, parallel, [](uint32_t) { return true; });
+}
+
+template <typename Accept>
+std::vector<HNSWVectorStore::Candidate> HNSWVectorStore::search_layer(const float* query, uint32_t entry,
+                                                                      size_t ef, int level, bool parallel,
+                                                                      Accept accept) const {
+    std::vector<uint32_t> copy;
+    visited.reset(ids_.size());
+    // candidates 为待扩展的节点（小顶堆），results 为当前最近的 ef 个节点（大顶堆）
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> candidates;
+    std::priority_queue<Candidate> results;
+    float d = distance(query, vector_at(entry));
+    candidates.emplace(d, entry);
+    if (accept(entry)) results.emplace(d, entry);
+    visited.insert(entry);
+
+    while (!candidates.empty()) {
+        Candidate c = candidates.top();
+        // 最近的待扩展节点比结果中最远的还远，结果不会再改善
+        if (results.size() >= ef && c.first > results.top().first) break;
+        candidates.pop();
+
+        const uint32_t* l = links(c.second, level);
+        if (parallel) {
+            // 其他线程可能正在修改这个邻居表，复制后再扩展
+            std::lock_guard<std::mutex> guard(link_lock(c.second));
+            copy.assign(l, l + l[0] + 1);
+            l = copy.data();
+        }
+        for (uint32_t i = 1; i <= l[0]; ++i) {
+            uint32_t nb = l[i];
+            if (!visited.insert(nb)) continue;
+            float nd = distance(query, vector_at(nb));
+            if (results.size() < ef || nd < results.top().first) {
+                candidates.emplace(nd, nb);
+                if (!accept(nb)) continue;
+                results.emplace(nd, nb);
+                if (results.size() > ef) results.pop();
+            }
+        }
+    }
+
+    std::vector<Candidate> out(results.size());
+    for (size_t i = out.size(); i-- > 0; ) {
+        out[i] = results.top();
+        results.pop();
+    }
+    return out;
+}
+
+void HNSWVectorStore::select_neighbors(std::vector<Candidate>& candidates, size_t m) const {
+    if (candidates.size() <= m) return;
+    std::vector<Candidate> selected;
+    selected.reserve(m);
+    for (const auto &c : candidates) {
+        if (selected.size() >= m) break;
+        bool keep = true;
+        for (const auto &s : selected) {
+            if (distance(vector_at(c.second), vector_at(s.second)) < c.first) {
+                keep = false;
+                break;
+            }
+        }
+        if (keep) selected.push_back(c);
+    }
+    candidates.swap(selected);
+}
+
+void HNSWVectorStore::connect(uint32_t neighbor, uint32_t node, int level) {
+    uint32_t* l = links(neighbor, level);
+    size_t cap = max_links(level);
+    if (l[0] < cap) {
+        l[++l[0]] = node;
+        return;
+    }
+
+    // 邻居表已满：在原有邻居与新节点中重新选择
+    const float* base = vector_at(neighbor);
+    std::vector<Candidate> candidates;
+    candidates.reserve(cap + 1);
+    candidates.emplace_back(distance(base, vector_at(node)), node);
+    for (uint32_t i = 1; i <= l[0]; ++i) {
+        // 已删除的邻居借这次重选直接去掉
+        if (!tombstones_.deleted(l[i])) candidates.emplace_back(distance(base, vector_at(l[i])), l[i]);
+    }
+    std::sort(candidates.begin(), candidates.end());
+    select_neighbors(candidates, cap);
+    l[0] = static_cast<uint32_t>(candidates.size());
+    for (size_t i = 0; i < candidates.size(); ++i) l[i + 1] = candidates[i].second;
+}
+
+uint32_t HNSWVectorStore::append_node(const std::vector<float>& vector, size_t vector_id) {
+    std::vector<float> normalized(dim_);
+    normalize(vector.data(), dim_, normalized.data());
+    int level = random_level();
+
+    // 复用层数相同的空闲槽位，摘除时邻居表已清空
+    if (static_cast<size_t>(level) < free_slots_.size() && !free_slots_[level].empty()) {
+        uint32_t node = free_slots_[level].back();
+        free_slots_[level].pop_back();
+        free_[node] = 0;
+        --free_count_;
+        vectors_.assign(node, normalized.data());
+        ids_.writable()[node] = vector_id;
+        tombstones_.on_insert(node, vector_id);
+        return node;
+    }
+
+    uint32_t node = static_cast<uint32_t>(ids_.size());
+    vectors_.append(normalized.data());
+    ids_.push_back(vector_id);
+    tombstones_.on_insert(node, vector_id);
+    levels_.push_back(level);
+    auto &links0 = links0_.writable();
+    links0.resize(links0.size() + max_links0_ + 1, 0);
+    auto &upper = upper_links_.writable();
+    upper_offsets_.push_back(upper.size());
+    upper.resize(upper.size() + static_cast<size_t>(level) * (M_ + 1), 0);
+    return node;
+}
+
+void HNSWVectorStore::link_node(uint32_t node, bool parallel) {
+    int level = levels_[node];
+    // 层数不超过当前最高层时只需在开始时读取入口点；否则插入期间一直持有，结束时更新入口点
+    std::unique_lock<std::mutex> entry_lock(entry_mutex_, std::defer_lock);
+    if (parallel) entry_lock.lock();
+    uint32_t entry = entry_point_;
+    int max_level = max_level_;
+    if (max_level < 0) {
+        entry_point_ = node;
+        max_level_ = level;
+        return;
+    }
+    if (parallel && level <= max_level) entry_lock.unlock();
+
+    const float* query = vector_at(node);
+    uint32_t cur = entry;
+    if (level < max_level) cur = greedy_search(query, cur, max_level, level + 1, parallel);
+
+    for (int l = std::min(level, max_level); l >= 0; --l) {
+        auto candidates = search_layer(query, cur, ef_construction_, l, parallel);
+        cur = candidates.front().second;
+        // 已删除的节点只用于路由，不作为邻居；并行建图时其他线程可能已经经由本节点的上层找到它并连了过来：
+        // 不连自己，并保留已有的邻居
+        candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+                                        [&](const Candidate& c) {
+                                            return c.second == node || tombstones_.deleted(c.second);
+                                        }),
+                         candidates.end());
+        if (candidates.empty()) continue;
+        std::unique_lock<std::mutex> own_lock;
+        if (parallel) own_lock = std::unique_lock<std::mutex>(link_lock(node));
+        uint32_t* own = links(node, l);
+        for (uint32_t i = 1; i <= own[0]; ++i) {
+            if (tombstones_.deleted(own[i])) continue;
+            if (std::none_of(candidates.begin(), candidates.end(), [&](const Candidate& c) { return c.second == own[i]; })) {
+                candidates.emplace_back(distance(query, vector_at(own[i])), own[i]);
+            }
+        }
+        if (own[0] > 0) std::sort(candidates.begin(), candidates.end());
+        select_neighbors(candidates, M_);
+        own[0] = static_cast<uint32_t>(candidates.size());
+        for (size_t i = 0; i < candidates.size(); ++i) own[i + 1] = candidates[i].second;
+        if (parallel) own_lock.unlock();
+
+        for (const auto &c : candidates) {
+            std::unique_lock<std::mutex> neighbor_lock;
+            if (parallel) neighbor_lock = std::unique_lock<std::mutex>(link_lock(c.second));
+            connect(c.second, node, l);
+        }
+    }
+
+    if (level > max_level) {
+        max_level_ = level;
+        entry_point_ = node;
+    }
+}
+
+void HNSWVectorStore::insert(const std::vector<float>& vector, size_t vector_id, const MemoryItem& metadata) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (vector.size() != dim_) {
+        std::cerr << "HNSWVectorStore: dimension mismatch (" << vector.size()
+                  << " vs " << dim_ << "), vector " << vector_id << " ignored" << std::endl;
+        return;
+    }
+
+    uint32_t node = append_node(vector, vector_id);
+    items_.set(node, metadata);
+    link_node(node, false);
+}
+
+void HNSWVectorStore::insert_batch(const std::vector<std::vector<float>>& vectors,
+                                   const std::vector<size_t>& vector_ids) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    size_t n = std::min(vectors.size(), vector_ids.size());
+
+    // 先按顺序追加全部节点（层数的随机序列与逐条插入相同），并行阶段不再改变数组大小
+    std::vector<uint32_t> nodes;
+    nodes.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        if (vectors[i].size() != dim_) {
+            std::cerr << "HNSWVectorStore: dimension mismatch (" << vectors[i].size()
+                      << " vs " << dim_ << "), vector " << vector_ids[i] << " ignored" << std::endl;
+            continue;
+        }
+        nodes.push_back(append_node(vectors[i], vector_ids[i]));
+    }
+    links0_.writable();
+    upper_links_.writable();
+
+    size_t workers = thread_pool_ ? std::min(thread_pool_->size(), nodes.size()) : 1;
+    size_t first = 0;
+    if (max_level_ < 0 && !nodes.empty()) link_node(nodes[first++], false);
+    if (workers <= 1) {
+        for (size_t i = first; i < nodes.size(); ++i) link_node(nodes[i], false);
+        return;
+    }
+
+    if (!link_locks_) link_locks_.reset(new std::mutex[kLinkLocks]);
+    // 按顺序领取节点，先插入的节点先连入图
+    std::atomic<size_t> next{first};
+    std::vector<std::future<void>> futures;
+    futures.reserve(workers);
+    for (size_t w = 0; w < workers; ++w) {
+        futures.push_back(thread_pool_->submit([this, &nodes, &next] {
+            for (size_t i = next++; i < nodes.size(); i = next++) link_node(nodes[i], true);
+        }));
+    }
+    for (auto &f : futures) f.get();
+}
+
+std::vector<MemoryItem> HNSWVectorStore::search(const std::vector<float>& query, size_t limit,
+                                                const rag::DocBitmap* filter) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (max_level_ < 0 || limit == 0) return {};
+    if (query.size() != dim_) {
+        std::cerr << "HNSWVectorStore: query dimension mismatch (" << query.size()
+                  << " vs " << dim_ << ")" << std::endl;
+        return {};
+    }
+
+    std::vector<float> q(dim_);
+    normalize(query.data(), dim_, q.data());
+    std::vector<Candidate> candidates;
+    size_t live = ids_.size() - tombstones_.count();
+    if (filter && filter->cardinality() <= filter_brute_force_ratio_ * live) {
+        candidates = brute_force(q.data(), limit, *filter);
+    } else {
+        auto accept = [&](uint32_t node) {
+            if (tombstones_.deleted(node)) return false;
+            return !filter || (ids_[node] <= UINT32_MAX && filter->contains(static_cast<uint32_t>(ids_[node])));
+        };
+        uint32_t cur = max_level_ > 0 ? greedy_search(q.data(), entry_point_, max_level_, 1) : entry_point_;
+        candidates = search_layer(q.data(), cur, std::max(ef_query_, limit), 0, false, accept);
+    }
+
+    std::vector<std::pair<size_t, double>> ranked;
+    for (const auto &[dist, node] : candidates) {
+        if (ranked.size() >= limit) break;
+        ranked.emplace_back(node, 1.0 - dist);
+    }
+    return items_.collect(ranked, ids_);
+}
+
+std::vector<HNSWVectorStore::Candidate> HNSWVectorStore::brute_force(const float* query, size_t limit,
+                                                                     const rag::DocBitmap& filter) const {
+    // 没有 vector_id 到节点的索引，按节点顺序判断；位图查找远比距离计算便宜
+    rag::TopK<uint32_t> top(limit);
+    for (uint32_t node = 0; node < ids_.size(); ++node) {
+        if (tombstones_.deleted(node) || ids_[node] > UINT32_MAX) continue;
+        if (!filter.contains(static_cast<uint32_t>(ids_[node]))) continue;
+        top.push(node, -distance(query, vector_at(node)));
+    }
+    std::vector<Candidate> out;
+    for (const auto &[node, negative_dist] : top.take_sorted()) out.emplace_back(-negative_dist, node);
+    return out;
+}
+
+bool HNSWVectorStore::remove(size_t vector_id) {
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        size_t node = tombstones_.remove(vector_id, ids_);
+        if (node == rag::Tombstones::kNone) return false;
+        items_.erase(node);
+    }
+    schedule_compaction();
+    return true;
+}
+
+std::vector<uint32_t> HNSWVectorStore::repair_links(uint32_t node, int level) const {
+    const uint32_t* l = links(node, level);
+    const float* base = vector_at(node);
+    std::vector<Candidate> candidates;
+    auto add = [&](uint32_t nb) {
+        if (nb == node || tombstones_.deleted(nb)) return;
+        for (const auto &c : candidates) {
+            if (c.second == nb) return;
+        }
+        candidates.emplace_back(distance(base, vector_at(nb)), nb);
+    };
+    for (uint32_t i = 1; i <= l[0]; ++i) {
+        if (!tombstones_.deleted(l[i])) {
+            add(l[i]);
+            continue;
+        }
+        const uint32_t* dl = links(l[i], level);
+        for (uint32_t j = 1; j <= dl[0]; ++j) add(dl[j]);
+    }
+    std::sort(candidates.begin(), candidates.end());
+    select_neighbors(candidates, max_links(level));
+    std::vector<uint32_t> out;
+    out.reserve(candidates.size() + 1);
+    out.push_back(static_cast<uint32_t>(candidates.size()));
+    for (const auto &c : candidates) out.push_back(c.second);
+    return out;
+}
+
+bool HNSWVectorStore::compact_once() {
+    // 修复一个 (节点, 层) 的邻居表：before 为计算时的邻居表，after 为新的邻居表
+    struct Repair {
+        uint32_t node;
+        int level;
+        std::vector<uint32_t> before;
+        std::vector<uint32_t> after;
+    };
+    std::vector<uint32_t> removed;
+    std::vector<Repair> repairs;
+    uint64_t generation = 0;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        generation = generation_;
+        size_t n = ids_.size();
+        for (uint32_t node = 0; node < n; ++node) {
+            if (tombstones_.deleted(node) && !is_free(node)) removed.push_back(node);
+        }
+        if (removed.empty()) return false;
+
+        // 重新选邻居只读取图，不持有写锁，期间检索可以继续
+        const HNSWVectorStore& graph = *this;
+        for (uint32_t node = 0; node < n; ++node) {
+            if (tombstones_.deleted(node)) continue;
+            for (int level = 0; level <= levels_[node]; ++level) {
+                const uint32_t* l = graph.links(node, level);
+                bool stale = false;
+                for (uint32_t i = 1; i <= l[0] && !stale; ++i) stale = tombstones_.deleted(l[i]);
+                if (!stale) continue;
+                repairs.push_back({node, level, std::vector<uint32_t>(l, l + l[0] + 1), repair_links(node, level)});
+            }
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (generation != generation_) return false;  // 图已被 reset() 或快照替换
+    for (auto &r : repairs) {
+        // 被删除或重新插入的节点不再修复；期间邻居表有变化时在写锁下重新计算
+        if (tombstones_.deleted(r.node) || is_free(r.node)) continue;
+        uint32_t* l = links(r.node, r.level);
+        if (!std::equal(r.before.begin(), r.before.end(), l)) r.after = repair_links(r.node, r.level);
+        std::copy(r.after.begin(), r.after.end(), l);
+    }
+
+    // 摘除：清空邻居表，槽位按层数放入空闲表
+    if (free_.size() < ids_.size()) free_.resize(ids_.size(), 0);
+    for (uint32_t node : removed) {
+        // 两阶段之间节点可能已被复用（不再是已删除）；整理串行执行，正常不会遇到已摘除的节点，仍然防御
+        if (!tombstones_.deleted(node) || is_free(node)) continue;
+        for (int level = 0; level <= levels_[node]; ++level) links(node, level)[0] = 0;
+        free_[node] = 1;
+        ++free_count_;
+        if (free_slots_.size() <= static_cast<size_t>(levels_[node])) free_slots_.resize(levels_[node] + 1);
+        free_slots_[levels_[node]].push_back(node);
+    }
+
+    // 入口点被摘除时换成图中层数最高的节点
+    if (max_level_ >= 0 && is_free(entry_point_)) {
+        max_level_ = -1;
+        entry_point_ = 0;
+        for (uint32_t node = 0; node < ids_.size(); ++node) {
+            if (!is_free(node) && levels_[node] > max_level_) {
+                max_level_ = levels_[node];
+                entry_point_ = node;
+            }
+        }
+    }
+    return true;
+}
+
+void HNSWVectorStore::compact() {
+    // 同步删除、外部调用与后台任务可能同时整理，串行执行，避免同一节点被摘除两次
+    std::lock_guard<std::mutex> run(compact_run_mutex_);
+    while (compact_once()) {}
+}
+
+void HNSWVectorStore::schedule_compaction() {
+    std::shared_ptr<rag::ThreadPool> pool;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        size_t in_graph = ids_.size() - free_count_;
+        size_t pending = tombstones_.count() - free_count_;
+        if (pending == 0 || pending <= compaction_threshold_ * in_graph) return;
+        pool = thread_pool_;
+    }
+    if (!pool) {
+        compact();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(compact_mutex_);
+        if (compacting_) {
+            compact_pending_ = true;  // 正在整理的任务结束前会再检查一次
+            return;
+        }
+        compacting_ = true;
+        compact_pending_ = false;
+    }
+    pool->submit([this] {
+        while (true) {
+            compact();
+            std::lock_guard<std::mutex> lock(compact_mutex_);
+            if (!compact_pending_) {
+                compacting_ = false;
+                compact_cv_.notify_all();
+                return;
+            }
+            compact_pending_ = false;
+        }
+    });
+}
+
+void HNSWVectorStore::wait_for_compaction() {
+    std::unique_lock<std::mutex> lock(compact_mutex_);
+    compact_cv_.wait(lock, [this] { return !compacting_; });
+}
+
+size_t HNSWVectorStore::memory_usage() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return ids_.memory_usage() + levels_.memory_usage() + links0_.memory_usage() +
+           upper_offsets_.memory_usage() + upper_links_.memory_usage() + tombstones_.memory_usage() +
+           free_.capacity() + items_.memory_usage();
+}
+
+size_t HNSWVectorStore::vector_bytes() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return vectors_.memory_usage();
+}
+
+bool HNSWVectorStore::save_snapshot(rag::SnapshotWriter& writer) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    writer.write<uint32_t>(kGraphFormat);
+    writer.write<uint64_t>(dim_);
+    writer.write<uint64_t>(M_);
+    writer.write<int32_t>(max_level_);
+    writer.write<uint32_t>(entry_point_);
+    writer.write_array(ids_);
+    writer.write_array(levels_);
+    writer.write_array(links0_);
+    writer.write_array(upper_offsets_);
+    writer.write_array(upper_links_);
+    vectors_.save(writer);
+    tombstones_.save(writer);
+    return writer.ok();
+}
+
+bool HNSWVectorStore::load_snapshot(rag::SectionReader& reader) {
+    uint32_t format = 0, entry = 0;
+    uint64_t dim = 0, M = 0;
+    int32_t max_level = -1;
+    rag::MappedArray<uint64_t> ids, upper_offsets;
+    rag::MappedArray<int32_t> levels;
+    rag::MappedArray<uint32_t> links0, upper_links;
+    rag::VectorArena vectors;
+    rag::Tombstones tombstones;
+    if (!reader.read(format) || format != kGraphFormat) {
+        reader.fail();
+        std::cerr << "HNSWVectorStore: unsupported graph format " << format
+                  << " (expected " << kGraphFormat << ")" << std::endl;
+        return false;
+    }
+    bool ok = reader.read(dim) && reader.read(M) && reader.read(max_level) && reader.read(entry) &&
+              reader.read_array(ids) && reader.read_array(levels) && reader.read_array(links0) &&
+              reader.read_array(upper_offsets) && reader.read_array(upper_links) && vectors.load(reader) &&
+              tombstones.load(reader, ids.size());
+    size_t n = ids.size();
+    ok = ok && dim > 0 && M >= 2 && n <= UINT32_MAX && levels.size() == n && upper_offsets.size() == n &&
+         links0.size() == n * (2 * M + 1) && vectors.size() == n && vectors.dim() == dim;
+    ok = ok && (n == 0 ? max_level == -1 : entry < n && max_level >= 0 && levels[entry] == max_level);
+
+    // 邻居表的越界会在检索时变成越界访问，打开时逐项检查；只读取、不复制
+    uint64_t upper_size = 0;
+    for (size_t node = 0; ok && node < n; ++node) {
+        ok = levels[node] >= 0 && levels[node] <= max_level && upper_offsets[node] == upper_size;
+        upper_size += static_cast<uint64_t>(levels[node]) * (M + 1);
+    }
+    ok = ok && upper_links.size() == upper_size;
+    auto valid_list = [&](const uint32_t* l, size_t cap) {
+        if (l[0] > cap) return false;
+        for (uint32_t i = 1; i <= l[0]; ++i) {
+            if (l[i] >= n) return false;
+        }
+        return true;
+    };
+    for (size_t node = 0; ok && node < n; ++node) {
+        ok = valid_list(links0.data() + node * (2 * M + 1), 2 * M);
+        for (int32_t level = 1; ok && level <= levels[node]; ++level) {
+            ok = valid_list(upper_links.data() + upper_offsets[node] + (level - 1) * (M + 1), M);
+        }
+    }
+    if (!ok) {
+        reader.fail();
+        std::cerr << "HNSWVectorStore: corrupt graph snapshot section" << std::endl;
+        return false;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    set_graph_params(dim, M);
+    ids_ = std::move(ids);
+    levels_ = std::move(levels);
+    links0_ = std::move(links0);
+    upper_offsets_ = std::move(upper_offsets);
+    upper_links_ = std::move(upper_links);
+    vectors_ = std::move(vectors);
+    tombstones_ = std::move(tombstones);
+    items_.clear();
+    entry_point_ = entry;
+    max_level_ = max_level;
+    ++generation_;
+
+    // 空闲槽位不单独保存：邻居表全空、且不是入口点的已删除节点已经摘除
+    const HNSWVectorStore& graph = *this;
+    free_.assign(tombstones_.empty() ? 0 : n, 0);
+    free_slots_.clear();
+    free_count_ = 0;
+    for (uint32_t node = 0; node < free_.size(); ++node) {
+        if (!tombstones_.deleted(node) || (max_level_ >= 0 && node == entry_point_)) continue;
+        bool detached = true;
+        for (int level = 0; detached && level <= levels_[node]; ++level) detached = graph.links(node, level)[0] == 0;
+        if (!detached) continue;
+        free_[node] = 1;
+        ++free_count_;
+        if (free_slots_.size() <= static_cast<size_t>(levels_[node])) free_slots_.resize(levels_[node] + 1);
+        free_slots_[levels_[node]].push_back(node);
+    }
+    mapping_ = reader.file();
+    return true;
+}
+
+bool HNSWVectorStore::save(const std::string& path) {
+    rag::SnapshotWriter writer(path);
+    if (!writer.ok()) return false;
+    writer.begin_section(rag::SnapshotSection::VECTORS);
+    if (!save_snapshot(writer)) return false;
+    writer.end_section();
+    return writer.finish();
+}
+
+bool HNSWVectorStore::open(const std::string& path) {
+    rag::SnapshotReader reader;
+    if (!reader.open(path)) return false;
+    auto section = reader.section(rag::SnapshotSection::VECTORS);
+    if (!section.ok()) {
+        std::cerr << "HNSWVectorStore: " << path << " has no vector section" << std::endl;
+        return false;
+    }
+    return load_snapshot(section);
+}
+
+} // namespace humanus
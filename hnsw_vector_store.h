@@ -0,0 +1,172 @@
+#pragma once
+#include "config.h"
+#include "mapped_array.h"
+#include "tombstones.h"
+#include "vector_arena.h"
+#include "vector_store.h"
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace humanus {
+
+// HNSW 图索引（Malkov & Yashunin）：余弦相似度，近似最近邻检索
+// 每个节点随机分配层数（概率按 1/M 逐层递减），上层稀疏、用于快速定位，第0层包含所有节点
+// 插入时逐层用 ef_construction 大小的候选集搜索邻居，按启发式选出至多 M 个（第0层至多 2M 个）互相连接
+// 查询时从入口点逐层贪心下降，在第0层用 max(ef_query, limit) 大小的候选集搜索
+// 向量插入时归一化，距离为 1 - 点积
+// 批量插入时在线程池上并行建图：每个线程独立插入节点，邻居表按节点编号分条加锁，读邻居表时加锁复制，
+// 改邻居表时只持有被修改节点的锁；层数高于当前最高层的节点插入期间独占入口点，其余节点只在开始时读取入口点
+// 图持久化为快照的向量段：邻居表、层数、入口点与对齐的向量行都是定长数组，打开时直接引用只读映射，不需要重新建图；
+// 多个进程打开同一个文件时共享同一份页缓存。打开后插入会先把映射的数组复制为自有存储
+// 删除只打墓碑：已删除的节点仍参与路由，但不出现在结果中，新节点也不会连向它们；
+// 图中已删除节点的占比超过 compaction_threshold 时整理（有线程池时在后台）：引用已删除节点的邻居表
+// 从原有邻居与已删除邻居的邻居中重新选邻居，已删除节点随后从图中摘除，其槽位留给之后层数相同的新节点复用
+// 带过滤条件的检索在遍历时判断：不满足条件与已删除的节点照常扩展、用于路由，只是不进入结果集，结果数不会因过滤而变少；
+// 过滤条件允许的向量占比低于 filter_brute_force_ratio 时图遍历要走过大部分节点才能凑满结果，改为对允许的节点暴力计算
+class HNSWVectorStore : public VectorStore {
+public:
+    explicit HNSWVectorStore(const rag::HNSWConfig& config = rag::HNSWConfig{},
+                             const rag::VectorConfig& vector = rag::VectorConfig{});
+    ~HNSWVectorStore() override;
+
+    void reset() override;
+    void insert(const std::vector<float>& vector, size_t vector_id, const MemoryItem& metadata) override;
+    // 设置了线程池时并行建图，节点层数与逐条插入时相同
+    void insert_batch(const std::vector<std::vector<float>>& vectors, const std::vector<size_t>& vector_ids) override;
+
+    // filter 不为空时只返回其中的 vector_id；图中满足条件的节点不少于 limit 个时返回 limit 个结果
+    std::vector<MemoryItem> search(const std::vector<float>& query, size_t limit,
+                                   const rag::DocBitmap* filter = nullptr) override;
+
+    void reserve(size_t n) override;
+    void set_thread_pool(std::shared_ptr<rag::ThreadPool> pool) override;
+    std::shared_ptr<VectorStore> clone_empty() override;
+    VectorIndexKind kind() const override { return VectorIndexKind::HNSW; }
+    bool remove(size_t vector_id) override;
+
+    // 立即整理全部已删除的节点；wait_for_compaction() 等待后台整理完成
+    void compact();
+    void wait_for_compaction();
+
+    // 图结构（M、维度）以快照中的为准，构造时的 M 与 vector_dim 被覆盖
+    bool save_snapshot(rag::SnapshotWriter& writer) override;
+    bool load_snapshot(rag::SectionReader& reader) override;
+
+    // 单独的图文件：只包含向量段的快照文件
+    bool save(const std::string& path);
+    bool open(const std::string& path);
+
+    // 查询时的候选集大小，越大召回越高、越慢
+    void set_ef_query(size_t ef);
+
+    // 有效（未删除）的节点数
+    size_t size();
+    // 已删除但尚未从图中摘除的节点数
+    size_t pending_deletes();
+    // 邻居表、层数与ID的字节数；向量行单独统计
+    size_t memory_usage();
+    size_t vector_bytes();
+
+    // 快照向量段中图格式的版本，布局变化时递增
+    static constexpr uint32_t kGraphFormat = 2;
+    // 并行建图时邻居表锁的条数，节点 i 使用第 i % kLinkLocks 把锁
+    static constexpr size_t kLinkLocks = 1 << 14;
+
+private:
+    using Candidate = std::pair<float, uint32_t>;  // (距离, 节点)
+
+    const float* vector_at(uint32_t node) const { return vectors_.row(node); }
+    float distance(const float* a, const float* b) const;
+
+    // 节点在第 level 层的邻居：[邻居数, 邻居...]
+    uint32_t* links(uint32_t node, int level);
+    const uint32_t* links(uint32_t node, int level) const;
+    size_t max_links(int level) const { return level == 0 ? max_links0_ : M_; }
+
+    std::mutex& link_lock(uint32_t node) const { return link_locks_[node % kLinkLocks]; }
+
+    int random_level();
+
+    // 分配节点：有层数相同的空闲槽位时复用，否则追加向量、ID、层数与空邻居表；返回节点编号，不连接
+    uint32_t append_node(const std::vector<float>& vector, size_t vector_id);
+    bool is_free(uint32_t node) const { return node < free_.size() && free_[node]; }
+    // 把已追加的节点连入图；parallel 为 true 时与其他线程并发，邻居表加锁读写
+    void link_node(uint32_t node, bool parallel);
+
+    // 从 entry 开始在 [bottom, top] 各层贪心下降，返回最近的节点
+    uint32_t greedy_search(const float* query, uint32_t entry, int top, int bottom, bool parallel = false) const;
+
+    // 在第 level 层搜索 ef 个最近的节点，按距离升序返回
+    std::vector<Candidate> search_layer(const float* query, uint32_t entry, size_t ef, int level,
+                                        bool parallel = false) const;
+    // 同上，但只有 accept(node) 为 true 的节点进入结果；其余节点仍被扩展，结果未满 ef 个时不停止
+    template <typename Accept>
+    std::vector<Candidate> search_layer(const float* query, uint32_t entry, size_t ef, int level, bool parallel,
+                                        Accept accept) const;
+    // 对满足过滤条件的有效节点逐个计算距离，按距离升序返回 limit 个
+    std::vector<Candidate> brute_force(const float* query, size_t limit, const rag::DocBitmap& filter) const;
+
+    // 启发式选邻居：按距离从近到远，只保留比所有已选邻居都更靠近基准点的候选，使邻居分布在不同方向
+    void select_neighbors(std::vector<Candidate>& candidates, size_t m) const;
+
+    // 把 node 加入 neighbor 的邻居表，已满时重新选择
+    void connect(uint32_t neighbor, uint32_t node, int level);
+
+    void set_graph_params(size_t dim, size_t M);
+
+    // 重新选择 node 在第 level 层的邻居，去掉已删除的节点：候选为原有的有效邻居与已删除邻居的有效邻居
+    std::vector<uint32_t> repair_links(uint32_t node, int level) const;
+    // 整理一轮：共享锁下计算新的邻居表，写锁下应用并摘除节点；没有可整理的节点或图已被替换时返回 false
+    bool compact_once();
+    // 删除后调用：已删除节点占比超过阈值时整理，有线程池时在后台进行
+    void schedule_compaction();
+
+    size_t config_dim_;
+    size_t config_M_;
+    size_t dim_;
+    size_t M_;
+    size_t max_links0_;
+    size_t ef_construction_;
+    size_t ef_query_;
+    size_t max_elements_;
+    double compaction_threshold_;
+    double filter_brute_force_ratio_;
+    double level_mult_;
+    std::mt19937_64 rng_;
+
+    rag::VectorArena vectors_;            // 归一化后的向量，每个节点一行
+    rag::MappedArray<uint64_t> ids_;      // 节点 -> vector_id
+    ItemColumn items_;                    // 插入时传入的非空元数据
+    rag::MappedArray<int32_t> levels_;    // 节点的最高层
+    rag::MappedArray<uint32_t> links0_;   // 第0层邻居表，每个节点 max_links0_ + 1 项
+    rag::MappedArray<uint64_t> upper_offsets_;  // 节点在 upper_links_ 中的起始位置
+    rag::MappedArray<uint32_t> upper_links_;    // 第1层及以上的邻居表按节点首尾相接，每层 M_ + 1 项
+    rag::Tombstones tombstones_;          // 已删除的节点
+    std::vector<uint8_t> free_;           // 已从图中摘除、可以复用的节点
+    std::vector<std::vector<uint32_t>> free_slots_;  // 按层数分组的空闲节点
+    size_t free_count_ = 0;
+    uint64_t generation_ = 0;             // reset() 与打开快照时递增，后台整理据此放弃过期的结果
+    uint32_t entry_point_ = 0;
+    int max_level_ = -1;                  // -1 表示图为空
+    std::shared_ptr<const rag::MappedFile> mapping_;
+    std::shared_ptr<rag::ThreadPool> thread_pool_;
+    std::unique_ptr<std::mutex[]> link_locks_;  // 第一次并行建图时分配
+    std::mutex entry_mutex_;              // 并行建图时保护 entry_point_ 与 max_level_
+    // 后台整理：同一时刻最多一个整理任务
+    std::mutex compact_mutex_;
+    std::mutex compact_run_mutex_;        // 同一时刻只执行一个 compact()
+    std::condition_variable compact_cv_;
+    bool compacting_ = false;
+    bool compact_pending_ = false;        // 整理期间又有删除，结束前需再检查一次
+    std::shared_mutex mutex_;             // 插入与检索可以并发调用
+};
+
+} // namespace humanus
@@ -0,0 +1,581 @@
+#include "ivf_pq_vector_store.h"
+#include "distance.h"
+#include "top_k.h"
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <numeric>
+#include <random>
+
+namespace humanus {
+
+namespace {
+
+constexpr size_t kTransposeMaxDim = 32;  // 不超过该维度的中心转置存放
+constexpr uint32_t kSeed = 20240601;
+
+// 把 [0, n) 分段交给线程池并行执行 fn(begin, end)，没有线程池时在当前线程执行
+template <typename F>
+void parallel_for(rag::ThreadPool* pool, size_t n, F&& fn) {
+    size_t parts = pool ? std::min(pool->size(), n) : 1;
+    if (parts <= 1) {
+        if (n > 0) fn(size_t(0), n);
+        return;
+    }
+    std::vector<std::future<void>> futures;
+    futures.reserve(parts);
+    for (size_t p = 0; p < parts; ++p) {
+        size_t begin = n * p / parts;
+        size_t end = n * (p + 1) / parts;
+        futures.push_back(pool->submit([&fn, begin, end] { fn(begin, end); }));
+    }
+    for (auto &f : futures) f.get();
+}
+
+// 从 [0, n) 中随机抽取至多 limit 个下标
+std::vector<size_t> sample_rows(size_t n, size_t limit, std::mt19937& rng) {
+    std::vector<size_t> rows(n);
+    std::iota(rows.begin(), rows.end(), size_t(0));
+    if (n > limit) {
+        for (size_t i = 0; i < limit; ++i) {
+            std::uniform_int_distribution<size_t> pick(i, n - 1);
+            std::swap(rows[i], rows[pick(rng)]);
+        }
+        rows.resize(limit);
+    }
+    return rows;
+}
+
+// L2 k-means：随机取 k 个点作初始中心，迭代 kKMeansIters 轮，返回 k × dim 的中心
+// 点数不超过 k 时每个点各自作为中心，多出的中心重复取点；空簇从最大的簇中随机取一个点重新开始
+std::vector<float> kmeans(const std::vector<const float*>& points, size_t dim, size_t k, rag::ThreadPool* pool,
+                          uint32_t seed) {
+    size_t n = points.size();
+    std::vector<float> centroids(k * dim, 0.0f);
+    if (n == 0) return centroids;
+
+    std::mt19937 rng(seed);
+    std::vector<size_t> order = sample_rows(n, std::min(n, k), rng);
+    for (size_t c = 0; c < k; ++c) {
+        const float* p = points[order[c % order.size()]];
+        std::copy(p, p + dim, centroids.begin() + c * dim);
+    }
+    if (n <= k) return centroids;
+
+    std::vector<uint32_t> assign(n);
+    std::vector<float> sums(k * dim);
+    std::vector<size_t> counts(k);
+    IVFPQVectorStore::Quantizer quantizer;
+    for (int iter = 0; iter < IVFPQVectorStore::kKMeansIters; ++iter) {
+        quantizer.build(centroids.data(), k, dim);
+        parallel_for(pool, n, [&](size_t begin, size_t end) {
+            std::vector<float> scratch(k);
+            for (size_t i = begin; i < end; ++i) {
+                assign[i] = static_cast<uint32_t>(quantizer.nearest(points[i], scratch.data()));
+            }
+        });
+
+        std::fill(sums.begin(), sums.end(), 0.0f);
+        std::fill(counts.begin(), counts.end(), 0);
+        for (size_t i = 0; i < n; ++i) {
+            float* sum = sums.data() + assign[i] * dim;
+            for (size_t d = 0; d < dim; ++d) sum[d] += points[i][d];
+            ++counts[assign[i]];
+        }
+        for (size_t c = 0; c < k; ++c) {
+            if (counts[c] == 0) continue;
+            float inv = 1.0f / counts[c];
+            for (size_t d = 0; d < dim; ++d) centroids[c * dim + d] = sums[c * dim + d] * inv;
+        }
+        for (size_t c = 0; c < k; ++c) {
+            if (counts[c] > 0) continue;
+            size_t largest = std::max_element(counts.begin(), counts.end()) - counts.begin();
+            std::uniform_int_distribution<size_t> pick(0, n - 1);
+            size_t i = pick(rng);
+            while (assign[i] != largest) i = pick(rng);
+            std::copy(points[i], points[i] + dim, centroids.begin() + c * dim);
+            assign[i] = static_cast<uint32_t>(c);
+            --counts[largest];
+            counts[c] = 1;
+        }
+    }
+    return centroids;
+}
+
+void normalize(const float* in, size_t n, float* out) {
+    float norm = rag::distance::dot(in, in, n);
+    float scale = norm > 0 ? 1.0f / std::sqrt(norm) : 0.0f;
+    for (size_t i = 0; i < n; ++i) out[i] = in[i] * scale;
+}
+
+} // namespace
+
+void IVFPQVectorStore::Quantizer::build(const float* centroids, size_t count, size_t dimension) {
+    rows = centroids;
+    k = count;
+    dim = dimension;
+    norms.resize(k);
+    for (size_t c = 0; c < k; ++c) norms[c] = rag::distance::dot(rows + c * dim, rows + c * dim, dim);
+    cols.clear();
+    if (dim <= kTransposeMaxDim) {
+        cols.resize(dim * k);
+        for (size_t c = 0; c < k; ++c) {
+            for (size_t d = 0; d < dim; ++d) cols[d * k + c] = rows[c * dim + d];
+        }
+    }
+}
+
+void IVFPQVectorStore::Quantizer::inner_products(const float* x, float* out) const {
+    if (cols.empty()) {
+        for (size_t c = 0; c < k; ++c) out[c] = rag::distance::dot(x, rows + c * dim, dim);
+        return;
+    }
+    std::fill(out, out + k, 0.0f);
+    for (size_t d = 0; d < dim; ++d) {
+        float xd = x[d];
+        const float* col = cols.data() + d * k;
+        for (size_t c = 0; c < k; ++c) out[c] += xd * col[c];
+    }
+}
+
+size_t IVFPQVectorStore::Quantizer::nearest(const float* x, float* scratch) const {
+    // |x - c|² = |x|² - 2 x·c + |c|²，|x|² 与中心无关
+    inner_products(x, scratch);
+    size_t best = 0;
+    float best_dist = norms[0] - 2 * scratch[0];
+    for (size_t c = 1; c < k; ++c) {
+        float dist = norms[c] - 2 * scratch[c];
+        if (dist < best_dist) {
+            best_dist = dist;
+            best = c;
+        }
+    }
+    return best;
+}
+
+IVFPQVectorStore::IVFPQVectorStore(const rag::IVFPQConfig& config, const rag::VectorConfig& vector)
+    : config_(config), rerank_factor_(static_cast<size_t>(std::max(vector.rerank_factor, 0))),
+      filter_brute_force_ratio_(std::max(vector.filter_brute_force_ratio, 0.0)) {
+    if (config_.nbits < 1 || config_.nbits > 8) {
+        std::cerr << "IVFPQVectorStore: nbits must be in [1, 8], got " << config_.nbits << ", using 8" << std::endl;
+        config_.nbits = 8;
+    }
+    config_.nlist = std::max(config_.nlist, 1);
+    config_.nprobe = std::max(config_.nprobe, 1);
+    config_.m = std::max(config_.m, 1);
+    config_.train_size = std::max(config_.train_size, 1);
+    nbits_ = static_cast<size_t>(config_.nbits);
+}
+
+void IVFPQVectorStore::reset() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    nlist_ = 0;
+    m_ = 0;
+    nbits_ = static_cast<size_t>(config_.nbits);
+    dim_ = 0;
+    dsub_ = 0;
+    code_size_ = 0;
+    trained_ = false;
+    floats_ = rag::VectorArena();
+    centroids_.clear();
+    codebooks_.clear();
+    coarse_ = Quantizer();
+    pq_.clear();
+    lists_.clear();
+    ids_.clear();
+    items_.clear();
+    tombstones_.clear();
+    reserved_ = 0;
+    mapping_.reset();
+}
+
+void IVFPQVectorStore::set_thread_pool(std::shared_ptr<rag::ThreadPool> pool) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    thread_pool_ = std::move(pool);
+}
+
+std::shared_ptr<VectorStore> IVFPQVectorStore::clone_empty() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    rag::VectorConfig vector;
+    vector.rerank_factor = static_cast<int>(rerank_factor_);
+    vector.filter_brute_force_ratio = filter_brute_force_ratio_;
+    return std::make_shared<IVFPQVectorStore>(config_, vector);
+}
+
+void IVFPQVectorStore::set_nprobe(size_t nprobe) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    config_.nprobe = static_cast<int>(std::max<size_t>(nprobe, 1));
+}
+
+void IVFPQVectorStore::reserve(size_t n) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    reserved_ = n;
+    if (dim_ == 0) return;
+    ids_.reserve(n);
+    if (rerank_factor_ > 0) {
+        floats_.reserve(n);
+    } else if (!trained_) {
+        floats_.reserve(std::min(n, static_cast<size_t>(config_.train_size)));
+    }
+}
+
+void IVFPQVectorStore::build_quantizers() {
+    coarse_.build(centroids_.data(), nlist_, dim_);
+    pq_.assign(m_, Quantizer());
+    for (size_t j = 0; j < m_; ++j) pq_[j].build(codebooks_.data() + j * ksub() * dsub_, ksub(), dsub_);
+}
+
+void IVFPQVectorStore::encode(const float* unit, size_t list, uint8_t* code, std::vector<float>& scratch) const {
+    scratch.resize(dim_ + ksub());
+    float* residual = scratch.data();
+    float* dist = residual + dim_;
+    const float* centroid = centroids_.data() + list * dim_;
+    for (size_t d = 0; d < dim_; ++d) residual[d] = unit[d] - centroid[d];
+
+    std::fill(code, code + code_size_, 0);
+    for (size_t j = 0; j < m_; ++j) {
+        uint32_t k = static_cast<uint32_t>(pq_[j].nearest(residual + j * dsub_, dist));
+        size_t bit = j * nbits_, byte = bit >> 3, shift = bit & 7;
+        code[byte] |= static_cast<uint8_t>(k << shift);
+        if (shift + nbits_ > 8) code[byte + 1] |= static_cast<uint8_t>(k >> (8 - shift));
+    }
+}
+
+void IVFPQVectorStore::append(size_t list, uint32_t row, const uint8_t* code) {
+    auto &bucket = lists_[list];
+    size_t count = bucket.rows.size();
+    size_t lane = count % rag::distance::kAdcBlock;
+    auto &codes = bucket.codes.writable();
+    if (lane == 0) codes.resize(codes.size() + code_size_ * rag::distance::kAdcBlock, 0);
+    uint8_t* block = codes.data() + (count / rag::distance::kAdcBlock) * code_size_ * rag::distance::kAdcBlock;
+    for (size_t b = 0; b < code_size_; ++b) block[b * rag::distance::kAdcBlock + lane] = code[b];
+    bucket.rows.push_back(row);
+}
+
+void IVFPQVectorStore::train() {
+    size_t n = ids_.size();
+    rag::ThreadPool* pool = thread_pool_.get();
+    std::mt19937 rng(kSeed);
+
+    // 粗量化：在（抽样的）原始向量上训练桶中心，再把全部行分桶
+    nlist_ = std::min(static_cast<size_t>(config_.nlist), n);
+    std::vector<const float*> points;
+    for (size_t row : sample_rows(n, nlist_ * kMaxPointsPerCentroid, rng)) points.push_back(floats_.row(row));
+    centroids_.writable() = kmeans(points, dim_, nlist_, pool, kSeed);
+    coarse_.build(centroids_.data(), nlist_, dim_);
+
+    std::vector<uint32_t> assign(n);
+    parallel_for(pool, n, [&](size_t begin, size_t end) {
+        std::vector<float> scratch(nlist_);
+        for (size_t row = begin; row < end; ++row) {
+            assign[row] = static_cast<uint32_t>(coarse_.nearest(floats_.row(row), scratch.data()));
+        }
+    });
+
+    // 乘积量化：在抽样行的残差上，每个子空间独立训练，子空间之间并行
+    std::vector<size_t> sample = sample_rows(n, ksub() * kMaxPointsPerCentroid, rng);
+    std::vector<float> residuals(sample.size() * dim_);
+    for (size_t s = 0; s < sample.size(); ++s) {
+        const float* v = floats_.row(sample[s]);
+        const float* c = centroids_.data() + assign[sample[s]] * dim_;
+        for (size_t d = 0; d < dim_; ++d) residuals[s * dim_ + d] = v[d] - c[d];
+    }
+    auto &codebooks = codebooks_.writable();
+    codebooks.assign(m_ * ksub() * dsub_, 0.0f);
+    parallel_for(pool, m_, [&](size_t begin, size_t end) {
+        std::vector<const float*> sub(sample.size());
+        for (size_t j = begin; j < end; ++j) {
+            for (size_t s = 0; s < sample.size(); ++s) sub[s] = residuals.data() + s * dim_ + j * dsub_;
+            std::vector<float> centers = kmeans(sub, dsub_, ksub(), nullptr, kSeed + static_cast<uint32_t>(j) + 1);
+            std::copy(centers.begin(), centers.end(), codebooks.begin() + j * ksub() * dsub_);
+        }
+    });
+    build_quantizers();
+
+    // 编码已插入的行；桶的大小已知，一次分配到位
+    std::vector<uint8_t> codes(n * code_size_);
+    parallel_for(pool, n, [&](size_t begin, size_t end) {
+        std::vector<float> scratch;
+        for (size_t row = begin; row < end; ++row) {
+            encode(floats_.row(row), assign[row], codes.data() + row * code_size_, scratch);
+        }
+    });
+    std::vector<size_t> counts(nlist_, 0);
+    for (uint32_t list : assign) ++counts[list];
+    lists_.assign(nlist_, InvertedList());
+    for (size_t list = 0; list < nlist_; ++list) {
+        size_t blocks = (counts[list] + rag::distance::kAdcBlock - 1) / rag::distance::kAdcBlock;
+        lists_[list].rows.reserve(counts[list]);
+        lists_[list].codes.reserve(blocks * code_size_ * rag::distance::kAdcBlock);
+    }
+    for (size_t row = 0; row < n; ++row) append(assign[row], static_cast<uint32_t>(row), codes.data() + row * code_size_);
+    trained_ = true;
+
+    if (rerank_factor_ == 0) floats_ = rag::VectorArena();
+}
+
+void IVFPQVectorStore::insert(const std::vector<float>& vector, size_t vector_id, const MemoryItem& metadata) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (ids_.empty()) {
+        dim_ = vector.size();
+        // 子空间数须整除维度，否则取不超过配置值的最大约数
+        m_ = std::min(static_cast<size_t>(config_.m), std::max<size_t>(dim_, 1));
+        while (dim_ % m_ != 0) --m_;
+        if (m_ != static_cast<size_t>(config_.m)) {
+            std::cerr << "IVFPQVectorStore: m=" << config_.m << " does not divide dimension " << dim_
+                      << ", using m=" << m_ << std::endl;
+        }
+        dsub_ = dim_ / m_;
+        code_size_ = (m_ * nbits_ + 7) / 8;
+        trained_ = false;
+        floats_.reset(dim_);
+        ids_.reserve(reserved_);
+        floats_.reserve(rerank_factor_ > 0 ? reserved_ : std::min(reserved_, static_cast<size_t>(config_.train_size)));
+    }
+    if (vector.size() != dim_) {
+        std::cerr << "IVFPQVectorStore: dimension mismatch (" << vector.size()
+                  << " vs " << dim_ << "), vector " << vector_id << " ignored" << std::endl;
+        return;
+    }
+
+    std::vector<float> unit(dim_);
+    normalize(vector.data(), dim_, unit.data());
+    size_t row = ids_.size();
+    if (has_floats()) floats_.append(unit.data());
+    ids_.push_back(vector_id);
+    tombstones_.on_insert(row, vector_id);
+    items_.set(row, metadata);
+
+    if (trained_) {
+        std::vector<float> scratch(std::max(nlist_, ksub()));
+        size_t list = coarse_.nearest(unit.data(), scratch.data());
+        std::vector<uint8_t> code(code_size_);
+        encode(unit.data(), list, code.data(), scratch);
+        append(list, static_cast<uint32_t>(row), code.data());
+    } else if (ids_.size() >= static_cast<size_t>(config_.train_size)) {
+        train();
+    }
+}
+
+std::vector<MemoryItem> IVFPQVectorStore::search(const std::vector<float>& query, size_t limit,
+                                                 const rag::DocBitmap* filter) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (ids_.empty() || limit == 0) return {};
+    if (query.size() != dim_) {
+        std::cerr << "IVFPQVectorStore: query dimension mismatch (" << query.size()
+                  << " vs " << dim_ << ")" << std::endl;
+        return {};
+    }
+
+    auto skip = [&](size_t row) {
+        if (tombstones_.deleted(row)) return true;
+        return filter && (ids_[row] > UINT32_MAX || !filter->contains(static_cast<uint32_t>(ids_[row])));
+    };
+    std::vector<float> q(dim_);
+    normalize(query.data(), dim_, q.data());
+    auto exact = [&](size_t row) { return static_cast<double>(rag::distance::dot(q.data(), floats_.row(row), dim_)); };
+
+    size_t live = ids_.size() - tombstones_.count();
+    bool selective = filter && filter->cardinality() <= filter_brute_force_ratio_ * live;
+
+    std::vector<std::pair<size_t, double>> ranked;
+    if (!trained_ || (selective && has_floats())) {
+        // 尚未训练，或过滤条件很严格：原始向量精确检索
+        rag::TopK<size_t> top(limit);
+        for (size_t row = 0; row < ids_.size(); ++row) {
+            if (!skip(row)) top.push(row, exact(row));
+        }
+        ranked = top.take_sorted();
+    } else {
+        // 全部桶按到查询的 L2 距离排序，同时记下 q·c；通常只扫描前 nprobe 个
+        std::vector<float> center_ip(nlist_);
+        coarse_.inner_products(q.data(), center_ip.data());
+        rag::TopK<size_t> probes(nlist_);
+        for (size_t list = 0; list < nlist_; ++list) probes.push(list, 2 * center_ip[list] - coarse_.norms[list]);
+        size_t nprobe = selective ? nlist_ : std::min(static_cast<size_t>(config_.nprobe), nlist_);
+
+        // 查找表：lut[j][k] = q_j · 第 j 个子空间的第 k 个中心
+        std::vector<float> lut(m_ * ksub());
+        for (size_t j = 0; j < m_; ++j) pq_[j].inner_products(q.data() + j * dsub_, lut.data() + j * ksub());
+
+        bool rerank = rerank_factor_ > 0 && has_floats();
+        rag::TopK<size_t> top(rerank ? limit * rerank_factor_ : limit);
+        std::vector<float> scores;
+        size_t probed = 0, accepted = 0;
+        for (const auto &[list, closeness] : probes.take_sorted()) {
+            // 满足条件的候选已够 top 的容量时才停，过滤掉的行不占名额
+            if (probed++ >= nprobe && accepted >= top.capacity()) break;
+            const auto &bucket = lists_[list];
+            size_t count = bucket.rows.size();
+            if (count == 0) continue;
+            size_t blocks = (count + rag::distance::kAdcBlock - 1) / rag::distance::kAdcBlock;
+            scores.resize(blocks * rag::distance::kAdcBlock);
+            rag::distance::adc_scan(lut.data(), m_, nbits_, bucket.codes.data(), code_size_, blocks, scores.data());
+            for (size_t i = 0; i < count; ++i) {
+                size_t row = bucket.rows[i];
+                if (skip(row)) continue;
+                top.push(row, center_ip[list] + scores[i]);
+                ++accepted;
+            }
+        }
+        ranked = top.take_sorted();
+
+        if (rerank) {
+            rag::TopK<size_t> exact_top(limit);
+            for (const auto &[row, approx] : ranked) exact_top.push(row, exact(row));
+            ranked = exact_top.take_sorted();
+        }
+    }
+
+    return items_.collect(ranked, ids_);
+}
+
+bool IVFPQVectorStore::remove(size_t vector_id) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    size_t row = tombstones_.remove(vector_id, ids_);
+    if (row == rag::Tombstones::kNone) return false;
+    items_.erase(row);
+    return true;
+}
+
+size_t IVFPQVectorStore::size() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return ids_.size() - tombstones_.count();
+}
+
+bool IVFPQVectorStore::trained() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return trained_;
+}
+
+size_t IVFPQVectorStore::code_size() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return code_size_;
+}
+
+size_t IVFPQVectorStore::memory_usage() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    size_t bytes = ids_.memory_usage() + centroids_.memory_usage() + codebooks_.memory_usage() +
+                   tombstones_.memory_usage();
+    for (const auto &bucket : lists_) bytes += sizeof(bucket) + bucket.rows.memory_usage() + bucket.codes.memory_usage();
+    for (const auto &quantizer : pq_) {
+        bytes += (quantizer.norms.capacity() + quantizer.cols.capacity()) * sizeof(float);
+    }
+    bytes += (coarse_.norms.capacity() + coarse_.cols.capacity()) * sizeof(float) + items_.memory_usage();
+    return bytes;
+}
+
+size_t IVFPQVectorStore::float_bytes() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return floats_.memory_usage();
+}
+
+bool IVFPQVectorStore::save_snapshot(rag::SnapshotWriter& writer) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    writer.write<uint64_t>(dim_);
+    writer.write<uint64_t>(m_);
+    writer.write<uint64_t>(nbits_);
+    writer.write<uint8_t>(trained_ ? 1 : 0);
+    writer.write_array(ids_);
+    if (trained_) {
+        writer.write_array(centroids_);
+        writer.write_array(codebooks_);
+        // 倒排表首尾相接：offsets[l, l+1) 为第 l 个桶的行范围，码按整块依次存放
+        std::vector<uint64_t> offsets{0};
+        size_t code_bytes = 0;
+        for (const auto &bucket : lists_) {
+            offsets.push_back(offsets.back() + bucket.rows.size());
+            code_bytes += bucket.codes.size();
+        }
+        writer.write_array(offsets);
+        writer.begin_array(offsets.back());
+        for (const auto &bucket : lists_) writer.append(bucket.rows.data(), bucket.rows.size());
+        writer.begin_array(code_bytes);
+        for (const auto &bucket : lists_) writer.append(bucket.codes.data(), bucket.codes.size());
+    }
+    writer.write<uint8_t>(has_floats() ? 1 : 0);
+    if (has_floats()) floats_.save(writer);
+    tombstones_.save(writer);
+    return writer.ok();
+}
+
+bool IVFPQVectorStore::load_snapshot(rag::SectionReader& reader) {
+    uint64_t dim = 0, m = 0, nbits = 0;
+    uint8_t trained = 0, with_floats = 0;
+    rag::MappedArray<uint64_t> ids, offsets;
+    rag::MappedArray<float> centroids, codebooks;
+    rag::MappedArray<uint32_t> rows;
+    rag::MappedArray<uint8_t> codes;
+    rag::VectorArena floats;
+    rag::Tombstones tombstones;
+    bool ok = reader.read(dim) && reader.read(m) && reader.read(nbits) && reader.read(trained) && reader.read_array(ids);
+    if (ok && trained) {
+        ok = reader.read_array(centroids) && reader.read_array(codebooks) && reader.read_array(offsets) &&
+             reader.read_array(rows) && reader.read_array(codes);
+    }
+    ok = ok && reader.read(with_floats) && (!with_floats || floats.load(reader));
+
+    size_t n = ids.size();
+    ok = ok && nbits >= 1 && nbits <= 8 && (dim == 0 || (m > 0 && dim % m == 0));
+    size_t centers = size_t(1) << (ok ? nbits : 0);
+    size_t code_size = ok ? (m * nbits + 7) / 8 : 0;
+    size_t nlist = offsets.empty() ? 0 : offsets.size() - 1;
+    if (ok && trained) {
+        ok = dim > 0 && nlist > 0 && centroids.size() == nlist * dim && codebooks.size() == centers * dim &&
+             offsets[0] == 0 && offsets.back() == n && rows.size() == n;
+        size_t blocks = 0;
+        for (size_t l = 0; ok && l < nlist; ++l) {
+            ok = offsets[l + 1] >= offsets[l];
+            blocks += (offsets[l + 1] - offsets[l] + rag::distance::kAdcBlock - 1) / rag::distance::kAdcBlock;
+        }
+        for (size_t i = 0; ok && i < n; ++i) ok = rows[i] < n;
+        ok = ok && codes.size() == blocks * code_size * rag::distance::kAdcBlock;
+    }
+    if (ok && (with_floats || !trained)) {
+        ok = floats.size() == n && (n == 0 || floats.dim() == dim);
+    }
+    ok = ok && tombstones.load(reader, n);
+    if (!ok) {
+        reader.fail();
+        std::cerr << "IVFPQVectorStore: corrupt vector snapshot section" << std::endl;
+        return false;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    dim_ = dim;
+    m_ = m;
+    nbits_ = nbits;
+    dsub_ = m ? dim / m : 0;
+    code_size_ = code_size;
+    trained_ = trained;
+    nlist_ = nlist;
+    ids_ = std::move(ids);
+    centroids_ = std::move(centroids);
+    codebooks_ = std::move(codebooks);
+    floats_ = std::move(floats);
+    tombstones_ = std::move(tombstones);
+    lists_.assign(nlist_, InvertedList());
+    size_t code_offset = 0;
+    for (size_t l = 0; l < nlist_; ++l) {
+        size_t count = offsets[l + 1] - offsets[l];
+        size_t bytes = (count + rag::distance::kAdcBlock - 1) / rag::distance::kAdcBlock * code_size_ *
+                       rag::distance::kAdcBlock;
+        lists_[l].rows.assign_view(rows.data() + offsets[l], count);
+        lists_[l].codes.assign_view(codes.data() + code_offset, bytes);
+        code_offset += bytes;
+    }
+    if (trained_) {
+        build_quantizers();
+    } else {
+        coarse_ = Quantizer();
+        pq_.clear();
+    }
+    items_.clear();
+    reserved_ = 0;
+    mapping_ = reader.file();
+    return true;
+}
+
+} // namespace humanus
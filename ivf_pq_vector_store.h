@@ -0,0 +1,113 @@
+#pragma once
+#include "config.h"
+#include "mapped_array.h"
+#include "tombstones.h"
+#include "vector_arena.h"
+#include "vector_store.h"
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace humanus {
+
+// IVF-PQ 近似检索：k-means 把单位化后的向量分到 nlist 个倒排桶，桶内只存向量与桶中心之差（残差）的乘积量化码
+// 残差切成 m 个子空间，每个子空间用 k-means 训练 2^nbits 个中心，向量按各子空间最近中心的编号编码，共 m * nbits 位
+// 检索时只扫描离查询最近的 nprobe 个桶：q·x ≈ q·c + Σ_j q_j·r̂_j，后一项先对每个子空间算好 q_j 与全部中心的内积（查找表），
+// 每个向量只需 m 次查表相加（distance::adc_scan，SIMD gather）；再取 limit * rerank_factor 个候选用原始向量重排
+// 行数达到 train_size 时用已插入的向量训练一次，之前精确检索；之后插入的向量按已训练的中心直接编码，不再重新训练
+// rerank_factor 为 0 时不重排，训练后释放原始向量；快照保存中心、码与原始向量，打开后都留在映射文件中
+// 带过滤条件（或有已删除的行）时，扫完 nprobe 个桶后满足条件的候选仍不够，按中心远近继续扫描后面的桶；
+// 过滤条件允许的向量占比低于 filter_brute_force_ratio 时不走倒排桶，直接对允许的行用原始向量精确计算（没有原始向量时扫描全部桶）
+class IVFPQVectorStore : public VectorStore {
+public:
+    static constexpr int kKMeansIters = 10;
+    static constexpr size_t kMaxPointsPerCentroid = 64;  // k-means 训练点数上限为中心数的倍数，超过时随机抽样
+
+    explicit IVFPQVectorStore(const rag::IVFPQConfig& config = rag::IVFPQConfig{},
+                              const rag::VectorConfig& vector = rag::VectorConfig{});
+
+    void reset() override;
+    void insert(const std::vector<float>& vector, size_t vector_id, const MemoryItem& metadata) override;
+    std::vector<MemoryItem> search(const std::vector<float>& query, size_t limit,
+                                   const rag::DocBitmap* filter = nullptr) override;
+    void reserve(size_t n) override;
+    // 删除的行只做标记，扫描倒排桶时跳过，重建前不回收
+    bool remove(size_t vector_id) override;
+
+    bool save_snapshot(rag::SnapshotWriter& writer) override;
+    bool load_snapshot(rag::SectionReader& reader) override;
+
+    // k-means 训练与训练后的批量编码并行执行
+    void set_thread_pool(std::shared_ptr<rag::ThreadPool> pool) override;
+    std::shared_ptr<VectorStore> clone_empty() override;
+    VectorIndexKind kind() const override { return VectorIndexKind::IVF_PQ; }
+    void set_nprobe(size_t nprobe);
+
+    size_t size();
+    bool trained();
+    size_t code_size();
+    // 码、倒排表、中心与ID的字节数；原始向量单独统计
+    size_t memory_usage();
+    size_t float_bytes();
+
+    // 一组中心的最近邻查找。维度较高时逐个中心调用 SIMD 内积；
+    // 维度低（PQ 子空间）时把中心按维度转置，一次扫描算出到全部中心的内积
+    struct Quantizer {
+        const float* rows = nullptr;  // k × dim，行优先
+        size_t k = 0;
+        size_t dim = 0;
+        std::vector<float> norms;     // |c|²
+        std::vector<float> cols;      // dim × k，仅低维时使用
+
+        void build(const float* centroids, size_t k, size_t dim);
+        // out[c] = x·c，out 至少 k 个元素
+        void inner_products(const float* x, float* out) const;
+        // L2 最近的中心，scratch 至少 k 个元素
+        size_t nearest(const float* x, float* scratch) const;
+    };
+
+private:
+    struct InvertedList {
+        rag::MappedArray<uint32_t> rows;  // 桶内向量的行号
+        rag::MappedArray<uint8_t> codes;  // PQ 码，按 distance::kAdcBlock 行一块转置存放，末块不足的部分补0
+    };
+
+    bool has_floats() const { return floats_.size() == ids_.size(); }
+    size_t ksub() const { return size_t(1) << nbits_; }
+
+    // 用全部已插入的向量训练中心并编码
+    void train();
+    // 单位向量在第 list 个桶中的残差 -> 行优先的 PQ 码（code_size_ 字节），scratch 为临时空间
+    void encode(const float* unit, size_t list, uint8_t* code, std::vector<float>& scratch) const;
+    void append(size_t list, uint32_t row, const uint8_t* code);
+    void build_quantizers();
+
+    rag::IVFPQConfig config_;
+    size_t rerank_factor_;
+    double filter_brute_force_ratio_;
+    size_t nlist_ = 0;             // 实际的桶数，训练时确定（不超过训练行数）
+    size_t m_ = 0;                 // 实际的子空间数，第一次插入时确定
+    size_t nbits_;
+
+    size_t dim_ = 0;               // 第一次插入时确定
+    size_t dsub_ = 0;              // 子空间维度 dim_ / m_
+    size_t code_size_ = 0;         // 每个向量的码字节数 ceil(m_ * nbits_ / 8)
+    bool trained_ = false;
+    rag::VectorArena floats_;      // 单位化后的原始向量（不重排时训练后释放）
+    rag::MappedArray<float> centroids_;  // 桶中心，nlist_ × dim_
+    rag::MappedArray<float> codebooks_;  // 子空间中心，m_ × 2^nbits_ × dsub_
+    Quantizer coarse_;
+    std::vector<Quantizer> pq_;
+    std::vector<InvertedList> lists_;
+    rag::MappedArray<uint64_t> ids_;
+    ItemColumn items_;                              // 插入时传入的非空元数据
+    rag::Tombstones tombstones_;                    // 已删除的行
+    size_t reserved_ = 0;
+    std::shared_ptr<rag::ThreadPool> thread_pool_;
+    std::shared_ptr<const rag::MappedFile> mapping_;
+    std::shared_mutex mutex_;
+};
+
+} // namespace humanus
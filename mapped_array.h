@@ -0,0 +1,132 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace rag {
+
+// 按 Align 字节对齐分配的分配器，用于需要整行对齐的 SIMD 数据
+template <typename T, size_t Align>
+struct AlignedAllocator {
+    static_assert(Align >= alignof(T) && (Align & (Align - 1)) == 0, "Align 必须是2的幂且不小于 alignof(T)");
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = AlignedAllocator<U, Align>;
+    };
+
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Align>&) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Align))); }
+    void deallocate(T* p, size_t) { ::operator delete(p, std::align_val_t(Align)); }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Align>&) const { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, Align>&) const { return false; }
+};
+
+// 可以直接引用外部只读内存（mmap打开的快照）的数组
+// 读操作不区分两种状态；写操作通过 writable() 进行，引用外部内存时先复制为自有存储（写时复制）
+// 非线程安全，由使用方负责加锁
+template <typename T, typename Alloc = std::allocator<T>>
+class MappedArray {
+    static_assert(std::is_trivially_copyable<T>::value, "MappedArray 只能保存可按字节复制的类型");
+
+public:
+    MappedArray() = default;
+    MappedArray(std::initializer_list<T> init) : owned_(init) {}
+
+    // 引用外部内存，调用方保证其生命周期
+    void assign_view(const T* data, size_t n) {
+        std::vector<T, Alloc>().swap(owned_);
+        view_ = data;
+        view_size_ = n;
+        mapped_ = true;
+    }
+
+    bool mapped() const { return mapped_; }
+
+    const T* data() const { return mapped_ ? view_ : owned_.data(); }
+    size_t size() const { return mapped_ ? view_size_ : owned_.size(); }
+    bool empty() const { return size() == 0; }
+
+    const T& operator[](size_t i) const { return data()[i]; }
+    const T& back() const { return data()[size() - 1]; }
+    const T* begin() const { return data(); }
+    const T* end() const { return data() + size(); }
+
+    // 取得可修改的自有存储
+    std::vector<T, Alloc>& writable() {
+        if (mapped_) {
+            owned_.assign(view_, view_ + view_size_);
+            view_ = nullptr;
+            view_size_ = 0;
+            mapped_ = false;
+        }
+        return owned_;
+    }
+
+    void push_back(const T& v) { writable().push_back(v); }
+    void resize(size_t n) { writable().resize(n); }
+    void reserve(size_t n) { writable().reserve(n); }
+
+    void clear() {
+        owned_.clear();
+        view_ = nullptr;
+        view_size_ = 0;
+        mapped_ = false;
+    }
+
+    void shrink_to_fit() {
+        if (!mapped_) owned_.shrink_to_fit();
+    }
+
+    // 自有存储按容量计算；映射的数据位于页缓存，按实际大小计算
+    size_t memory_usage() const {
+        return mapped_ ? view_size_ * sizeof(T) : owned_.capacity() * sizeof(T);
+    }
+
+private:
+    std::vector<T, Alloc> owned_;
+    const T* view_ = nullptr;
+    size_t view_size_ = 0;
+    bool mapped_ = false;
+};
+
+// 字符串列：所有字符串首尾相接存放，offsets[i, i+1) 为第 i 个字符串的范围
+struct StringColumn {
+    MappedArray<uint64_t> offsets{0};
+    MappedArray<char> chars;
+
+    size_t size() const { return offsets.size() - 1; }
+    bool empty() const { return size() == 0; }
+
+    std::string_view operator[](size_t i) const {
+        return std::string_view(chars.data() + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+
+    void push_back(std::string_view s) {
+        auto &buf = chars.writable();
+        buf.insert(buf.end(), s.begin(), s.end());
+        offsets.push_back(buf.size());
+    }
+
+    void clear() {
+        offsets.clear();
+        offsets.push_back(0);
+        chars.clear();
+    }
+
+    size_t memory_usage() const { return offsets.memory_usage() + chars.memory_usage(); }
+};
+
+} // namespace rag
@@ -0,0 +1,170 @@
+#include "metadata_index.h"
+#include <iostream>
+
+namespace rag {
+
+MetadataFilter MetadataFilter::topic(const std::string& value) {
+    MetadataFilter f;
+    f.op_ = Op::TOPIC;
+    f.value_ = value;
+    return f;
+}
+
+MetadataFilter MetadataFilter::language(const std::string& value) {
+    MetadataFilter f;
+    f.op_ = Op::LANGUAGE;
+    f.value_ = value;
+    return f;
+}
+
+MetadataFilter MetadataFilter::doc_id(const std::string& value) {
+    MetadataFilter f;
+    f.op_ = Op::DOC_ID;
+    f.value_ = value;
+    return f;
+}
+
+MetadataFilter MetadataFilter::created_between(std::time_t from, std::time_t to) {
+    MetadataFilter f;
+    f.op_ = Op::CREATED_AT;
+    f.from_ = from;
+    f.to_ = to;
+    return f;
+}
+
+MetadataFilter MetadataFilter::operator&&(const MetadataFilter& other) const {
+    if (empty()) return other;
+    if (other.empty()) return *this;
+    MetadataFilter f;
+    f.op_ = Op::AND;
+    // 同类组合展开为一层
+    for (const MetadataFilter* src : {this, &other}) {
+        if (src->op_ == Op::AND) {
+            f.children_.insert(f.children_.end(), src->children_.begin(), src->children_.end());
+        } else {
+            f.children_.push_back(*src);
+        }
+    }
+    return f;
+}
+
+MetadataFilter MetadataFilter::operator||(const MetadataFilter& other) const {
+    if (empty() || other.empty()) return MetadataFilter();
+    MetadataFilter f;
+    f.op_ = Op::OR;
+    for (const MetadataFilter* src : {this, &other}) {
+        if (src->op_ == Op::OR) {
+            f.children_.insert(f.children_.end(), src->children_.begin(), src->children_.end());
+        } else {
+            f.children_.push_back(*src);
+        }
+    }
+    return f;
+}
+
+MetadataFilter MetadataFilter::operator!() const {
+    MetadataFilter f;
+    f.op_ = Op::NOT;
+    f.children_.push_back(*this);
+    return f;
+}
+
+void MetadataIndex::add(uint32_t doc, std::string_view topic, std::string_view language, std::string_view doc_id,
+                        std::time_t created_at) {
+    if (doc != created_at_.size()) {
+        std::cerr << "MetadataIndex: document " << doc << " added out of order (expected "
+                  << created_at_.size() << ")" << std::endl;
+        return;
+    }
+    topics_[std::string(topic)].add(doc);
+    languages_[std::string(language)].add(doc);
+    doc_ids_[std::string(doc_id)].add(doc);
+    int64_t t = static_cast<int64_t>(created_at);
+    time_buckets_[bucket_of(t)].add(doc);
+    created_at_.push_back(t);
+}
+
+void MetadataIndex::clear() {
+    topics_.clear();
+    languages_.clear();
+    doc_ids_.clear();
+    time_buckets_.clear();
+    created_at_.clear();
+}
+
+int64_t MetadataIndex::bucket_of(int64_t t) {
+    // 向下取整，负数时间也落在正确的桶
+    return t / kTimeBucket - (t % kTimeBucket < 0 ? 1 : 0);
+}
+
+DocBitmap MetadataIndex::time_range(int64_t from, int64_t to) const {
+    if (from >= to || created_at_.empty()) return DocBitmap();
+
+    // 各桶的文档下标互相交错，先写入按下标排列的位数组，再按升序生成位图
+    std::vector<uint64_t> words((created_at_.size() + 63) / 64, 0);
+    int64_t last = bucket_of(to - 1);
+    for (auto it = time_buckets_.lower_bound(bucket_of(from)); it != time_buckets_.end() && it->first <= last; ++it) {
+        int64_t begin = it->first * kTimeBucket;
+        bool inside = begin >= from && begin + kTimeBucket <= to;
+        it->second.for_each([&](uint32_t doc) {
+            if (inside || (created_at_[doc] >= from && created_at_[doc] < to)) {
+                words[doc >> 6] |= uint64_t(1) << (doc & 63);
+            }
+        });
+    }
+
+    DocBitmap result;
+    for (size_t w = 0; w < words.size(); ++w) {
+        for (uint64_t word = words[w]; word; word &= word - 1) {
+            result.add(static_cast<uint32_t>(w * 64 + __builtin_ctzll(word)));
+        }
+    }
+    return result;
+}
+
+DocBitmap MetadataIndex::evaluate(const MetadataFilter& filter) const {
+    using Op = MetadataFilter::Op;
+    auto lookup = [](const std::unordered_map<std::string, DocBitmap>& values, const std::string& value) {
+        auto it = values.find(value);
+        return it == values.end() ? DocBitmap() : it->second;
+    };
+
+    switch (filter.op_) {
+        case Op::TOPIC:
+            return lookup(topics_, filter.value_);
+        case Op::LANGUAGE:
+            return lookup(languages_, filter.value_);
+        case Op::DOC_ID:
+            return lookup(doc_ids_, filter.value_);
+        case Op::CREATED_AT:
+            return time_range(static_cast<int64_t>(filter.from_), static_cast<int64_t>(filter.to_));
+        case Op::AND: {
+            DocBitmap result = evaluate(filter.children_[0]);
+            for (size_t i = 1; i < filter.children_.size() && !result.empty(); ++i) {
+                result = result & evaluate(filter.children_[i]);
+            }
+            return result;
+        }
+        case Op::OR: {
+            DocBitmap result;
+            for (const auto &child : filter.children_) result = result | evaluate(child);
+            return result;
+        }
+        case Op::NOT:
+            return DocBitmap::all(static_cast<uint32_t>(size())).and_not(evaluate(filter.children_[0]));
+        case Op::ALL:
+        default:
+            return DocBitmap::all(static_cast<uint32_t>(size()));
+    }
+}
+
+size_t MetadataIndex::memory_usage() const {
+    size_t bytes = created_at_.capacity() * sizeof(int64_t);
+    for (const auto *values : {&topics_, &languages_, &doc_ids_}) {
+        for (const auto &[value, bitmap] : *values) bytes += value.capacity() + bitmap.memory_usage();
+    }
+    for (const auto &[bucket, bitmap] : time_buckets_) bytes += sizeof(bucket) + bitmap.memory_usage();
+    return bytes;
+}
+
+} // namespace rag
@@ -0,0 +1,84 @@
+#pragma once
+#include "doc_bitmap.h"
+#include <cstdint>
+#include <ctime>
+#include <limits>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace rag {
+
+// 元数据过滤条件：topic / language / doc_id 等值匹配、created_at 时间区间，可以用 && || ! 组合
+// 默认构造的条件不过滤任何文档
+//   auto filter = MetadataFilter::topic("ml") && !MetadataFilter::language("en");
+class MetadataFilter {
+public:
+    MetadataFilter() = default;
+
+    static MetadataFilter topic(const std::string& value);
+    static MetadataFilter language(const std::string& value);
+    static MetadataFilter doc_id(const std::string& value);
+    // created_at 位于 [from, to) 内
+    static MetadataFilter created_between(std::time_t from, std::time_t to);
+    static MetadataFilter created_after(std::time_t from) { return created_between(from, kMaxTime); }
+    static MetadataFilter created_before(std::time_t to) { return created_between(kMinTime, to); }
+
+    MetadataFilter operator&&(const MetadataFilter& other) const;
+    MetadataFilter operator||(const MetadataFilter& other) const;
+    MetadataFilter operator!() const;
+
+    // 是否不过滤任何文档
+    bool empty() const { return op_ == Op::ALL; }
+
+private:
+    friend class MetadataIndex;
+
+    static constexpr std::time_t kMinTime = std::numeric_limits<std::time_t>::min();
+    static constexpr std::time_t kMaxTime = std::numeric_limits<std::time_t>::max();
+
+    enum class Op { ALL, TOPIC, LANGUAGE, DOC_ID, CREATED_AT, AND, OR, NOT };
+
+    Op op_ = Op::ALL;
+    std::string value_;
+    std::time_t from_ = 0;
+    std::time_t to_ = 0;
+    std::vector<MetadataFilter> children_;
+};
+
+// 元数据倒排索引：每个 topic / language / doc_id 取值一个文档位图，created_at 按时间桶分组
+// 文档下标与 BM25Indexer 的文档下标（FusionRetriever 的 chunk 下标）一致，只能按下标顺序追加
+// 删除文档不修改索引，由检索侧的存活标记过滤
+// 非线程安全，由使用方（如 FusionRetriever）负责加锁
+class MetadataIndex {
+public:
+    // 追加文档，doc 必须等于当前的 size()
+    void add(uint32_t doc, std::string_view topic, std::string_view language, std::string_view doc_id,
+             std::time_t created_at);
+
+    void clear();
+
+    size_t size() const { return created_at_.size(); }
+
+    // 计算过滤条件匹配的文档；NOT 以 [0, size()) 为全集
+    DocBitmap evaluate(const MetadataFilter& filter) const;
+
+    size_t memory_usage() const;
+
+private:
+    // 时间桶宽度（秒）：区间完整覆盖的桶直接取位图，两端的桶逐个比较 created_at
+    static constexpr int64_t kTimeBucket = 3600;
+
+    static int64_t bucket_of(int64_t t);
+    DocBitmap time_range(int64_t from, int64_t to) const;
+
+    std::unordered_map<std::string, DocBitmap> topics_;
+    std::unordered_map<std::string, DocBitmap> languages_;
+    std::unordered_map<std::string, DocBitmap> doc_ids_;
+    std::map<int64_t, DocBitmap> time_buckets_;   // 时间桶 -> 文档
+    std::vector<int64_t> created_at_;             // 文档下标 -> created_at
+};
+
+} // namespace rag
@@ -0,0 +1,435 @@
+#include "posting_codec.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RAG_CODEC_X86 1
+#include <immintrin.h>
+#endif
+
+namespace rag {
+
+PostingCodec parse_posting_codec(const std::string& codec) {
+    if (codec == "raw") return PostingCodec::RAW;
+    if (codec == "varbyte") return PostingCodec::VARBYTE;
+    return PostingCodec::BITPACK;
+}
+
+const char* posting_codec_name(PostingCodec codec) {
+    switch (codec) {
+        case PostingCodec::RAW: return "raw";
+        case PostingCodec::VARBYTE: return "varbyte";
+        case PostingCodec::BITPACK:
+        default: return "bitpack";
+    }
+}
+
+namespace codec {
+
+namespace {
+
+constexpr size_t kPForValues = PostingList::kBlockSize;
+
+inline uint32_t load_u32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t bit_width(uint32_t v) {
+    return v ? 32 - __builtin_clz(v) : 0;
+}
+
+inline uint32_t low_mask(uint32_t b) {
+    return b >= 32 ? 0xFFFFFFFFu : (1u << b) - 1;
+}
+
+inline size_t varbyte_length(uint32_t v) {
+    size_t n = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        ++n;
+    }
+    return n;
+}
+
+bool detect_avx2() {
+#ifdef RAG_CODEC_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+const bool g_has_avx2 = detect_avx2();
+std::atomic<bool> g_simd_enabled{g_has_avx2};
+
+// 4路纵向布局：第 i 个值属于第 i % 4 路的第 i / 4 行，每路的值按位连续存放，
+// 4路的32位字交错排列。解码时一行的4个值位于相同的位偏移，可以整行移位
+void unpack_scalar(const uint8_t* packed, uint32_t b, uint32_t* out) {
+    if (b == 0) {
+        std::fill(out, out + kPForValues, 0u);
+        return;
+    }
+    const uint32_t mask = low_mask(b);
+    for (uint32_t i = 0; i < kPForValues; ++i) {
+        uint32_t lane = i & 3, row = i >> 2;
+        uint32_t p = row * b, k = p >> 5, sh = p & 31;
+        uint32_t v = load_u32(packed + 4 * (4 * k + lane)) >> sh;
+        if (sh + b > 32) v |= load_u32(packed + 4 * (4 * (k + 1) + lane)) << (32 - sh);
+        out[i] = v & mask;
+    }
+}
+
+void finish_scalar(uint32_t* out, bool prefix_sum, uint32_t base) {
+    if (prefix_sum) {
+        uint32_t acc = base;
+        for (size_t i = 0; i < kPForValues; ++i) {
+            acc += out[i] + 1;
+            out[i] = acc;
+        }
+    } else {
+        for (size_t i = 0; i < kPForValues; ++i) out[i] += 1;
+    }
+}
+
+#ifdef RAG_CODEC_X86
+// 每次处理两行（8个值）：两行的位偏移不同，用AVX2的逐lane变长移位一次完成
+__attribute__((target("avx2")))
+void unpack_avx2(const uint8_t* packed, uint32_t b, uint32_t* out) {
+    if (b == 0) {
+        std::fill(out, out + kPForValues, 0u);
+        return;
+    }
+    const __m256i mask = _mm256_set1_epi32(static_cast<int>(low_mask(b)));
+    const __m256i bits = _mm256_set1_epi32(32);
+    for (uint32_t r = 0; r < kPForValues / 4; r += 2) {
+        uint32_t p0 = r * b, p1 = (r + 1) * b;
+        uint32_t k0 = p0 >> 5, k1 = p1 >> 5;
+        int s0 = static_cast<int>(p0 & 31), s1 = static_cast<int>(p1 & 31);
+        __m256i w0 = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(packed + 16 * k0))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(packed + 16 * k1)), 1);
+        __m256i w1 = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(packed + 16 * (k0 + 1)))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(packed + 16 * (k1 + 1))), 1);
+        __m256i sh = _mm256_setr_epi32(s0, s0, s0, s0, s1, s1, s1, s1);
+        // 左移32位时 sllv 结果为0，值不跨字时高位部分自动消失
+        __m256i v = _mm256_or_si256(_mm256_srlv_epi32(w0, sh),
+                                    _mm256_sllv_epi32(w1, _mm256_sub_epi32(bits, sh)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 4 * r), _mm256_and_si256(v, mask));
+    }
+}
+
+__attribute__((target("avx2")))
+void finish_avx2(uint32_t* out, bool prefix_sum, uint32_t base) {
+    const __m256i one = _mm256_set1_epi32(1);
+    if (!prefix_sum) {
+        for (size_t i = 0; i < kPForValues; i += 8) {
+            __m256i* p = reinterpret_cast<__m256i*>(out + i);
+            _mm256_storeu_si256(p, _mm256_add_epi32(_mm256_loadu_si256(p), one));
+        }
+        return;
+    }
+    const __m256i lane3 = _mm256_set1_epi32(3);
+    const __m256i lane7 = _mm256_set1_epi32(7);
+    __m256i carry = _mm256_set1_epi32(static_cast<int>(base));
+    for (size_t i = 0; i < kPForValues; i += 8) {
+        __m256i* p = reinterpret_cast<__m256i*>(out + i);
+        __m256i x = _mm256_add_epi32(_mm256_loadu_si256(p), one);
+        // 两个128位半区内分别做前缀和，再把低半区的总和加到高半区
+        x = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+        x = _mm256_add_epi32(x, _mm256_slli_si256(x, 8));
+        __m256i low_total = _mm256_permutevar8x32_epi32(x, lane3);
+        x = _mm256_add_epi32(x, _mm256_blend_epi32(_mm256_setzero_si256(), low_total, 0xF0));
+        x = _mm256_add_epi32(x, carry);
+        _mm256_storeu_si256(p, x);
+        carry = _mm256_permutevar8x32_epi32(x, lane7);
+    }
+}
+#endif
+
+// 解析PFor段头部，解出低位并修补异常项，返回段结束位置
+template <typename Unpack>
+const uint8_t* decode_pfor_values(const uint8_t* in, uint32_t* out, Unpack unpack) {
+    uint32_t b = in[0];
+    uint32_t num_exceptions = in[1];
+    const uint8_t* packed = in + 2;
+    unpack(packed, b, out);
+
+    const uint8_t* positions = packed + 16 * b;
+    const uint8_t* p = positions + num_exceptions;
+    for (uint32_t e = 0; e < num_exceptions; ++e) {
+        uint32_t high;
+        p = decode_varbyte(p, 1, &high);
+        out[positions[e]] |= high << b;
+    }
+    return p;
+}
+
+} // namespace
+
+void encode_varbyte(const uint32_t* in, size_t n, std::vector<uint8_t>& out) {
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t v = in[i];
+        while (v >= 0x80) {
+            out.push_back(static_cast<uint8_t>(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(v));
+    }
+}
+
+const uint8_t* decode_varbyte(const uint8_t* in, size_t n, uint32_t* out) {
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t v = 0;
+        uint32_t shift = 0;
+        uint8_t byte;
+        do {
+            byte = *in++;
+            v |= static_cast<uint32_t>(byte & 0x7F) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        out[i] = v;
+    }
+    return in;
+}
+
+void encode_pfor(const uint32_t* in, std::vector<uint8_t>& out) {
+    // 选择总字节数最小的位宽：低位统一位压缩，超出位宽的高位作为异常项
+    uint32_t best_b = 32;
+    size_t best_cost = 16 * 32;
+    for (uint32_t b = 0; b < 32; ++b) {
+        size_t cost = 16 * b;
+        for (size_t i = 0; i < kPForValues && cost < best_cost; ++i) {
+            if (bit_width(in[i]) > b) cost += 1 + varbyte_length(in[i] >> b);
+        }
+        if (cost < best_cost) {
+            best_cost = cost;
+            best_b = b;
+        }
+    }
+
+    const uint32_t b = best_b;
+    const uint32_t mask = low_mask(b);
+    uint32_t words[4 * 32] = {0};
+    std::vector<uint8_t> positions;
+    std::vector<uint32_t> highs;
+    for (uint32_t i = 0; i < kPForValues; ++i) {
+        uint32_t v = in[i];
+        if (bit_width(v) > b) {
+            positions.push_back(static_cast<uint8_t>(i));
+            highs.push_back(v >> b);
+        }
+        if (b == 0) continue;
+        uint32_t lo = v & mask;
+        uint32_t lane = i & 3, row = i >> 2;
+        uint32_t p = row * b, k = p >> 5, sh = p & 31;
+        words[4 * k + lane] |= lo << sh;
+        if (sh + b > 32) words[4 * (k + 1) + lane] |= lo >> (32 - sh);
+    }
+
+    out.push_back(static_cast<uint8_t>(b));
+    out.push_back(static_cast<uint8_t>(positions.size()));
+    size_t at = out.size();
+    out.resize(at + 16 * b);
+    std::memcpy(out.data() + at, words, 16 * b);
+    out.insert(out.end(), positions.begin(), positions.end());
+    encode_varbyte(highs.data(), highs.size(), out);
+}
+
+const uint8_t* decode_pfor_scalar(const uint8_t* in, uint32_t* out, bool prefix_sum, uint32_t base) {
+    const uint8_t* end = decode_pfor_values(in, out, unpack_scalar);
+    finish_scalar(out, prefix_sum, base);
+    return end;
+}
+
+const uint8_t* decode_pfor(const uint8_t* in, uint32_t* out, bool prefix_sum, uint32_t base) {
+#ifdef RAG_CODEC_X86
+    if (g_simd_enabled.load(std::memory_order_relaxed)) {
+        const uint8_t* end = decode_pfor_values(in, out, unpack_avx2);
+        finish_avx2(out, prefix_sum, base);
+        return end;
+    }
+#endif
+    return decode_pfor_scalar(in, out, prefix_sum, base);
+}
+
+bool simd_enabled() {
+    return g_simd_enabled.load(std::memory_order_relaxed);
+}
+
+void set_simd_enabled(bool enabled) {
+    g_simd_enabled.store(enabled && g_has_avx2, std::memory_order_relaxed);
+}
+
+} // namespace codec
+
+void PostingList::append(uint32_t doc, uint32_t tf) {
+    if (sealed_tail_) {
+        // 把已编码的尾块解回未压缩形式，继续追加
+        size_t b = blocks_.size() - 1;
+        size_t n = block_length(b);
+        uint32_t docs[kBlockSize];
+        uint32_t tfs[kBlockSize];
+        decode_docs(b, docs);
+        decode_tfs(b, tfs);
+        tail_.clear();
+        for (size_t i = 0; i < n; ++i) tail_.push_back({docs[i], tfs[i]});
+
+        auto &bytes = bytes_.writable();
+        bytes.resize(blocks_.back().doc_offset);
+        if (padded_) bytes.resize(bytes.size() + codec::kPadding, 0);
+        blocks_.writable().pop_back();
+        sealed_tail_ = false;
+    }
+
+    tail_.push_back({doc, tf});
+    ++size_;
+    if (tail_.size() == kBlockSize) {
+        encode_block(tail_.data(), kBlockSize);
+        tail_.clear();
+    }
+}
+
+void PostingList::seal() {
+    if (tail_.empty()) return;
+    encode_block(tail_.data(), tail_.size());
+    sealed_tail_ = true;
+    std::vector<Posting>().swap(tail_);
+}
+
+void PostingList::clear() {
+    size_ = 0;
+    bytes_.clear();
+    blocks_.clear();
+    tail_.clear();
+    sealed_tail_ = false;
+    padded_ = false;
+}
+
+void PostingList::shrink_to_fit() {
+    bytes_.shrink_to_fit();
+    blocks_.shrink_to_fit();
+    tail_.shrink_to_fit();
+}
+
+size_t PostingList::block_length(size_t b) const {
+    return std::min(kBlockSize, size_ - b * kBlockSize);
+}
+
+uint32_t PostingList::block_base(size_t b) const {
+    // 第一块以 -1 为基准，解码时 base + (gap + 1) 回绕得到第一个文档下标
+    return b == 0 ? UINT32_MAX : blocks_[b - 1].last_doc;
+}
+
+void PostingList::encode_block(const Posting* postings, size_t n) {
+    uint32_t values[kBlockSize];
+    auto &bytes = bytes_.writable();
+    if (padded_) bytes.resize(bytes.size() - codec::kPadding);
+    padded_ = padded_ || (codec_ == PostingCodec::BITPACK && n == kBlockSize);
+
+    BlockRef ref;
+    ref.doc_offset = static_cast<uint32_t>(bytes.size());
+    uint32_t prev = block_base(blocks_.size());
+    for (size_t i = 0; i < n; ++i) {
+        values[i] = codec_ == PostingCodec::RAW ? postings[i].doc : postings[i].doc - prev - 1;
+        prev = postings[i].doc;
+    }
+    if (codec_ == PostingCodec::RAW) {
+        size_t at = bytes.size();
+        bytes.resize(at + n * sizeof(uint32_t));
+        std::memcpy(bytes.data() + at, values, n * sizeof(uint32_t));
+    } else if (codec_ == PostingCodec::BITPACK && n == kBlockSize) {
+        codec::encode_pfor(values, bytes);
+    } else {
+        codec::encode_varbyte(values, n, bytes);
+    }
+
+    ref.tf_offset = static_cast<uint32_t>(bytes.size());
+    for (size_t i = 0; i < n; ++i) {
+        values[i] = codec_ == PostingCodec::RAW ? postings[i].tf : postings[i].tf - 1;
+    }
+    if (codec_ == PostingCodec::RAW) {
+        size_t at = bytes.size();
+        bytes.resize(at + n * sizeof(uint32_t));
+        std::memcpy(bytes.data() + at, values, n * sizeof(uint32_t));
+    } else if (codec_ == PostingCodec::BITPACK && n == kBlockSize) {
+        codec::encode_pfor(values, bytes);
+    } else {
+        codec::encode_varbyte(values, n, bytes);
+    }
+
+    ref.last_doc = postings[n - 1].doc;
+    blocks_.push_back(ref);
+    if (padded_) bytes.resize(bytes.size() + codec::kPadding, 0);
+}
+
+size_t PostingList::decode_docs(size_t b, uint32_t* docs) const {
+    size_t n = block_length(b);
+    if (b >= blocks_.size()) {
+        for (size_t i = 0; i < n; ++i) docs[i] = tail_[i].doc;
+        return n;
+    }
+
+    const uint8_t* p = bytes_.data() + blocks_[b].doc_offset;
+    if (codec_ == PostingCodec::RAW) {
+        std::memcpy(docs, p, n * sizeof(uint32_t));
+    } else if (codec_ == PostingCodec::BITPACK && n == kBlockSize) {
+        codec::decode_pfor(p, docs, true, block_base(b));
+    } else {
+        codec::decode_varbyte(p, n, docs);
+        uint32_t acc = block_base(b);
+        for (size_t i = 0; i < n; ++i) {
+            acc += docs[i] + 1;
+            docs[i] = acc;
+        }
+    }
+    return n;
+}
+
+void PostingList::decode_tfs(size_t b, uint32_t* tfs) const {
+    size_t n = block_length(b);
+    if (b >= blocks_.size()) {
+        for (size_t i = 0; i < n; ++i) tfs[i] = tail_[i].tf;
+        return;
+    }
+
+    const uint8_t* p = bytes_.data() + blocks_[b].tf_offset;
+    if (codec_ == PostingCodec::RAW) {
+        std::memcpy(tfs, p, n * sizeof(uint32_t));
+    } else if (codec_ == PostingCodec::BITPACK && n == kBlockSize) {
+        codec::decode_pfor(p, tfs, false, 0);
+    } else {
+        codec::decode_varbyte(p, n, tfs);
+        for (size_t i = 0; i < n; ++i) tfs[i] += 1;
+    }
+}
+
+std::vector<Posting> PostingList::to_vector() const {
+    std::vector<Posting> out;
+    out.reserve(size_);
+    for_each([&](uint32_t doc, uint32_t tf) { out.push_back({doc, tf}); });
+    return out;
+}
+
+size_t PostingList::memory_usage() const {
+    return bytes_.memory_usage() + blocks_.memory_usage() + tail_.capacity() * sizeof(Posting);
+}
+
+PostingList PostingList::view(PostingCodec codec, size_t size,
+                              const uint8_t* bytes, size_t num_bytes,
+                              const BlockRef* blocks, size_t num_blocks) {
+    PostingList list(codec);
+    list.size_ = size;
+    list.bytes_.assign_view(bytes, num_bytes);
+    list.blocks_.assign_view(blocks, num_blocks);
+    // seal() 之后所有条目都已编码：不满一块的条目在最后一个尾块中，满块存在时末尾带填充
+    list.sealed_tail_ = size % kBlockSize != 0;
+    list.padded_ = codec == PostingCodec::BITPACK && size >= kBlockSize;
+    return list;
+}
+
+} // namespace rag
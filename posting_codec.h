@@ -0,0 +1,129 @@
+#pragma once
+#include "mapped_array.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace rag {
+
+// 倒排表中的一项：文档下标 + 词频
+struct Posting {
+    uint32_t doc;
+    uint32_t tf;
+};
+
+// 倒排表压缩方式
+enum class PostingCodec {
+    RAW,      // 不压缩，每项8字节
+    VARBYTE,  // 差分 + 变长字节
+    BITPACK   // 差分 + PForDelta位压缩（满块），不满一块的尾块用变长字节
+};
+
+// 解析 BM25Config::posting_codec，未知取值回退为 BITPACK
+PostingCodec parse_posting_codec(const std::string& codec);
+const char* posting_codec_name(PostingCodec codec);
+
+// 块编解码，供 PostingList 和基准测试使用
+namespace codec {
+
+// 编码区末尾预留的字节数：SIMD解码会越界读取最多16字节
+constexpr size_t kPadding = 16;
+
+// 变长字节：每字节7位，最高位表示后面还有字节
+void encode_varbyte(const uint32_t* in, size_t n, std::vector<uint8_t>& out);
+const uint8_t* decode_varbyte(const uint8_t* in, size_t n, uint32_t* out);
+
+// PForDelta：128个值按4路纵向布局位压缩，超出位宽的值作为异常项单独存储
+void encode_pfor(const uint32_t* in, std::vector<uint8_t>& out);
+
+// 解码128个值。prefix_sum 为 true 时输出 base + Σ(v + 1)（文档下标差分），否则输出 v + 1（词频）
+// 运行时检测CPU，支持AVX2时使用SIMD实现
+const uint8_t* decode_pfor(const uint8_t* in, uint32_t* out, bool prefix_sum, uint32_t base);
+const uint8_t* decode_pfor_scalar(const uint8_t* in, uint32_t* out, bool prefix_sum, uint32_t base);
+
+// 当前CPU是否使用SIMD解码；set_simd_enabled(false) 强制走标量实现（用于对比测试）
+bool simd_enabled();
+void set_simd_enabled(bool enabled);
+
+} // namespace codec
+
+// 块压缩的倒排表
+// 每 kBlockSize 项为一块，块内文档下标差分编码，可以按块独立解码
+// 追加时未满一块的尾部条目暂存为未压缩形式，seal() 后同样编码
+// 编码数据可以直接引用快照的映射内存，追加时再复制为自有存储
+class PostingList {
+public:
+    static constexpr size_t kBlockSize = 128;
+
+    // 已编码块的位置
+    struct BlockRef {
+        uint32_t doc_offset;  // 文档下标段在编码数据中的起始位置
+        uint32_t tf_offset;   // 词频段在编码数据中的起始位置
+        uint32_t last_doc;    // 块内最大文档下标，也是下一块的差分基准
+    };
+
+    explicit PostingList(PostingCodec codec = PostingCodec::RAW) : codec_(codec) {}
+
+    // 引用外部的编码数据（由 encoded_bytes() / block_refs() 保存得到），调用方保证其生命周期
+    static PostingList view(PostingCodec codec, size_t size,
+                            const uint8_t* bytes, size_t num_bytes,
+                            const BlockRef* blocks, size_t num_blocks);
+
+    PostingCodec codec() const { return codec_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    size_t num_blocks() const { return (size_ + kBlockSize - 1) / kBlockSize; }
+
+    // 追加一项，doc 必须严格递增；凑满一块时立即编码
+    void append(uint32_t doc, uint32_t tf);
+
+    // 编码尾部不足一块的条目，之后仍可继续 append
+    void seal();
+
+    void clear();
+    void shrink_to_fit();
+
+    // 解码第 b 块的文档下标，返回块内条目数
+    size_t decode_docs(size_t b, uint32_t* docs) const;
+
+    // 解码第 b 块的词频
+    void decode_tfs(size_t b, uint32_t* tfs) const;
+
+    // 按文档升序遍历所有条目
+    template <typename F>
+    void for_each(F&& f) const {
+        uint32_t docs[kBlockSize];
+        uint32_t tfs[kBlockSize];
+        for (size_t b = 0; b < num_blocks(); ++b) {
+            size_t n = decode_docs(b, docs);
+            decode_tfs(b, tfs);
+            for (size_t i = 0; i < n; ++i) f(docs[i], tfs[i]);
+        }
+    }
+
+    std::vector<Posting> to_vector() const;
+
+    // 占用的内存字节数（编码数据 + 块索引 + 未编码尾部）
+    size_t memory_usage() const;
+
+    // 编码数据与块索引，用于保存快照；调用前需先 seal()
+    bool sealed() const { return tail_.empty(); }
+    const MappedArray<uint8_t>& encoded_bytes() const { return bytes_; }
+    const MappedArray<BlockRef>& block_refs() const { return blocks_; }
+
+private:
+    size_t block_length(size_t b) const;
+    uint32_t block_base(size_t b) const;
+    void encode_block(const Posting* postings, size_t n);
+
+    PostingCodec codec_;
+    size_t size_ = 0;
+    MappedArray<uint8_t> bytes_;     // 已编码的块，含PFor块时末尾保留 codec::kPadding 字节
+    MappedArray<BlockRef> blocks_;
+    std::vector<Posting> tail_;      // 未编码的尾部条目
+    bool sealed_tail_ = false;       // 最后一个已编码块是否为不满一块的尾块
+    bool padded_ = false;            // bytes_ 末尾是否有填充（只有PFor解码需要）
+};
+
+} // namespace rag
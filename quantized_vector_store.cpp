@@ -0,0 +1,279 @@
+#include "quantized_vector_store.h"
+#include "distance.h"
+#include "top_k.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <mutex>
+
+namespace humanus {
+
+QuantizedVectorStore::QuantizedVectorStore(const rag::VectorConfig& config)
+    : rerank_factor_(static_cast<size_t>(std::max(config.rerank_factor, 0))) {
+}
+
+void QuantizedVectorStore::reset() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    dim_ = 0;
+    code_stride_ = 0;
+    trained_rows_ = 0;
+    floats_ = rag::VectorArena();
+    codes_.clear();
+    norms_.clear();
+    scale_.clear();
+    offset_.clear();
+    ids_.clear();
+    items_.clear();
+    tombstones_.clear();
+    reserved_ = 0;
+    mapping_.reset();
+}
+
+void QuantizedVectorStore::reserve(size_t n) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    reserved_ = n;
+    if (dim_ == 0) return;
+    ids_.reserve(n);
+    norms_.reserve(n);
+    if (trained_rows_ > 0) codes_.reserve(n * code_stride_);
+    if (rerank_factor_ > 0) {
+        floats_.reserve(n);
+    } else if (trained_rows_ == 0) {
+        floats_.reserve(std::min(n, kMinTrainRows));
+    }
+}
+
+std::shared_ptr<VectorStore> QuantizedVectorStore::clone_empty() {
+    rag::VectorConfig config;
+    config.rerank_factor = static_cast<int>(rerank_factor_);
+    return std::make_shared<QuantizedVectorStore>(config);
+}
+
+void QuantizedVectorStore::encode(const float* vector, int8_t* out) const {
+    for (size_t d = 0; d < dim_; ++d) {
+        float code = std::nearbyint((vector[d] - offset_[d]) / scale_[d]);
+        out[d] = static_cast<int8_t>(std::clamp(code, -127.0f, 127.0f));
+    }
+}
+
+void QuantizedVectorStore::train() {
+    size_t n = ids_.size();
+    std::vector<float> lo(dim_, std::numeric_limits<float>::max());
+    std::vector<float> hi(dim_, std::numeric_limits<float>::lowest());
+    for (size_t row = 0; row < n; ++row) {
+        const float* v = floats_.row(row);
+        for (size_t d = 0; d < dim_; ++d) {
+            lo[d] = std::min(lo[d], v[d]);
+            hi[d] = std::max(hi[d], v[d]);
+        }
+    }
+
+    // [lo, hi] 映射到 [-127, 127]；取值恒定的维度 scale 取1，量化码全为0
+    auto &scale = scale_.writable();
+    auto &offset = offset_.writable();
+    scale.resize(dim_);
+    offset.resize(dim_);
+    for (size_t d = 0; d < dim_; ++d) {
+        offset[d] = (lo[d] + hi[d]) / 2;
+        scale[d] = hi[d] > lo[d] ? (hi[d] - lo[d]) / 254 : 1.0f;
+    }
+
+    auto &codes = codes_.writable();
+    codes.assign(n * code_stride_, 0);
+    codes.reserve(std::max(n, reserved_) * code_stride_);
+    for (size_t row = 0; row < n; ++row) encode(floats_.row(row), codes.data() + row * code_stride_);
+    trained_rows_ = n;
+
+    if (rerank_factor_ == 0) floats_ = rag::VectorArena();
+}
+
+void QuantizedVectorStore::insert(const std::vector<float>& vector, size_t vector_id, const MemoryItem& metadata) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (ids_.empty()) {
+        dim_ = vector.size();
+        code_stride_ = (dim_ + rag::VectorArena::kAlignment - 1) / rag::VectorArena::kAlignment *
+                       rag::VectorArena::kAlignment;
+        floats_.reset(dim_);
+        trained_rows_ = 0;
+        ids_.reserve(reserved_);
+        norms_.reserve(reserved_);
+        floats_.reserve(rerank_factor_ > 0 ? reserved_ : std::min(reserved_, kMinTrainRows));
+    }
+    if (vector.size() != dim_) {
+        std::cerr << "QuantizedVectorStore: dimension mismatch (" << vector.size()
+                  << " vs " << dim_ << "), vector " << vector_id << " ignored" << std::endl;
+        return;
+    }
+
+    size_t row = ids_.size();
+    if (has_floats()) floats_.append(vector.data());
+    norms_.push_back(std::sqrt(rag::distance::dot(vector.data(), vector.data(), dim_)));
+    ids_.push_back(vector_id);
+    tombstones_.on_insert(row, vector_id);
+    items_.set(row, metadata);
+
+    if (trained_rows_ > 0) {
+        auto &codes = codes_.writable();
+        codes.resize(codes.size() + code_stride_, 0);
+        encode(vector.data(), codes.data() + row * code_stride_);
+    }
+
+    size_t n = ids_.size();
+    if ((trained_rows_ == 0 && n >= kMinTrainRows) || (trained_rows_ > 0 && has_floats() && n >= 2 * trained_rows_)) {
+        train();
+    }
+}
+
+std::vector<MemoryItem> QuantizedVectorStore::search(const std::vector<float>& query, size_t limit,
+                                                     const rag::DocBitmap* filter) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (ids_.empty() || limit == 0) return {};
+    if (query.size() != dim_) {
+        std::cerr << "QuantizedVectorStore: query dimension mismatch (" << query.size()
+                  << " vs " << dim_ << ")" << std::endl;
+        return {};
+    }
+
+    auto skip = [&](size_t row) {
+        if (tombstones_.deleted(row)) return true;
+        return filter && (ids_[row] > UINT32_MAX || !filter->contains(static_cast<uint32_t>(ids_[row])));
+    };
+    float query_norm = std::sqrt(rag::distance::dot(query.data(), query.data(), dim_));
+    auto exact = [&](size_t row) {
+        float norm = norms_[row];
+        if (query_norm <= 0 || norm <= 0) return 0.0;
+        return static_cast<double>(rag::distance::dot(query.data(), floats_.row(row), dim_)) / (query_norm * norm);
+    };
+
+    std::vector<std::pair<size_t, double>> ranked;
+    if (trained_rows_ == 0) {
+        // 尚未训练：原始向量精确检索
+        rag::TopK<size_t> top(limit);
+        for (size_t row = 0; row < ids_.size(); ++row) {
+            if (!skip(row)) top.push(row, exact(row));
+        }
+        ranked = top.take_sorted();
+    } else {
+        // q·x ≈ Σ q[d] * offset[d] + Σ (q[d] * scale[d]) * code[d]，后一项把 q[d] * scale[d] 量化为 int8 后做整数内积
+        std::vector<float> weights(dim_);
+        float max_weight = 0.0f;
+        for (size_t d = 0; d < dim_; ++d) {
+            weights[d] = query[d] * scale_[d];
+            max_weight = std::max(max_weight, std::fabs(weights[d]));
+        }
+        float step = max_weight / 127;
+        std::vector<int8_t> qcode(dim_, 0);
+        if (step > 0) {
+            for (size_t d = 0; d < dim_; ++d) qcode[d] = static_cast<int8_t>(std::nearbyint(weights[d] / step));
+        }
+        float bias = rag::distance::dot(query.data(), offset_.data(), dim_);
+
+        bool rerank = rerank_factor_ > 0 && has_floats();
+        rag::TopK<size_t> top(rerank ? limit * rerank_factor_ : limit);
+        for (size_t row = 0; row < ids_.size(); ++row) {
+            if (skip(row)) continue;
+            float norm = norms_[row];
+            double score = 0.0;
+            if (query_norm > 0 && norm > 0) {
+                score = (bias + step * rag::distance::dot_i8(qcode.data(), code_at(row), dim_)) / (query_norm * norm);
+            }
+            top.push(row, score);
+        }
+        ranked = top.take_sorted();
+
+        if (rerank) {
+            rag::TopK<size_t> exact_top(limit);
+            for (const auto &[row, approx] : ranked) exact_top.push(row, exact(row));
+            ranked = exact_top.take_sorted();
+        }
+    }
+
+    return items_.collect(ranked, ids_);
+}
+
+bool QuantizedVectorStore::remove(size_t vector_id) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    size_t row = tombstones_.remove(vector_id, ids_);
+    if (row == rag::Tombstones::kNone) return false;
+    items_.erase(row);
+    return true;
+}
+
+size_t QuantizedVectorStore::size() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return ids_.size() - tombstones_.count();
+}
+
+size_t QuantizedVectorStore::memory_usage() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return codes_.memory_usage() + norms_.memory_usage() + scale_.memory_usage() +
+           offset_.memory_usage() + ids_.memory_usage() + tombstones_.memory_usage() +
+           items_.memory_usage();
+}
+
+size_t QuantizedVectorStore::float_bytes() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return floats_.memory_usage();
+}
+
+bool QuantizedVectorStore::save_snapshot(rag::SnapshotWriter& writer) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    writer.write<uint64_t>(dim_);
+    writer.write<uint64_t>(code_stride_);
+    writer.write<uint64_t>(trained_rows_);
+    writer.write_array(ids_);
+    writer.write_array(norms_);
+    writer.write_array(scale_);
+    writer.write_array(offset_);
+    writer.write_array(codes_);
+    writer.write<uint8_t>(has_floats() ? 1 : 0);
+    if (has_floats()) floats_.save(writer);
+    tombstones_.save(writer);
+    return writer.ok();
+}
+
+bool QuantizedVectorStore::load_snapshot(rag::SectionReader& reader) {
+    uint64_t dim = 0, stride = 0, trained = 0;
+    uint8_t with_floats = 0;
+    rag::MappedArray<uint64_t> ids;
+    rag::MappedArray<float> norms, scale, offset;
+    rag::MappedArray<int8_t, rag::AlignedAllocator<int8_t, rag::VectorArena::kAlignment>> codes;
+    rag::VectorArena floats;
+    rag::Tombstones tombstones;
+    bool ok = reader.read(dim) && reader.read(stride) && reader.read(trained) && reader.read_array(ids) &&
+              reader.read_array(norms) && reader.read_array(scale) && reader.read_array(offset) &&
+              reader.read_array(codes) && reader.read(with_floats) && (!with_floats || floats.load(reader));
+    size_t n = ids.size();
+    ok = ok && norms.size() == n && stride >= dim && stride % rag::VectorArena::kAlignment == 0;
+    if (ok && trained > 0) {
+        ok = scale.size() == dim && offset.size() == dim && codes.size() == n * stride;
+    }
+    if (ok && (with_floats || trained == 0)) {
+        ok = floats.size() == n && floats.dim() == dim;
+    }
+    ok = ok && tombstones.load(reader, n);
+    if (!ok) {
+        reader.fail();
+        std::cerr << "QuantizedVectorStore: corrupt vector snapshot section" << std::endl;
+        return false;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    dim_ = dim;
+    code_stride_ = stride;
+    trained_rows_ = trained;
+    ids_ = std::move(ids);
+    norms_ = std::move(norms);
+    scale_ = std::move(scale);
+    offset_ = std::move(offset);
+    codes_ = std::move(codes);
+    floats_ = std::move(floats);
+    tombstones_ = std::move(tombstones);
+    items_.clear();
+    reserved_ = 0;
+    mapping_ = reader.file();
+    return true;
+}
+
+} // namespace humanus
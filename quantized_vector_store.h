@@ -0,0 +1,70 @@
+#pragma once
+#include "config.h"
+#include "mapped_array.h"
+#include "tombstones.h"
+#include "vector_arena.h"
+#include "vector_store.h"
+#include <cstdint>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace humanus {
+
+// 标量量化（SQ8）暴力检索：每个分量按维度线性映射为 int8，x ≈ offset[d] + scale[d] * code，向量内存减为 1/4
+// 检索时把 q[d] * scale[d] 同样量化为 int8，用 int8 SIMD 内积对全部行近似打分，
+// 取 limit * rerank_factor 个候选，再用 float32 原始向量精确计算余弦相似度重排
+// 量化参数取每维的最小/最大值：行数达到 kMinTrainRows 时首次训练，之后行数每增长一倍用原始向量重新训练并重新编码，
+// 训练之前直接用原始向量精确检索
+// rerank_factor 为 0 时不重排，首次训练后释放原始向量，之后插入的向量按已有参数截断量化
+// 快照同时保存量化码与原始向量，打开后原始向量留在映射文件中，只有重排访问到的行会读入内存
+class QuantizedVectorStore : public VectorStore {
+public:
+    static constexpr size_t kMinTrainRows = 1024;
+
+    explicit QuantizedVectorStore(const rag::VectorConfig& config = rag::VectorConfig{});
+
+    void reset() override;
+    void insert(const std::vector<float>& vector, size_t vector_id, const MemoryItem& metadata) override;
+    std::vector<MemoryItem> search(const std::vector<float>& query, size_t limit,
+                                   const rag::DocBitmap* filter = nullptr) override;
+    void reserve(size_t n) override;
+    std::shared_ptr<VectorStore> clone_empty() override;
+    VectorIndexKind kind() const override { return VectorIndexKind::INT8; }
+    // 删除的行只做标记，检索时跳过，重建前不回收
+    bool remove(size_t vector_id) override;
+
+    bool save_snapshot(rag::SnapshotWriter& writer) override;
+    bool load_snapshot(rag::SectionReader& reader) override;
+
+    size_t size();
+    // 量化码、模长、ID 与量化参数的字节数；原始向量单独统计
+    size_t memory_usage();
+    size_t float_bytes();
+
+private:
+    const int8_t* code_at(size_t row) const { return codes_.data() + row * code_stride_; }
+    bool has_floats() const { return floats_.size() == ids_.size(); }
+
+    // 用全部原始向量训练量化参数并重新编码
+    void train();
+    void encode(const float* vector, int8_t* out) const;
+
+    size_t rerank_factor_;
+    size_t dim_ = 0;                 // 第一次插入时确定
+    size_t code_stride_ = 0;         // 每行量化码字节数，补齐到64字节
+    size_t trained_rows_ = 0;        // 上次训练时的行数，0 表示尚未训练
+    rag::VectorArena floats_;        // 原始向量（不重排时训练后释放）
+    rag::MappedArray<int8_t, rag::AlignedAllocator<int8_t, rag::VectorArena::kAlignment>> codes_;
+    rag::MappedArray<float> norms_;  // 原始向量的模长
+    rag::MappedArray<float> scale_;
+    rag::MappedArray<float> offset_;
+    rag::MappedArray<uint64_t> ids_;
+    ItemColumn items_;                              // 插入时传入的非空元数据
+    rag::Tombstones tombstones_;                    // 已删除的行
+    size_t reserved_ = 0;
+    std::shared_ptr<const rag::MappedFile> mapping_;
+    std::shared_mutex mutex_;
+};
+
+} // namespace humanus
@@ -0,0 +1,224 @@
+#include "snapshot.h"
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rag {
+
+namespace {
+
+constexpr char kMagic[8] = {'R', 'A', 'G', 'S', 'N', 'A', 'P', '\0'};
+
+// 按本机字节序写入，读取时用于检查字节序是否一致
+constexpr uint32_t kEndianMark = 0x01020304;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    uint64_t table_offset;   // 段表位置
+    uint64_t section_count;
+    uint64_t file_size;
+    uint8_t reserved[24];
+};
+static_assert(sizeof(FileHeader) == kSnapshotAlignment, "文件头占一个对齐单位");
+
+struct TableEntry {
+    uint32_t tag;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+} // namespace
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "MappedFile: cannot open " << path << ": " << std::strerror(errno) << std::endl;
+        return nullptr;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+        std::cerr << "MappedFile: cannot stat or empty file " << path << std::endl;
+        ::close(fd);
+        return nullptr;
+    }
+
+    size_t size = static_cast<size_t>(st.st_size);
+    void* addr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);  // 映射建立后不再需要文件描述符
+    if (addr == MAP_FAILED) {
+        std::cerr << "MappedFile: mmap failed for " << path << ": " << std::strerror(errno) << std::endl;
+        return nullptr;
+    }
+    return std::shared_ptr<MappedFile>(new MappedFile(static_cast<const uint8_t*>(addr), size));
+}
+
+MappedFile::~MappedFile() {
+    ::munmap(const_cast<uint8_t*>(data_), size_);
+}
+
+SnapshotWriter::SnapshotWriter(const std::string& path)
+    : path_(path), tmp_path_(path + ".tmp") {
+    out_.open(tmp_path_, std::ios::binary | std::ios::trunc);
+    if (!out_) {
+        std::cerr << "SnapshotWriter: cannot create " << tmp_path_ << std::endl;
+        ok_ = false;
+        return;
+    }
+    // 先占位，finish() 时回填
+    FileHeader header{};
+    put(&header, sizeof(header));
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    if (!finished_) {
+        out_.close();
+        std::remove(tmp_path_.c_str());
+    }
+}
+
+void SnapshotWriter::begin_section(SnapshotSection tag) {
+    align(kSnapshotAlignment);
+    sections_.push_back({static_cast<uint32_t>(tag), 0, pos_, 0});
+    in_section_ = true;
+}
+
+void SnapshotWriter::end_section() {
+    if (!in_section_) return;
+    sections_.back().size = pos_ - sections_.back().offset;
+    in_section_ = false;
+}
+
+void SnapshotWriter::align(size_t alignment) {
+    static const char zeros[kSnapshotAlignment] = {};
+    size_t pad = (alignment - pos_ % alignment) % alignment;
+    put(zeros, pad);
+}
+
+void SnapshotWriter::put(const void* data, size_t n) {
+    if (!ok_ || n == 0) return;
+    out_.write(static_cast<const char*>(data), static_cast<std::streamsize>(n));
+    if (!out_) {
+        std::cerr << "SnapshotWriter: write failed for " << tmp_path_ << std::endl;
+        ok_ = false;
+        return;
+    }
+    pos_ += n;
+}
+
+bool SnapshotWriter::finish() {
+    end_section();
+
+    align(kSnapshotAlignment);
+    uint64_t table_offset = pos_;
+    for (const auto &s : sections_) {
+        TableEntry entry{s.tag, 0, s.offset, s.size};
+        put(&entry, sizeof(entry));
+    }
+
+    FileHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kSnapshotVersion;
+    header.endian = kEndianMark;
+    header.table_offset = table_offset;
+    header.section_count = sections_.size();
+    header.file_size = pos_;
+    if (ok_) {
+        out_.seekp(0);
+        out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out_.flush();
+        ok_ = static_cast<bool>(out_);
+    }
+    out_.close();
+
+    if (ok_ && std::rename(tmp_path_.c_str(), path_.c_str()) != 0) {
+        std::cerr << "SnapshotWriter: cannot rename " << tmp_path_ << " to " << path_
+                  << ": " << std::strerror(errno) << std::endl;
+        ok_ = false;
+    }
+    if (!ok_) std::remove(tmp_path_.c_str());
+    finished_ = true;
+    return ok_;
+}
+
+const void* SectionReader::take(size_t alignment, size_t n) {
+    if (!ok_) return nullptr;
+    size_t at = (pos_ + alignment - 1) / alignment * alignment;
+    if (at > end_ || n > end_ - at) {
+        fail();
+        return nullptr;
+    }
+    pos_ = at + n;
+    return file_->data() + at;
+}
+
+bool SnapshotReader::open(const std::string& path) {
+    file_.reset();
+    sections_.clear();
+
+    auto file = MappedFile::open(path);
+    if (!file) return false;
+
+    FileHeader header;
+    if (file->size() < sizeof(header)) {
+        std::cerr << "SnapshotReader: " << path << " is too small" << std::endl;
+        return false;
+    }
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+        std::cerr << "SnapshotReader: " << path << " is not a snapshot file" << std::endl;
+        return false;
+    }
+    if (header.endian != kEndianMark) {
+        std::cerr << "SnapshotReader: " << path << " was written with a different byte order" << std::endl;
+        return false;
+    }
+    if (header.version != kSnapshotVersion) {
+        std::cerr << "SnapshotReader: unsupported snapshot version " << header.version
+                  << " (expected " << kSnapshotVersion << ")" << std::endl;
+        return false;
+    }
+    if (header.file_size != file->size() || header.table_offset > file->size() ||
+        header.section_count > (file->size() - header.table_offset) / sizeof(TableEntry)) {
+        std::cerr << "SnapshotReader: " << path << " is truncated or corrupt" << std::endl;
+        return false;
+    }
+
+    const uint8_t* table = file->data() + header.table_offset;
+    for (uint64_t i = 0; i < header.section_count; ++i) {
+        TableEntry entry;
+        std::memcpy(&entry, table + i * sizeof(entry), sizeof(entry));
+        if (entry.offset % kSnapshotAlignment != 0 || entry.offset > header.table_offset ||
+            entry.size > header.table_offset - entry.offset) {
+            std::cerr << "SnapshotReader: " << path << " has a corrupt section table" << std::endl;
+            return false;
+        }
+        sections_.push_back({entry.tag, entry.offset, entry.size});
+    }
+
+    file_ = std::move(file);
+    return true;
+}
+
+bool SnapshotReader::has_section(SnapshotSection tag) const {
+    for (const auto &s : sections_) {
+        if (s.tag == static_cast<uint32_t>(tag)) return true;
+    }
+    return false;
+}
+
+SectionReader SnapshotReader::section(SnapshotSection tag) const {
+    for (const auto &s : sections_) {
+        if (s.tag == static_cast<uint32_t>(tag)) return SectionReader(file_, s.offset, s.size);
+    }
+    return SectionReader();
+}
+
+} // namespace rag
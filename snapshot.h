@@ -0,0 +1,206 @@
+#pragma once
+#include "mapped_array.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace rag {
+
+// 快照文件格式（小端）：
+//   文件头(64字节) | 段 | 段 | ... | 段表
+// 每个段从64字节对齐处开始，段内按写入顺序依次存放：
+//   标量：8字节对齐
+//   数组：8字节元素个数 + 64字节对齐的连续数据
+// 打开时整个文件只读 mmap，数组直接以 MappedArray 视图引用映射内存，不做拷贝
+constexpr uint32_t kSnapshotVersion = 7;
+constexpr size_t kSnapshotAlignment = 64;
+
+// 段类型
+enum class SnapshotSection : uint32_t {
+    CHUNKS = 1,   // chunk 存储
+    BM25 = 2,     // BM25 索引
+    VECTORS = 3   // 向量数据
+};
+
+// 只读内存映射的文件
+class MappedFile {
+public:
+    // 打开失败时返回空指针并输出错误信息
+    static std::shared_ptr<MappedFile> open(const std::string& path);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    MappedFile(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+    const uint8_t* data_;
+    size_t size_;
+};
+
+// 顺序写入快照：先写入临时文件，finish() 成功后原子替换目标文件
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(const std::string& path);
+    ~SnapshotWriter();
+
+    bool ok() const { return ok_; }
+
+    void begin_section(SnapshotSection tag);
+    void end_section();
+
+    template <typename T>
+    void write(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "只能写入可按字节复制的类型");
+        align(sizeof(uint64_t));
+        put(&value, sizeof(T));
+    }
+
+    template <typename T>
+    void write_array(const T* values, size_t n) {
+        static_assert(std::is_trivially_copyable<T>::value, "只能写入可按字节复制的类型");
+        static_assert(alignof(T) <= kSnapshotAlignment, "元素对齐要求超过快照对齐");
+        write<uint64_t>(n);
+        align(kSnapshotAlignment);
+        put(values, n * sizeof(T));
+    }
+
+    template <typename T, typename Alloc>
+    void write_array(const MappedArray<T, Alloc>& values) { write_array(values.data(), values.size()); }
+
+    template <typename T>
+    void write_array(const std::vector<T>& values) { write_array(values.data(), values.size()); }
+
+    // 分多次写入一个数组：先声明元素总数，再依次追加，追加的元素总数必须与声明一致
+    void begin_array(size_t n) {
+        write<uint64_t>(n);
+        align(kSnapshotAlignment);
+    }
+
+    template <typename T>
+    void append(const T* values, size_t n) {
+        static_assert(std::is_trivially_copyable<T>::value, "只能写入可按字节复制的类型");
+        put(values, n * sizeof(T));
+    }
+
+    void write_strings(const StringColumn& column) {
+        write_array(column.offsets);
+        write_array(column.chars);
+    }
+
+    // 写入段表并更新文件头，成功后替换目标文件
+    bool finish();
+
+private:
+    struct SectionEntry {
+        uint32_t tag;
+        uint32_t reserved;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    void align(size_t alignment);
+    void put(const void* data, size_t n);
+
+    std::string path_;
+    std::string tmp_path_;
+    std::ofstream out_;
+    uint64_t pos_ = 0;
+    std::vector<SectionEntry> sections_;
+    bool in_section_ = false;
+    bool finished_ = false;
+    bool ok_ = true;
+};
+
+// 按写入顺序读取一个段，越界或格式错误时 ok() 变为 false，之后的读取全部失败
+class SectionReader {
+public:
+    SectionReader() = default;
+    SectionReader(std::shared_ptr<const MappedFile> file, size_t offset, size_t size)
+        : file_(std::move(file)), begin_(offset), end_(offset + size), pos_(offset), ok_(true) {}
+
+    bool ok() const { return ok_; }
+
+    // 映射的文件，加载出的视图需要持有它以保证映射有效
+    const std::shared_ptr<const MappedFile>& file() const { return file_; }
+
+    template <typename T>
+    bool read(T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "只能读取可按字节复制的类型");
+        const void* p = take(sizeof(uint64_t), sizeof(T));
+        if (!p) return false;
+        std::memcpy(&value, p, sizeof(T));
+        return true;
+    }
+
+    template <typename T, typename Alloc>
+    bool read_array(MappedArray<T, Alloc>& values) {
+        uint64_t n = 0;
+        if (!read(n)) return false;
+        if (n > (end_ - begin_) / sizeof(T)) return fail();
+        const void* p = take(kSnapshotAlignment, n * sizeof(T));
+        if (!p) return false;
+        values.assign_view(static_cast<const T*>(p), n);
+        return true;
+    }
+
+    bool read_strings(StringColumn& column) {
+        if (!read_array(column.offsets) || !read_array(column.chars)) return false;
+        // 偏移量必须从0开始单调不减且不超出字符区
+        const auto &offsets = column.offsets;
+        if (offsets.empty() || offsets[0] != 0 || offsets.back() != column.chars.size()) return fail();
+        for (size_t i = 1; i < offsets.size(); ++i) {
+            if (offsets[i] < offsets[i - 1]) return fail();
+        }
+        return true;
+    }
+
+    // 标记格式错误
+    bool fail() {
+        ok_ = false;
+        return false;
+    }
+
+private:
+    const void* take(size_t alignment, size_t n);
+
+    std::shared_ptr<const MappedFile> file_;
+    size_t begin_ = 0;
+    size_t end_ = 0;
+    size_t pos_ = 0;
+    bool ok_ = false;
+};
+
+// 打开快照文件并校验文件头与段表
+class SnapshotReader {
+public:
+    bool open(const std::string& path);
+
+    bool has_section(SnapshotSection tag) const;
+
+    // 不存在的段返回 ok() 为 false 的读取器
+    SectionReader section(SnapshotSection tag) const;
+
+    const std::shared_ptr<const MappedFile>& file() const { return file_; }
+
+private:
+    struct SectionRef {
+        uint32_t tag;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    std::shared_ptr<const MappedFile> file_;
+    std::vector<SectionRef> sections_;
+};
+
+} // namespace rag
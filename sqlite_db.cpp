@@ -3,12 +3,16 @@
  */
 
 #include "sqlite_db.h"
+#include "distance.h"
+#include "top_k.h"
 #include <iostream>
 #include <sstream>
 #include <algorithm>
 #include <ctime>
+#include <cstdint>
 #include <cstring>
-#include <unordered_set>
+#include <cmath>
+#include <unordered_map>
 #include <iomanip>
 
 namespace rag {
@@ -33,6 +37,11 @@ SQLiteDB::SQLiteDB(const SQLiteConfig& config)
         log_error("Failed to optimize database");
     }
 
+    // 注册内置向量函数
+    if (!register_vector_functions()) {
+        log_error("Failed to register vector functions");
+    }
+
     // 加载向量扩展
     if (!load_vector_extension()) {
         log_error("Failed to load vector extension");
@@ -79,6 +88,48 @@ bool SQLiteDB::load_vector_extension() {
     return true;
 }
 
+namespace {
+
+// BLOB 可能直接指向页缓冲区或 mmap 的文件页，不保证 float 对齐；未对齐时复制到每线程的缓冲区
+const float* aligned_floats(const void* blob, size_t n, std::vector<float>& scratch) {
+    if (reinterpret_cast<uintptr_t>(blob) % alignof(float) == 0) return static_cast<const float*>(blob);
+    scratch.resize(n);
+    std::memcpy(scratch.data(), blob, n * sizeof(float));
+    return scratch.data();
+}
+
+void sql_vec_cosine(sqlite3_context* ctx, int /*argc*/, sqlite3_value** argv) {
+    // 先检查类型：对非 BLOB 调用 sqlite3_value_bytes 会把值转换为文本
+    if (sqlite3_value_type(argv[0]) != SQLITE_BLOB || sqlite3_value_type(argv[1]) != SQLITE_BLOB) {
+        sqlite3_result_null(ctx);
+        return;
+    }
+    int bytes = sqlite3_value_bytes(argv[0]);
+    if (bytes != sqlite3_value_bytes(argv[1]) || bytes % sizeof(float) != 0) {
+        sqlite3_result_null(ctx);
+        return;
+    }
+    thread_local std::vector<float> scratch_a, scratch_b;
+    size_t n = bytes / sizeof(float);
+    const float* a = aligned_floats(sqlite3_value_blob(argv[0]), n, scratch_a);
+    const float* b = aligned_floats(sqlite3_value_blob(argv[1]), n, scratch_b);
+    sqlite3_result_double(ctx, distance::cosine(a, b, n));
+}
+
+} // namespace
+
+bool SQLiteDB::register_vector_functions() {
+    if (!db_) return false;
+
+    int rc = sqlite3_create_function_v2(db_, "vec_cosine", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+                                        nullptr, sql_vec_cosine, nullptr, nullptr, nullptr);
+    if (rc != SQLITE_OK) {
+        log_error("Failed to register vec_cosine", rc);
+        return false;
+    }
+    return true;
+}
+
 bool SQLiteDB::optimize_database() {
     if (!db_) return false;
 
@@ -347,10 +398,10 @@ std::vector<SQLiteSearchResult> SQLiteDB::search_vector(
 
     std::lock_guard<std::mutex> lock(db_mutex_);
 
-    // 尝试使用向量扩展语法
+    // 余弦相似度映射到 [0, 1]，与 FTS5 的归一化分数处于同一量级
     const char* sql = R"(
         SELECT c.id, c.doc_id, c.topic, c.content,
-               (1.0 / (1.0 + ABS(e.vector - ?))) AS score
+               (1.0 + vec_cosine(e.vector, ?)) / 2.0 AS score
         FROM embeddings e
         JOIN chunks c ON e.chunk_id = c.id
         ORDER BY score DESC
@@ -387,14 +438,14 @@ std::vector<SQLiteSearchResult> SQLiteDB::search_hybrid(
     const std::string& query_text,
     const std::vector<float>& query_embedding,
     int fts5_limit, int vector_limit,
-    double fts5_weight, double vector_weight) {
+    double fts5_weight, double vector_weight, int limit) {
 
     // 并行执行 FTS5 和向量检索
     auto fts5_results = search_fts5(query_text, fts5_limit);
     auto vector_results = search_vector(query_embedding, vector_limit);
 
-    // 使用 unordered_set 去重并合并结果
-    std::unordered_set<int> seen_ids;
+    // chunk_id -> merged_results 下标，用于去重合并
+    std::unordered_map<int, size_t> merged_index;
     std::vector<SQLiteSearchResult> merged_results;
 
     // 归一化分数
@@ -404,38 +455,39 @@ std::vector<SQLiteSearchResult> SQLiteDB::search_hybrid(
 
     // 添加 FTS5 结果
     for (auto& result : fts5_results) {
-        if (seen_ids.find(result.chunk_id) == seen_ids.end()) {
+        if (merged_index.find(result.chunk_id) == merged_index.end()) {
             result.score = normalize_fts5(result.score) * fts5_weight;
-            merged_results.push_back(result);
-            seen_ids.insert(result.chunk_id);
+            merged_index[result.chunk_id] = merged_results.size();
+            merged_results.push_back(std::move(result));
         }
     }
 
     // 添加向量结果
     for (auto& result : vector_results) {
-        auto it = seen_ids.find(result.chunk_id);
-        if (it == seen_ids.end()) {
+        auto it = merged_index.find(result.chunk_id);
+        if (it == merged_index.end()) {
             result.score = result.score * vector_weight;
-            merged_results.push_back(result);
-            seen_ids.insert(result.chunk_id);
+            merged_index[result.chunk_id] = merged_results.size();
+            merged_results.push_back(std::move(result));
         } else {
             // 如果已存在，更新分数（加权平均）
-            for (auto& merged_result : merged_results) {
-                if (merged_result.chunk_id == result.chunk_id) {
-                    merged_result.score += result.score * vector_weight;
-                    break;
-                }
-            }
+            merged_results[it->second].score += result.score * vector_weight;
         }
     }
 
-    // 按分数排序
-    std::sort(merged_results.begin(), merged_results.end(),
-              [](const SQLiteSearchResult& a, const SQLiteSearchResult& b) {
-                  return a.score > b.score;
-              });
+    // 按分数选出 top-limit
+    size_t k = limit < 0 ? merged_results.size() : static_cast<size_t>(limit);
+    TopK<size_t> top(k);
+    for (size_t i = 0; i < merged_results.size(); ++i) {
+        top.push(i, merged_results[i].score);
+    }
+
+    std::vector<SQLiteSearchResult> ranked;
+    for (const auto& entry : top.take_sorted()) {
+        ranked.push_back(std::move(merged_results[entry.first]));
+    }
 
-    return merged_results;
+    return ranked;
 }
 
 std::vector<SQLiteSearchResult> SQLiteDB::get_chunks_by_ids(
@@ -94,6 +94,7 @@ public:
      * @param vector_limit 向量结果数量
      * @param fts5_weight FTS5 权重
      * @param vector_weight 向量权重
+     * @param limit 返回结果数量（-1 表示返回全部融合结果）
      * @return 融合后的检索结果
      */
     std::vector<SQLiteSearchResult> search_hybrid(
@@ -102,7 +103,8 @@ public:
         int fts5_limit = 50,
         int vector_limit = 50,
         double fts5_weight = 0.6,
-        double vector_weight = 0.4
+        double vector_weight = 0.4,
+        int limit = -1
     );
 
     /**
@@ -177,6 +179,12 @@ private:
      */
     bool load_vector_extension();
 
+    /**
+     * 注册向量函数 vec_cosine(blob, blob)：两个 float32 数组的余弦相似度，
+     * 用 SIMD 距离内核计算；长度不一致或不是 float 数组时返回 NULL
+     */
+    bool register_vector_functions();
+
     /**
      * 创建表结构
      */
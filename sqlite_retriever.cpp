@@ -261,7 +261,8 @@ std::vector<SQLiteSearchResult> SQLiteRetriever::query_hybrid(
     return db_->search_hybrid(
         query, embedding,
         fts5_limit, vector_limit,
-        config_.fts5_weight, config_.vector_weight
+        config_.fts5_weight, config_.vector_weight,
+        limit
     );
 }
 
@@ -16,6 +16,9 @@ public:
     explicit ThreadPool(size_t numWorkers);  // Keep backward compatibility
     ~ThreadPool();
 
+    // 工作线程数
+    size_t size() const { return workers_.size(); }
+
     template<class F, class... Args>
     auto submit(F&& f, Args&&... args) -> std::future<decltype(f(args...))> {
         using RetT = decltype(f(args...));
@@ -337,6 +337,33 @@ std::vector<std::string> Tokenizer::filter_tokens(const std::vector<std::string>
     return filtered;
 }
 
+std::vector<TermId> Tokenizer::tokenize_ids(const std::string& text, const Vocabulary& vocab, Language lang) const {
+    auto tokens = tokenize(text, lang);
+    std::vector<TermId> ids;
+    ids.reserve(tokens.size());
+
+    for (const auto& token : tokens) {
+        TermId id = vocab.lookup(token);
+        if (id != kInvalidTermId) {
+            ids.push_back(id);
+        }
+    }
+
+    return ids;
+}
+
+std::vector<TermId> Tokenizer::intern_tokens(const std::string& text, Vocabulary& vocab, Language lang) const {
+    auto tokens = tokenize(text, lang);
+    std::vector<TermId> ids;
+    ids.reserve(tokens.size());
+
+    for (const auto& token : tokens) {
+        ids.push_back(vocab.intern(token));
+    }
+
+    return ids;
+}
+
 std::vector<std::vector<std::string>> Tokenizer::tokenize_batch(const std::vector<std::string>& texts, Language lang) const {
     std::vector<std::vector<std::string>> results;
     results.reserve(texts.size());
@@ -9,6 +9,7 @@
 #include <algorithm>
 #include <locale>
 #include <codecvt>
+#include "vocabulary.h"
 
 namespace rag {
 
@@ -91,6 +92,12 @@ public:
     // 主要的分词接口
     std::vector<std::string> tokenize(const std::string& text, Language lang = Language::AUTO) const;
 
+    // 分词并映射为词项ID（查询用）：词典中不存在的token直接丢弃
+    std::vector<TermId> tokenize_ids(const std::string& text, const Vocabulary& vocab, Language lang = Language::AUTO) const;
+
+    // 分词并写入词典（建索引用）：新token分配新ID
+    std::vector<TermId> intern_tokens(const std::string& text, Vocabulary& vocab, Language lang = Language::AUTO) const;
+
     // 批量分词
     std::vector<std::vector<std::string>> tokenize_batch(const std::vector<std::string>& texts, Language lang = Language::AUTO) const;
 
@@ -0,0 +1,62 @@
+#include "tombstones.h"
+#include <algorithm>
+
+namespace rag {
+
+void Tombstones::clear() {
+    flags_.clear();
+    index_.clear();
+    indexed_ = false;
+    count_ = 0;
+}
+
+void Tombstones::build_index(const MappedArray<uint64_t>& ids) {
+    index_.clear();
+    index_.reserve(ids.size());
+    for (size_t row = 0; row < ids.size(); ++row) {
+        if (!deleted(row)) index_[ids[row]] = row;
+    }
+    indexed_ = true;
+}
+
+void Tombstones::on_insert(size_t row, uint64_t id) {
+    if (deleted(row)) {
+        flags_.writable()[row] = 0;
+        --count_;
+    }
+    if (indexed_) index_[id] = row;
+}
+
+size_t Tombstones::remove(uint64_t id, const MappedArray<uint64_t>& ids) {
+    if (!indexed_) build_index(ids);
+    auto it = index_.find(id);
+    if (it == index_.end()) return kNone;
+    size_t row = it->second;
+    index_.erase(it);
+
+    auto &flags = flags_.writable();
+    if (flags.size() <= row) flags.resize(std::max(row + 1, ids.size()), 0);
+    flags[row] = 1;
+    ++count_;
+    return row;
+}
+
+size_t Tombstones::memory_usage() const {
+    return flags_.memory_usage() + index_.size() * (sizeof(uint64_t) + sizeof(size_t) + sizeof(void*));
+}
+
+void Tombstones::save(SnapshotWriter& writer) const {
+    writer.write_array(flags_);
+}
+
+bool Tombstones::load(SectionReader& reader, size_t rows) {
+    clear();
+    if (!reader.read_array(flags_) || flags_.size() > rows) {
+        clear();
+        return reader.fail();
+    }
+    count_ = static_cast<size_t>(std::count_if(flags_.begin(), flags_.end(), [](uint8_t f) { return f != 0; }));
+    return true;
+}
+
+} // namespace rag
@@ -0,0 +1,45 @@
+#pragma once
+#include "mapped_array.h"
+#include "snapshot.h"
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+
+namespace rag {
+
+// 向量行的删除标记（墓碑）：删除只做标记，检索时跳过，行本身由各索引自行回收或保留到重建
+// vector_id -> 行号的索引在第一次删除时按ID列建立，之后随插入维护；同一ID插入多次时只记录最后插入的行
+// 非线程安全，由使用方负责加锁
+class Tombstones {
+public:
+    static constexpr size_t kNone = std::numeric_limits<size_t>::max();
+
+    void clear();
+
+    size_t count() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    bool deleted(size_t row) const { return row < flags_.size() && flags_[row]; }
+
+    // 第 row 行写入了 id（追加或复用已删除的行）后调用
+    void on_insert(size_t row, uint64_t id);
+
+    // 标记 id 对应的行为已删除，返回行号；不存在或已删除时返回 kNone
+    size_t remove(uint64_t id, const MappedArray<uint64_t>& ids);
+
+    size_t memory_usage() const;
+
+    void save(SnapshotWriter& writer) const;
+    // 标记数多于 rows 时视为损坏，标记 reader 失败并返回 false
+    bool load(SectionReader& reader, size_t rows);
+
+private:
+    void build_index(const MappedArray<uint64_t>& ids);
+
+    MappedArray<uint8_t> flags_;  // 只覆盖到最后一个删除过的行，之后的行都有效
+    std::unordered_map<uint64_t, size_t> index_;
+    bool indexed_ = false;
+    size_t count_ = 0;
+};
+
+} // namespace rag
@@ -0,0 +1,68 @@
+#pragma once
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace rag {
+
+// 固定容量的top-K累加器（小顶堆）
+// 排序规则：分数降序，分数相同时 id 升序，保证结果确定
+// 选择复杂度 O(N log K)，内存只占 K 个元素
+template <typename Id, typename Score = double>
+class TopK {
+public:
+    using Entry = std::pair<Id, Score>;
+
+    explicit TopK(size_t k) : k_(k) { heap_.reserve(k); }
+
+    size_t capacity() const { return k_; }
+    size_t size() const { return heap_.size(); }
+    bool empty() const { return heap_.empty(); }
+    bool full() const { return heap_.size() >= k_; }
+
+    // 进入top-K所需超过的分数；未满时为最小值
+    Score threshold() const {
+        return full() && k_ > 0 ? heap_.front().second : std::numeric_limits<Score>::lowest();
+    }
+
+    // 分数为 score 的候选是否可能进入top-K（用于提前跳过）
+    bool would_accept(Score score) const {
+        return k_ > 0 && (!full() || score >= heap_.front().second);
+    }
+
+    // 插入候选，返回是否进入top-K
+    bool push(const Id& id, Score score) {
+        if (k_ == 0) return false;
+        if (heap_.size() < k_) {
+            heap_.emplace_back(id, score);
+            std::push_heap(heap_.begin(), heap_.end(), better);
+            return true;
+        }
+        if (!better(Entry(id, score), heap_.front())) return false;
+        std::pop_heap(heap_.begin(), heap_.end(), better);
+        heap_.back() = Entry(id, score);
+        std::push_heap(heap_.begin(), heap_.end(), better);
+        return true;
+    }
+
+    // 取出结果（按排序规则从好到差），累加器随之清空
+    std::vector<Entry> take_sorted() {
+        std::sort_heap(heap_.begin(), heap_.end(), better);
+        std::vector<Entry> out;
+        out.swap(heap_);
+        return out;
+    }
+
+    void clear() { heap_.clear(); }
+
+    static bool better(const Entry& a, const Entry& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    }
+
+private:
+    size_t k_;
+    std::vector<Entry> heap_;  // 堆顶为当前最差的结果
+};
+
+} // namespace rag
@@ -0,0 +1,53 @@
+#include "vector_arena.h"
+#include "distance.h"
+#include <algorithm>
+#include <cmath>
+
+namespace rag {
+
+void VectorArena::reset(size_t dim) {
+    dim_ = dim;
+    stride_ = (dim + kRowFloats - 1) / kRowFloats * kRowFloats;
+    data_.clear();
+    norms_.clear();
+}
+
+void VectorArena::reserve(size_t rows) {
+    data_.reserve(rows * stride_);
+    norms_.reserve(rows);
+}
+
+size_t VectorArena::append(const float* vector) {
+    auto &data = data_.writable();
+    size_t at = data.size();
+    data.resize(at + stride_, 0.0f);
+    std::copy(vector, vector + dim_, data.begin() + at);
+    norms_.push_back(std::sqrt(distance::dot(vector, vector, dim_)));
+    return norms_.size() - 1;
+}
+
+void VectorArena::assign(size_t i, const float* vector) {
+    std::copy(vector, vector + dim_, data_.writable().begin() + i * stride_);
+    norms_.writable()[i] = std::sqrt(distance::dot(vector, vector, dim_));
+}
+
+void VectorArena::save(SnapshotWriter& writer) const {
+    writer.write<uint64_t>(dim_);
+    writer.write<uint64_t>(stride_);
+    writer.write_array(data_);
+    writer.write_array(norms_);
+}
+
+bool VectorArena::load(SectionReader& reader) {
+    uint64_t dim = 0, stride = 0;
+    if (!reader.read(dim) || !reader.read(stride) || !reader.read_array(data_) || !reader.read_array(norms_) ||
+        stride < dim || stride % kRowFloats != 0 || data_.size() != norms_.size() * stride) {
+        reset();
+        return reader.fail();
+    }
+    dim_ = dim;
+    stride_ = stride;
+    return true;
+}
+
+} // namespace rag
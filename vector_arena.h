@@ -0,0 +1,49 @@
+#pragma once
+#include "mapped_array.h"
+#include "snapshot.h"
+#include <cstddef>
+
+namespace rag {
+
+// 向量行存储：所有向量按行连续存放在一块64字节对齐的内存中，每行补齐到64字节的整数倍，
+// 每行起始地址都对齐到缓存行；另存每行的 L2 模长，检索时余弦相似度只需一次点积
+// 可以直接引用快照的映射内存（快照数组同样按64字节对齐）
+// 非线程安全，由使用方负责加锁
+class VectorArena {
+public:
+    static constexpr size_t kAlignment = 64;
+    static constexpr size_t kRowFloats = kAlignment / sizeof(float);
+
+    // 清空并设置维度
+    void reset(size_t dim = 0);
+
+    size_t dim() const { return dim_; }
+    size_t stride() const { return stride_; }   // 每行的 float 数（含补齐）
+    size_t size() const { return norms_.size(); }
+    bool empty() const { return size() == 0; }
+
+    void reserve(size_t rows);
+
+    // 追加一行（dim() 个分量），返回行号
+    size_t append(const float* vector);
+    // 覆盖第 i 行
+    void assign(size_t i, const float* vector);
+
+    const float* row(size_t i) const { return data_.data() + i * stride_; }
+    float norm(size_t i) const { return norms_[i]; }
+
+    size_t memory_usage() const { return data_.memory_usage() + norms_.memory_usage(); }
+
+    // 打开快照时 load 只映射不读取；各索引把重排用的原始向量放在自己分段的最后
+    void save(SnapshotWriter& writer) const;
+    // 格式错误时标记 reader 失败并返回 false
+    bool load(SectionReader& reader);
+
+private:
+    size_t dim_ = 0;
+    size_t stride_ = 0;
+    MappedArray<float, AlignedAllocator<float, kAlignment>> data_;  // 行优先，每行 stride_ 个 float，补齐部分为0
+    MappedArray<float> norms_;                                      // 每行的 L2 模长
+};
+
+} // namespace rag
@@ -0,0 +1,298 @@
+#include "vector_store.h"
+#include "binary_vector_store.h"
+#include "distance.h"
+#include "hnsw_vector_store.h"
+#include "ivf_pq_vector_store.h"
+#include "quantized_vector_store.h"
+#include "top_k.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <mutex>
+
+namespace humanus {
+
+const char* vector_index_kind_name(VectorIndexKind kind) {
+    switch (kind) {
+        case VectorIndexKind::FLAT: return "flat";
+        case VectorIndexKind::INT8: return "flat/int8";
+        case VectorIndexKind::BINARY: return "flat/binary";
+        case VectorIndexKind::HNSW: return "hnsw";
+        case VectorIndexKind::IVF_PQ: return "ivf_pq";
+        case VectorIndexKind::CUSTOM:
+        default: return "custom";
+    }
+}
+
+void ItemColumn::set(size_t row, const MemoryItem& item) {
+    if (item.content.empty() && item.metadata.empty()) return;
+    items_[row] = item;
+}
+
+std::vector<MemoryItem> ItemColumn::collect(const std::vector<std::pair<size_t, double>>& ranked,
+                                            const rag::MappedArray<uint64_t>& ids) const {
+    std::vector<MemoryItem> results;
+    results.reserve(ranked.size());
+    for (const auto& [row, similarity] : ranked) {
+        auto it = items_.find(row);
+        if (it != items_.end()) {
+            results.push_back(it->second);
+        } else {
+            results.emplace_back();
+        }
+        results.back().id = ids[row];
+        results.back().similarity = similarity;
+    }
+    return results;
+}
+
+size_t ItemColumn::memory_usage() const {
+    size_t bytes = 0;
+    for (const auto &[row, item] : items_) {
+        bytes += sizeof(row) + sizeof(item) + item.content.capacity();
+        for (const auto &[key, value] : item.metadata) bytes += key.capacity() + value.capacity();
+    }
+    return bytes;
+}
+
+void MockVectorStore::reset() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    arena_.reset();
+    ids_.clear();
+    items_.clear();
+    tombstones_.clear();
+    reserved_ = 0;
+    mapping_.reset();
+}
+
+void MockVectorStore::insert(const std::vector<float>& vector, size_t vector_id, const MemoryItem& metadata) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (ids_.empty()) {
+        arena_.reset(vector.size());
+        arena_.reserve(reserved_);
+        ids_.reserve(reserved_);
+    }
+    if (vector.size() != arena_.dim()) {
+        std::cerr << "MockVectorStore: dimension mismatch (" << vector.size()
+                  << " vs " << arena_.dim() << "), vector " << vector_id << " ignored" << std::endl;
+        return;
+    }
+    size_t row = arena_.append(vector.data());
+    ids_.push_back(vector_id);
+    tombstones_.on_insert(row, vector_id);
+    items_.set(row, metadata);
+}
+
+bool MockVectorStore::remove(size_t vector_id) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    size_t row = tombstones_.remove(vector_id, ids_);
+    if (row == rag::Tombstones::kNone) return false;
+    items_.erase(row);
+    return true;
+}
+
+void MockVectorStore::reserve(size_t n) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    reserved_ = n;
+    if (!ids_.empty()) {
+        arena_.reserve(n);
+        ids_.reserve(n);
+    }
+}
+
+std::vector<MemoryItem> MockVectorStore::search(const std::vector<float>& query, size_t limit,
+                                                const rag::DocBitmap* filter) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (ids_.empty() || limit == 0) return {};
+    size_t dim = arena_.dim();
+    if (query.size() != dim) {
+        std::cerr << "MockVectorStore: query dimension mismatch (" << query.size()
+                  << " vs " << dim << ")" << std::endl;
+        return {};
+    }
+
+    // 行模长已预先计算，逐行只需一次点积
+    rag::TopK<size_t> top(limit);
+    float query_norm = std::sqrt(rag::distance::dot(query.data(), query.data(), dim));
+    for (size_t idx = 0; idx < ids_.size(); ++idx) {
+        if (filter && (ids_[idx] > UINT32_MAX || !filter->contains(static_cast<uint32_t>(ids_[idx])))) continue;
+        if (tombstones_.deleted(idx)) continue;
+        float norm_doc = arena_.norm(idx);
+        double similarity = 0.0;
+        if (query_norm > 0 && norm_doc > 0) {
+            similarity = rag::distance::dot(query.data(), arena_.row(idx), dim) / (query_norm * norm_doc);
+        }
+        top.push(idx, similarity);
+    }
+
+    return items_.collect(top.take_sorted(), ids_);
+}
+
+std::vector<std::vector<MemoryItem>> MockVectorStore::search_batch(const std::vector<std::vector<float>>& queries,
+                                                                   size_t limit) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    std::vector<std::vector<MemoryItem>> results(queries.size());
+    if (ids_.empty() || limit == 0) return results;
+    size_t dim = arena_.dim(), stride = arena_.stride();
+    std::vector<size_t> valid;
+    valid.reserve(queries.size());
+    for (size_t q = 0; q < queries.size(); ++q) {
+        if (queries[q].size() == dim) {
+            valid.push_back(q);
+        } else {
+            std::cerr << "MockVectorStore: query dimension mismatch (" << queries[q].size()
+                      << " vs " << dim << ")" << std::endl;
+        }
+    }
+
+    // 每块的行数取4的倍数，与内核的寄存器分块对齐
+    size_t row_tile = std::max<size_t>(4, kRowTileBytes / (stride * sizeof(float)) / 4 * 4);
+    auto run_tile = [&](size_t begin) {
+        size_t count = std::min(kQueryTile, valid.size() - begin);
+        // 查询按行跨度补零存放，与向量行的补齐部分相乘为0，内核不需要处理尾部
+        std::vector<float> packed(count * stride, 0.0f);
+        std::vector<float> query_norms(count);
+        for (size_t i = 0; i < count; ++i) {
+            const auto& query = queries[valid[begin + i]];
+            std::copy(query.begin(), query.end(), packed.begin() + i * stride);
+            query_norms[i] = std::sqrt(rag::distance::dot(query.data(), query.data(), dim));
+        }
+        std::vector<rag::TopK<size_t>> tops(count, rag::TopK<size_t>(limit));
+        std::vector<float> scores(count * row_tile);
+        for (size_t first = 0; first < ids_.size(); first += row_tile) {
+            size_t rows = std::min(row_tile, ids_.size() - first);
+            rag::distance::dot_block(packed.data(), count, stride, arena_.row(first), rows, stride, stride,
+                                     scores.data());
+            for (size_t i = 0; i < count; ++i) {
+                const float* s = scores.data() + i * rows;
+                for (size_t r = 0; r < rows; ++r) {
+                    size_t idx = first + r;
+                    if (tombstones_.deleted(idx)) continue;
+                    float norm_doc = arena_.norm(idx);
+                    double similarity = 0.0;
+                    if (query_norms[i] > 0 && norm_doc > 0) similarity = s[r] / (query_norms[i] * norm_doc);
+                    tops[i].push(idx, similarity);
+                }
+            }
+        }
+        for (size_t i = 0; i < count; ++i) results[valid[begin + i]] = items_.collect(tops[i].take_sorted(), ids_);
+    };
+
+    size_t tiles = (valid.size() + kQueryTile - 1) / kQueryTile;
+    if (!thread_pool_ || tiles < 2) {
+        for (size_t t = 0; t < tiles; ++t) run_tile(t * kQueryTile);
+        return results;
+    }
+    std::atomic<size_t> next{0};
+    std::vector<std::future<void>> futures;
+    size_t workers = std::min(thread_pool_->size(), tiles);
+    for (size_t w = 0; w < workers; ++w) {
+        futures.push_back(thread_pool_->submit([&] {
+            for (size_t t = next++; t < tiles; t = next++) run_tile(t * kQueryTile);
+        }));
+    }
+    for (auto &f : futures) f.get();
+    return results;
+}
+
+void MockVectorStore::set_thread_pool(std::shared_ptr<rag::ThreadPool> pool) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    thread_pool_ = std::move(pool);
+}
+
+std::shared_ptr<VectorStore> MockVectorStore::clone_empty() {
+    return std::make_shared<MockVectorStore>();
+}
+
+size_t MockVectorStore::memory_usage() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return arena_.memory_usage() + ids_.memory_usage() + tombstones_.memory_usage() +
+           items_.memory_usage();
+}
+
+bool MockVectorStore::save_snapshot(rag::SnapshotWriter& writer) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    writer.write_array(ids_);
+    arena_.save(writer);
+    tombstones_.save(writer);
+    return writer.ok();
+}
+
+bool MockVectorStore::load_snapshot(rag::SectionReader& reader) {
+    rag::MappedArray<uint64_t> ids;
+    rag::VectorArena arena;
+    rag::Tombstones tombstones;
+    if (!reader.read_array(ids) || !arena.load(reader) || arena.size() != ids.size() ||
+        !tombstones.load(reader, ids.size())) {
+        reader.fail();
+        std::cerr << "MockVectorStore: corrupt vector snapshot section" << std::endl;
+        return false;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    ids_ = std::move(ids);
+    arena_ = std::move(arena);
+    tombstones_ = std::move(tombstones);
+    items_.clear();
+    mapping_ = reader.file();
+    return true;
+}
+
+std::shared_ptr<VectorStore> VectorStore::create(const rag::VectorConfig& config, const rag::HNSWConfig& hnsw,
+                                                 const rag::IVFPQConfig& ivf_pq) {
+    if (config.quantization != "none" && config.quantization != "int8" && config.quantization != "binary") {
+        std::cerr << "VectorStore: unknown quantization '" << config.quantization << "', using none" << std::endl;
+    }
+    bool int8 = config.quantization == "int8";
+    bool binary = config.quantization == "binary";
+
+    if (config.index == "hnsw" || config.index == "ivf_pq") {
+        if (int8 || binary) {
+            std::cerr << "VectorStore: " << config.quantization
+                      << " quantization only applies to the flat index, ignored" << std::endl;
+        }
+        if (config.index == "ivf_pq") return std::make_shared<IVFPQVectorStore>(ivf_pq, config);
+        return std::make_shared<HNSWVectorStore>(hnsw, config);
+    }
+    if (config.index != "flat") {
+        std::cerr << "VectorStore: unknown index type '" << config.index << "', using flat" << std::endl;
+    }
+    if (int8) return std::make_shared<QuantizedVectorStore>(config);
+    if (binary) return std::make_shared<BinaryVectorStore>(config);
+    return std::make_shared<MockVectorStore>();
+}
+
+std::vector<float> MockEmbeddingModel::embed(const std::string& text, EmbeddingType type) {
+    // 简单的TF-IDF式embedding
+    std::vector<float> embedding(768, 0.0f);
+
+    // 基于文本hash生成特征向量
+    std::hash<std::string> hasher;
+    auto hash_val = hasher(text);
+
+    for (size_t i = 0; i < embedding.size(); ++i) {
+        embedding[i] = static_cast<float>((hash_val + i) % 1000) / 1000.0f;
+    }
+
+    // 归一化
+    float norm = 0.0f;
+    for (float val : embedding) {
+        norm += val * val;
+    }
+    norm = std::sqrt(norm);
+
+    if (norm > 0) {
+        for (float& val : embedding) {
+            val /= norm;
+        }
+    }
+
+    return embedding;
+}
+
+std::shared_ptr<EmbeddingModel> EmbeddingModel::get_instance(const std::string& name, std::shared_ptr<EmbeddingModelConfig> config) {
+    return std::make_shared<MockEmbeddingModel>();
+}
+
+} // namespace humanus
@@ -0,0 +1,179 @@
+#pragma once
+#include "config.h"
+#include "doc_bitmap.h"
+#include "mapped_array.h"
+#include "snapshot.h"
+#include "thread_pool.h"
+#include "tombstones.h"
+#include "vector_arena.h"
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// 向量存储与embedding模型接口
+// 简单的mock类，避免依赖复杂的humanus框架
+namespace humanus {
+    enum class EmbeddingType { DOCUMENT, QUERY };
+
+    struct VectorStoreConfig {
+        int vector_dim = 768;
+        int max_elements = 10000;
+        int ef_construction = 200;
+        int M = 16;
+    };
+
+    struct EmbeddingModelConfig {
+        std::string provider = "tfidf";
+    };
+
+    struct MemoryItem {
+        size_t id;
+        std::string content;
+        std::unordered_map<std::string, std::string> metadata;
+        double similarity = 0.0;
+    };
+
+    // 各向量索引共用的元数据列：行号 -> 插入时传入的非空 MemoryItem，检索结果按行号带上元数据
+    // 非线程安全，由使用方负责加锁
+    class ItemColumn {
+    public:
+        void clear() { items_.clear(); }
+        // content 与 metadata 都为空时不保存
+        void set(size_t row, const MemoryItem& item);
+        void erase(size_t row) { items_.erase(row); }
+
+        // top-K 的 (行号, 相似度) -> 结果，id 取 ids[行号]；只拷贝进入top-K的条目
+        std::vector<MemoryItem> collect(const std::vector<std::pair<size_t, double>>& ranked,
+                                        const rag::MappedArray<uint64_t>& ids) const;
+
+        size_t memory_usage() const;
+
+    private:
+        std::unordered_map<size_t, MemoryItem> items_;
+    };
+
+    // 向量索引的类型，写在快照向量段开头，打开快照时与当前索引比对；自定义索引为 CUSTOM
+    enum class VectorIndexKind : uint32_t {
+        CUSTOM = 0,
+        FLAT = 1,      // MockVectorStore
+        INT8 = 2,      // QuantizedVectorStore
+        BINARY = 3,    // BinaryVectorStore
+        HNSW = 4,      // HNSWVectorStore
+        IVF_PQ = 5     // IVFPQVectorStore
+    };
+
+    const char* vector_index_kind_name(VectorIndexKind kind);
+
+    class VectorStore {
+    public:
+        virtual ~VectorStore() = default;
+        virtual void reset() = 0;
+        virtual void insert(const std::vector<float>& vector, size_t vector_id, const MemoryItem& metadata) = 0;
+        // filter 不为空时只返回 vector_id 在其中的向量，检索时直接跳过其他向量
+        virtual std::vector<MemoryItem> search(const std::vector<float>& query, size_t limit,
+                                               const rag::DocBitmap* filter = nullptr) = 0;
+
+        // 批量检索，结果与 queries 一一对应；默认逐条 search()
+        virtual std::vector<std::vector<MemoryItem>> search_batch(const std::vector<std::vector<float>>& queries,
+                                                                  size_t limit) {
+            std::vector<std::vector<MemoryItem>> results;
+            results.reserve(queries.size());
+            for (const auto& query : queries) results.push_back(search(query, limit));
+            return results;
+        }
+
+        // 删除 vector_id 对应的向量，之后的检索不再返回；不存在或不支持删除时返回 false
+        // 同一ID插入多次时删除最后插入的一条
+        virtual bool remove(size_t /*vector_id*/) { return false; }
+
+        // 替换 vector_id 对应的向量（删除后重新插入，不带元数据）；不存在时返回 false
+        virtual bool update(size_t vector_id, const std::vector<float>& vector) {
+            if (!remove(vector_id)) return false;
+            insert(vector, vector_id, MemoryItem{});
+            return true;
+        }
+
+        // 批量插入（不带元数据），vectors[i] 的 ID 为 vector_ids[i]；默认逐条 insert()
+        virtual void insert_batch(const std::vector<std::vector<float>>& vectors, const std::vector<size_t>& vector_ids) {
+            for (size_t i = 0; i < vectors.size() && i < vector_ids.size(); ++i) {
+                insert(vectors[i], vector_ids[i], MemoryItem{});
+            }
+        }
+
+        // 预分配 n 个向量的空间，避免逐条插入时整块存储反复扩容；默认忽略
+        virtual void reserve(size_t /*n*/) {}
+
+        // 建索引可以使用的线程池；默认忽略
+        virtual void set_thread_pool(std::shared_ptr<rag::ThreadPool> /*pool*/) {}
+
+        // 创建同类型、同参数（含 set_ef_query 等调整过的检索参数）的空索引，不复制线程池；不支持时返回空指针
+        virtual std::shared_ptr<VectorStore> clone_empty() { return nullptr; }
+
+        virtual VectorIndexKind kind() const { return VectorIndexKind::CUSTOM; }
+
+        // 快照读写，不支持时返回 false
+        virtual bool save_snapshot(rag::SnapshotWriter& /*writer*/) { return false; }
+        virtual bool load_snapshot(rag::SectionReader& /*reader*/) { return false; }
+
+        // 按 VectorConfig::index / quantization 创建向量索引：flat 为 MockVectorStore，flat + int8 为 QuantizedVectorStore，
+        // flat + binary 为 BinaryVectorStore，hnsw 为 HNSWVectorStore，ivf_pq 为 IVFPQVectorStore；未知取值回退为 flat、不量化
+        static std::shared_ptr<VectorStore> create(const rag::VectorConfig& config, const rag::HNSWConfig& hnsw,
+                                                   const rag::IVFPQConfig& ivf_pq = rag::IVFPQConfig{});
+    };
+
+    class EmbeddingModel {
+    public:
+        virtual ~EmbeddingModel() = default;
+        virtual std::vector<float> embed(const std::string& text, EmbeddingType type) = 0;
+        static std::shared_ptr<EmbeddingModel> get_instance(const std::string& name, std::shared_ptr<EmbeddingModelConfig> config);
+    };
+
+    // 简单的mock实现：暴力计算余弦相似度
+    // 向量存放在 VectorArena 中（64字节对齐的连续行 + 预先计算的模长），从快照加载时直接引用映射内存
+    // 元数据与向量分开存放，只保存非空的 MemoryItem
+    // 批量检索按分块矩阵乘计算：kQueryTile 条查询 × 约 kRowTileBytes 字节的向量行为一块，
+    // 每行向量从内存读一次即可与整块查询计算内积，逐条检索时每条查询都要把全部向量读一遍
+    class MockVectorStore : public VectorStore {
+    public:
+        static constexpr size_t kQueryTile = 64;
+        static constexpr size_t kRowTileBytes = 64 * 1024;
+
+        void reset() override;
+        void insert(const std::vector<float>& vector, size_t vector_id, const MemoryItem& metadata) override;
+        std::vector<MemoryItem> search(const std::vector<float>& query, size_t limit,
+                                       const rag::DocBitmap* filter = nullptr) override;
+        // 设置了线程池时各查询块并行计算
+        std::vector<std::vector<MemoryItem>> search_batch(const std::vector<std::vector<float>>& queries,
+                                                          size_t limit) override;
+        void reserve(size_t n) override;
+        void set_thread_pool(std::shared_ptr<rag::ThreadPool> pool) override;
+        std::shared_ptr<VectorStore> clone_empty() override;
+        VectorIndexKind kind() const override { return VectorIndexKind::FLAT; }
+        // 删除的行只做标记，检索时跳过，重建前不回收
+        bool remove(size_t vector_id) override;
+
+        // 快照只保存向量与ID，加载的行检索结果中只有 id 和 similarity
+        bool save_snapshot(rag::SnapshotWriter& writer) override;
+        bool load_snapshot(rag::SectionReader& reader) override;
+
+        size_t memory_usage();
+
+    private:
+        rag::VectorArena arena_;                        // 第一次插入时确定维度
+        rag::MappedArray<uint64_t> ids_;                // 每行的 vector_id
+        ItemColumn items_;                              // 插入时传入的非空元数据
+        rag::Tombstones tombstones_;                    // 已删除的行
+        size_t reserved_ = 0;                           // 维度确定之前请求的预分配行数
+        std::shared_ptr<const rag::MappedFile> mapping_;
+        std::shared_ptr<rag::ThreadPool> thread_pool_;
+        std::shared_mutex mutex_;  // 插入与检索可以并发调用
+    };
+
+    class MockEmbeddingModel : public EmbeddingModel {
+    public:
+        std::vector<float> embed(const std::string& text, EmbeddingType type) override;
+    };
+}
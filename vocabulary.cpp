@@ -0,0 +1,115 @@
+#include "vocabulary.h"
+#include "snapshot.h"
+
+namespace rag {
+
+namespace {
+
+// 快照中的哈希表使用固定的哈希函数，不依赖标准库实现
+uint64_t hash_term(std::string_view term) {
+    uint64_t h = 14695981039346656037ULL;  // FNV-1a
+    for (unsigned char c : term) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+} // namespace
+
+TermId Vocabulary::intern(std::string_view term) {
+    TermId mapped = lookup_mapped(term);
+    if (mapped != kInvalidTermId) return mapped;
+
+    auto it = ids_.find(term);
+    if (it != ids_.end()) return it->second;
+
+    TermId id = static_cast<TermId>(size());
+    terms_.emplace_back(term);
+    ids_.emplace(std::string_view(terms_.back()), id);
+    return id;
+}
+
+TermId Vocabulary::lookup(std::string_view term) const {
+    TermId mapped = lookup_mapped(term);
+    if (mapped != kInvalidTermId) return mapped;
+
+    auto it = ids_.find(term);
+    return it == ids_.end() ? kInvalidTermId : it->second;
+}
+
+TermId Vocabulary::lookup_mapped(std::string_view term) const {
+    if (mapped_size_ == 0) return kInvalidTermId;
+    size_t mask = mapped_slots_.size() - 1;
+    for (size_t slot = hash_term(term) & mask; ; slot = (slot + 1) & mask) {
+        TermId id = mapped_slots_[slot];
+        if (id == kInvalidTermId || mapped_terms_[id] == term) return id;
+    }
+}
+
+void Vocabulary::clear() {
+    ids_.clear();
+    terms_.clear();
+    mapped_terms_.clear();
+    mapped_slots_.clear();
+    mapped_size_ = 0;
+}
+
+void Vocabulary::save_snapshot(SnapshotWriter& writer) const {
+    // 槽位数取不小于词项数两倍的2的幂，负载因子不超过 0.5
+    size_t n = size();
+    size_t capacity = 1;
+    while (capacity < n * 2) capacity <<= 1;
+
+    if (terms_.empty()) {
+        // 词项全部来自快照，原样写回
+        writer.write<uint64_t>(n);
+        writer.write_strings(mapped_terms_);
+        if (mapped_size_ > 0) {
+            writer.write_array(mapped_slots_);
+        } else {
+            writer.write_array(std::vector<TermId>(capacity, kInvalidTermId));
+        }
+        return;
+    }
+
+    StringColumn column;
+    column.offsets.reserve(n + 1);
+    for (TermId id = 0; id < n; ++id) column.push_back(term(id));
+
+    std::vector<TermId> slots(capacity, kInvalidTermId);
+    size_t mask = capacity - 1;
+    for (TermId id = 0; id < n; ++id) {
+        size_t slot = hash_term(term(id)) & mask;
+        while (slots[slot] != kInvalidTermId) slot = (slot + 1) & mask;
+        slots[slot] = id;
+    }
+
+    writer.write<uint64_t>(n);
+    writer.write_strings(column);
+    writer.write_array(slots);
+}
+
+bool Vocabulary::load_snapshot(SectionReader& reader) {
+    uint64_t n = 0;
+    StringColumn column;
+    MappedArray<TermId> slots;
+    if (!reader.read(n) || !reader.read_strings(column) || !reader.read_array(slots)) return false;
+
+    // 槽位数必须是2的幂且留有空槽，否则查找不会终止
+    size_t capacity = slots.size();
+    if (column.size() != n || capacity == 0 || (capacity & (capacity - 1)) != 0 || capacity <= n) {
+        return reader.fail();
+    }
+    for (size_t i = 0; i < capacity; ++i) {
+        if (slots[i] != kInvalidTermId && slots[i] >= n) return reader.fail();
+    }
+
+    clear();
+    mapped_terms_ = std::move(column);
+    mapped_slots_ = std::move(slots);
+    mapped_size_ = n;
+    return true;
+}
+
+} // namespace rag
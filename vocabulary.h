@@ -0,0 +1,65 @@
+#pragma once
+#include "mapped_array.h"
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace rag {
+
+class SnapshotWriter;
+class SectionReader;
+
+// 稠密词项ID
+using TermId = uint32_t;
+constexpr TermId kInvalidTermId = std::numeric_limits<TermId>::max();
+
+// 词典：在建索引时把token映射为连续的 uint32_t ID
+// 每个词项字符串只保存一份，哈希表的key引用这份存储
+// 从快照加载的词项直接引用映射内存（开放寻址哈希表随快照保存），之后新增的词项保存在自有存储中
+// 非线程安全，由使用方（如 BM25Indexer）负责加锁
+class Vocabulary {
+public:
+    Vocabulary() = default;
+    Vocabulary(const Vocabulary&) = delete;
+    Vocabulary& operator=(const Vocabulary&) = delete;
+    Vocabulary(Vocabulary&&) = default;              // 移动不改变元素地址，key仍然有效
+    Vocabulary& operator=(Vocabulary&&) = default;
+
+    // 查找词项ID，不存在时分配新ID
+    TermId intern(std::string_view term);
+
+    // 仅查找，不存在返回 kInvalidTermId
+    TermId lookup(std::string_view term) const;
+
+    // 根据ID取回词项
+    std::string_view term(TermId id) const {
+        return id < mapped_size_ ? mapped_terms_[id] : std::string_view(terms_[id - mapped_size_]);
+    }
+
+    size_t size() const { return mapped_size_ + terms_.size(); }
+    bool empty() const { return size() == 0; }
+
+    void reserve(size_t n) { ids_.reserve(n); }
+    void clear();
+
+    // 快照读写；加载的数据引用 SectionReader 的映射，由调用方保持映射有效
+    void save_snapshot(SnapshotWriter& writer) const;
+    bool load_snapshot(SectionReader& reader);
+
+private:
+    TermId lookup_mapped(std::string_view term) const;
+
+    // 快照中的词项：mapped_terms_ 为 ID -> 词项，mapped_slots_ 为按哈希值线性探测的 ID 表
+    StringColumn mapped_terms_;
+    MappedArray<TermId> mapped_slots_;
+    size_t mapped_size_ = 0;
+
+    // 新增的词项，ID 从 mapped_size_ 开始
+    std::deque<std::string> terms_;                     // ID -> 词项（deque保证元素地址稳定）
+    std::unordered_map<std::string_view, TermId> ids_;  // 词项 -> ID，key指向 terms_
+};
+
+} // namespace rag